@@ -0,0 +1,187 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Benchmarks of the non-ui parts of Runcher, over synthetic installs of generated Packs.
+//!
+//! Each install is a fake game folder with a `data` folder full of minimal mod Packs, just a valid header and nothing else.
+//! Configs, profiles and caches go to the config folder of `runcher_bench`, so running these never touches the real ones.
+//!
+//! Run them with `cargo bench`. Installs are generated in the temp folder the first time, and reused after that.
+
+use anyhow::{anyhow, Result};
+use criterion::{criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion};
+
+use std::fs::{read_dir, remove_dir_all, write, DirBuilder};
+use std::path::{Path, PathBuf};
+
+use rpfm_lib::games::{GameInfo, supported_games::KEY_WARHAMMER_3};
+
+use rpfm_ui_common::settings::config_path;
+use rpfm_ui_common::{ORGANISATION, PROGRAM_NAME, QUALIFIER};
+
+use runcher::integrations::{ConfigFormat, GameConfig, Profile};
+use runcher::mod_manager::discovery::{add_probed_packs, clear_mod_paths};
+use runcher::mod_manager::game_switch::{GameSwitchEvent, GameSwitchJob};
+use runcher::mod_manager::load_order::solve_load_order;
+use runcher::mod_manager::pack_cache::PackCache;
+use runcher::settings_ui::init_config_folders;
+use runcher::SUPPORTED_GAMES;
+
+/// Amount of Packs of each synthetic install.
+const PACK_COUNTS: [usize; 3] = [100, 1_000, 5_000];
+
+/// Amount of profiles saved for each install.
+const PROFILE_COUNT: usize = 20;
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+fn benchmarks(criterion: &mut Criterion) {
+    init_bench_config().expect("Failed to initialize the benchmark config folder.");
+    let game = SUPPORTED_GAMES.game(KEY_WARHAMMER_3).unwrap();
+
+    let mut group = criterion.benchmark_group("mod_manager");
+    group.sample_size(10);
+
+    for count in PACK_COUNTS {
+        let game_path = synthetic_install(count).expect("Failed to generate the synthetic install.");
+
+        // Every install starts from an empty config folder, so nothing from the previous one leaks into it.
+        reset_bench_config().expect("Failed to reset the benchmark config folder.");
+
+        group.bench_with_input(BenchmarkId::new("discovery_cold", count), &game_path, |bencher, game_path| bencher.iter_batched(
+            || reset_bench_config().unwrap(),
+            |_| game_switch(game, game_path).unwrap(),
+            BatchSize::PerIteration
+        ));
+
+        // From here on, the Pack cache stays warm, as it is on every launch but the first one.
+        let (mut game_config, pack_cache) = game_switch(game, &game_path).unwrap();
+        group.bench_with_input(BenchmarkId::new("discovery_warm", count), &game_path, |bencher, game_path| bencher.iter(|| {
+            game_switch(game, game_path).unwrap()
+        }));
+
+        for format in [ConfigFormat::Binary, ConfigFormat::Json] {
+            group.bench_function(BenchmarkId::new(format!("game_config_save_{}", format.key()), count), |bencher| bencher.iter(|| {
+                game_config.save(game, format).unwrap()
+            }));
+
+            group.bench_function(BenchmarkId::new(format!("game_config_load_{}", format.key()), count), |bencher| bencher.iter(|| {
+                GameConfig::load(game, false).unwrap()
+            }));
+        }
+
+        // Profiles with half the mods enabled, each one a different half.
+        let mod_ids = game_config.mods().keys().cloned().collect::<Vec<_>>();
+        let profiles = (0..PROFILE_COUNT)
+            .map(|index| {
+                let name = format!("profile_{index}");
+                let mut profile = Profile::default();
+                profile.set_id(name.to_owned());
+                profile.set_mods(mod_ids.iter().skip(index % 2).step_by(2).cloned().collect());
+                profile.save(game, &name, ConfigFormat::Binary).map(|_| profile)
+            })
+            .collect::<Result<Vec<_>>>()
+            .unwrap();
+
+        group.bench_function(BenchmarkId::new("profiles_list", count), |bencher| bencher.iter(|| {
+            Profile::profile_names_for_game(game).unwrap()
+        }));
+
+        let mut next_profile = profiles.iter().cycle();
+        group.bench_function(BenchmarkId::new("profile_apply", count), |bencher| bencher.iter(|| {
+            next_profile.next().unwrap().apply(&mut game_config)
+        }));
+
+        group.bench_function(BenchmarkId::new("load_order", count), |bencher| bencher.iter(|| {
+            solve_load_order(&game_config, &pack_cache).mods().len()
+        }));
+    }
+
+    group.finish();
+}
+
+/// This function runs a full game switch like the ui does, without the ui, returning the resulting config and Pack cache.
+fn game_switch(game: &GameInfo, game_path: &Path) -> Result<(GameConfig, PackCache)> {
+    let job = GameSwitchJob::spawn(game.clone(), Some(game_path.to_path_buf()));
+    let mut game_config = None;
+    while let Ok(event) = job.receiver().recv() {
+        match event {
+            GameSwitchEvent::ConfigLoaded(mut config) => {
+                clear_mod_paths(&mut config);
+                game_config = Some(config);
+            }
+
+            GameSwitchEvent::ProfilesListed(_) => {}
+            GameSwitchEvent::PacksProbed(packs) => {
+                if let Some(ref mut game_config) = game_config {
+                    add_probed_packs(game_config, &packs);
+                }
+            }
+
+            GameSwitchEvent::Finished(pack_cache, _) => return game_config.map(|config| (config, pack_cache)).ok_or_else(|| anyhow!("No config loaded.")),
+            GameSwitchEvent::Error(error) => return Err(error),
+        }
+    }
+
+    Err(anyhow!("Game switch job stopped before finishing."))
+}
+
+/// This function returns the folder of a synthetic install with the provided amount of Packs, generating it if needed.
+fn synthetic_install(count: usize) -> Result<PathBuf> {
+    let game_path = std::env::temp_dir().join("runcher_bench").join(format!("install_{count}"));
+    let data_path = game_path.join("data");
+    if data_path.is_dir() && read_dir(&data_path)?.count() == count {
+        return Ok(game_path);
+    }
+
+    if game_path.is_dir() {
+        remove_dir_all(&game_path)?;
+    }
+
+    DirBuilder::new().recursive(true).create(&data_path)?;
+    for index in 0..count {
+        write(data_path.join(format!("bench_mod_{index:05}.pack")), synthetic_pack())?;
+    }
+
+    Ok(game_path)
+}
+
+/// This function returns the data of an empty PFH5 mod Pack.
+fn synthetic_pack() -> Vec<u8> {
+    let mut data = b"PFH5".to_vec();
+    data.extend_from_slice(&3u32.to_le_bytes());
+
+    // Dependencies, files and their index sizes, and timestamp.
+    data.extend_from_slice(&[0; 20]);
+    data
+}
+
+/// This function points all config paths to the `runcher_bench` config folder.
+fn init_bench_config() -> Result<()> {
+    *QUALIFIER.write().unwrap() = "com".to_owned();
+    *ORGANISATION.write().unwrap() = "FrodoWazEre".to_owned();
+    *PROGRAM_NAME.write().unwrap() = "runcher_bench".to_owned();
+
+    init_config_folders()
+}
+
+fn reset_bench_config() -> Result<()> {
+    let path = config_path()?;
+    if path.is_dir() {
+        remove_dir_all(path)?;
+    }
+
+    init_config_folders()
+}
+
+criterion_group!(benches, benchmarks);
+criterion_main!(benches);
@@ -3,18 +3,68 @@ settings = Settings
 
 menu_bar_game_selected = Game Selected
 menu_bar_about = About
+menu_bar_debug = Debug
 
 about_qt = About QT
 about_runcher = About Runcher
+debug_timings = Timings
+debug_export_trace = Export Chrome Trace
 
 settings_game_line_ph = This is the folder where you have {"{"}{"}"} installed, where the .exe is.
 default_game = Default Game
 update_channel = Update Chanel
+config_format = Config Format
+config_format_binary = Binary
+config_format_json = Compact JSON
+config_format_pretty_json = Pretty-printed JSON
+thumbnail_cache_budget = Thumbnails Memory
+merge_small_mods = Merge Mods Smaller Than
+merge_small_mods_disabled = Disabled
+merge_small_mods_tooltip = Enabled mods smaller than this are merged into cached packs on launch, so the game has fewer packs to open. Merged packs are only rebuilt when their mods change.
+prewarm_budget = Prewarm Packs Up To
+prewarm_budget_disabled = Disabled
+prewarm_budget_tooltip = Once the enabled mods are saved, up to this much of their packs is read in the background, indexes first, so the game starts with them already in memory.
+prewarm_finished = Prewarmed {"{"}{"}"} MB of {"{"}{"}"} packs in {"{"}{"}"} ms.
+merged_packs_built = Built {"{"}{"}"} merged packs for the next launch.
 
 pack_name = Pack Name
 pack_path = Pack Path
 location = Location
 load_order = Load Order
+location_data = Data
+location_content = Content
+conflicts = Conflicts
+conflicts_cell = {"{"}{"}"} ({"{"}{"}"} overwritten)
+conflicts_tooltip = {"{"}{"}"} files ({"{"}{"}"} of them tables) are also in other enabled packs.
+conflicts_overwrites = This pack loads first, so it overwrites the files of: {"{"}{"}"}
+conflicts_overwritten_by = {"{"}{"}"} files ({"{"}{"}"} of them tables) are overwritten by: {"{"}{"}"}
+conflicts_overwritten_tables = Tables with overwritten files: {"{"}{"}"}
+    {"{"}{"}"}
+
+load_order_pin = Pin to Top
+load_order_unpin = Unpin
+load_order_load_before = Load Before...
+load_order_load_after = Load After...
+load_order_clear_rules = Clear Load Order Rules
+load_order_rule_title = Load Order Rule
+load_order_before_label = Load the selected packs before:
+load_order_after_label = Load the selected packs after:
+
+missing_dependencies_title = Missing Dependencies
+missing_dependencies_enabled = {"{"}{"}"} needs these packs, which are not installed or not enabled: {"{"}{"}"}
+missing_dependencies_disabled = {"{"}{"}"} is needed by these enabled mods: {"{"}{"}"}
+missing_dependencies_launch = These mods need packs that are not installed or not enabled, and the game may crash without them:
+
+    {"{"}{"}"}
+
+    Launch anyway?
+
+filter_regex = Search with a regular expression.
+filter_categories = Search also in the categories of the mods.
+filter_paths = Search also in the paths of the packs.
+filter_fuzzy = Fuzzy search: find mods by their name, pack name or Workshop title, even with typos, best matches first.
 
 load_profile = Load Profile
 save_profile = Save Profile
+profile_diff_text = Loading the profile {"{"}{"}"} will enable {"{"}{"}"} mods and disable {"{"}{"}"} mods. Load it?
+profile_unchanged = The profile {"{"}{"}"} is already applied.
@@ -24,6 +24,8 @@ use getset::*;
 use rpfm_ui_common::locale::qtr;
 use rpfm_ui_common::utils::*;
 
+use crate::profiling::span_with;
+
 const VIEW_DEBUG: &str = "ui_templates/actions_groupbox.ui";
 const VIEW_RELEASE: &str = "ui/actions_groupbox.ui";
 
@@ -56,7 +58,10 @@ impl ActionsUI {
 
         // Load the UI Template.
         let template_path = if cfg!(debug_assertions) { VIEW_DEBUG } else { VIEW_RELEASE };
-        let main_widget = load_template(main_window, template_path)?;
+        let main_widget = {
+            let _span = span_with("load_template", template_path);
+            load_template(main_window, template_path)?
+        };
 
         let play_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "play_button")?;
         let settings_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "settings_button")?;
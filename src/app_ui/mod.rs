@@ -11,47 +11,100 @@
 use qt_widgets::QAction;
 use qt_widgets::QActionGroup;
 use qt_widgets::QApplication;
+use qt_widgets::QDialog;
+use qt_widgets::QFileDialog;
+use qt_widgets::QInputDialog;
 use qt_widgets::QMainWindow;
+use qt_widgets::{QMessageBox, q_message_box::{Icon, StandardButton}};
+use qt_widgets::{QPlainTextEdit, q_plain_text_edit::LineWrapMode};
 use qt_widgets::QWidget;
 
+use qt_gui::{QFontDatabase, q_font_database::SystemFont};
+use qt_gui::QIcon;
+
 use qt_core::CheckState;
 use qt_core::QBox;
+use qt_core::QFileSystemWatcher;
 use qt_core::QPtr;
 use qt_core::QString;
+use qt_core::QStringList;
+use qt_core::QTimer;
+use qt_core::WidgetAttribute;
+
+use cpp_core::CppBox;
 
 use anyhow::{anyhow, Result};
 use getset::Getters;
 
-use std::collections::HashMap;
-use std::fs::File;
-use std::io::{BufWriter, Write};
-#[cfg(target_os = "windows")] use std::os::windows::process::CommandExt;
-use std::path::PathBuf;
-use std::process::Command;
+use std::collections::{BTreeSet, HashMap, HashSet};
+use std::path::{Path, PathBuf};
 use std::rc::Rc;
+use std::sync::mpsc::TryRecvError;
 use std::sync::{Arc, RwLock};
 
-use rpfm_lib::files::pack::Pack;
-use rpfm_lib::games::{GameInfo, pfh_file_type::PFHFileType, supported_games::*};
+use rpfm_lib::games::{GameInfo, supported_games::*};
 use rpfm_lib::integrations::log::*;
 
-use rpfm_ui_common::locale::qtr;
+use rpfm_ui_common::locale::{qtr, qtre, tre};
 use rpfm_ui_common::settings::*;
 use rpfm_ui_common::utils::*;
 
 use crate::actions_ui::ActionsUI;
-use crate::integrations::{GameConfig, Mod, Profile};
+use crate::integrations::{GameConfig, LoadOrder, LoadOrderRule, Profile};
+use crate::integrations::mod_ids::ModHandle;
+use crate::integrations::steam::{workshop_requests, WorkshopFetcher, WorkshopRequest};
 use crate::mod_list_ui::ModListUI;
+use crate::mod_manager::conflicts::ConflictAnalyzer;
+use crate::mod_manager::dependencies::DependencyGraph;
+use crate::mod_manager::discovery::{add_mod_path, add_probed_packs, clear_mod_paths, remove_mod_path};
+use crate::mod_manager::game_switch::{GameSwitchEvent, GameSwitchJob};
+use crate::mod_manager::launcher::{launch_game, mod_list_entries};
+use crate::mod_manager::load_order::{load_order, rule_cycle, update_load_order};
+use crate::mod_manager::merged_packs::{merge_jobs, MergeBuilder, ModListEntry};
+use crate::mod_manager::pack_cache::PackCache;
+use crate::mod_manager::pack_hasher::PackHasher;
+use crate::mod_manager::pack_watcher::{new_subfolders, packs_in_folder, FolderIndex};
+use crate::mod_manager::prewarm::Prewarmer;
+use crate::mod_manager::thumbnails::{ThumbnailLoader, ThumbnailLru, ThumbnailRequest};
 use crate::pack_list_ui::PackListUI;
+use crate::profiling::{export_chrome_trace, span, span_with, summary};
 use crate::settings_ui::SettingsUI;
-use crate::settings_ui::init_settings;
+use crate::settings_ui::{config_format, init_settings, merge_small_mods_max_size, prewarm_budget, profiles_path, thumbnail_cache_budget};
 use crate::SUPPORTED_GAMES;
 
 use self::slots::AppUISlots;
 
 pub mod slots;
 
-const CREATE_NO_WINDOW: u32 = 0x08000000;
+/// Time, in milliseconds, between checks for news from a game switch job, while it's running.
+const GAME_SWITCH_POLL_INTERVAL: i32 = 16;
+
+/// Time, in milliseconds, without changes before an edited game config gets saved.
+const GAME_CONFIG_SAVE_DELAY: i32 = 2000;
+
+/// Time, in milliseconds, between checks for results of the conflict analyzer, while it's busy.
+const CONFLICTS_POLL_INTERVAL: i32 = 50;
+
+/// Time, in milliseconds, between checks for finished hashes, while there are packs being hashed.
+const HASHING_POLL_INTERVAL: i32 = 250;
+
+/// Time, in milliseconds, between checks for Workshop data, while there are requests in flight.
+const WORKSHOP_POLL_INTERVAL: i32 = 250;
+
+/// Time, in milliseconds, between checks for finished prewarm passes, while there's one running.
+const PREWARM_POLL_INTERVAL: i32 = 250;
+
+/// Time, in milliseconds, between checks for built merged packs, while there are some being built.
+const MERGED_PACKS_POLL_INTERVAL: i32 = 250;
+
+/// Time, in milliseconds, between checks for loaded thumbnails, while there are thumbnails being loaded.
+const THUMBNAILS_POLL_INTERVAL: i32 = 50;
+
+/// Time, in milliseconds, the mod list has to stay still before we look for thumbnails to load.
+const VISIBLE_THUMBNAILS_DELAY: i32 = 50;
+
+/// Time, in milliseconds, without changes in the pack folders before we check them. Steam writes packs in chunks, so don't go too low.
+const PACK_FOLDERS_UPDATE_DELAY: i32 = 1000;
 //const DETACHED_PROCESS: u32 = 0x00000008;
 
 //-------------------------------------------------------------------------------//
@@ -93,6 +146,12 @@ pub struct AppUI {
     about_about_qt: QPtr<QAction>,
     about_about_runcher: QPtr<QAction>,
 
+    //-------------------------------------------------------------------------------//
+    // `Debug` menu.
+    //-------------------------------------------------------------------------------//
+    debug_timings: QPtr<QAction>,
+    debug_export_trace: QPtr<QAction>,
+
     //-------------------------------------------------------------------------------//
     // `Actions` section.
     //-------------------------------------------------------------------------------//
@@ -114,8 +173,65 @@ pub struct AppUI {
     focused_widget: Rc<RwLock<Option<QPtr<QWidget>>>>,
     disabled_counter: Rc<RwLock<u32>>,
 
+    // Timer to coalesce config changes into a single save.
+    game_config_save_timer: QBox<QTimer>,
+
     game_config: Arc<RwLock<Option<GameConfig>>>,
-    game_profiles: Arc<RwLock<HashMap<String, Profile>>>,
+
+    // Names of the profiles of the game selected. Profiles are only read from disk when loaded.
+    game_profiles: Arc<RwLock<BTreeSet<String>>>,
+
+    // Watcher over the profiles folder, to keep the profile names up to date without rescanning it.
+    profiles_watcher: QBox<QFileSystemWatcher>,
+    pack_cache: Arc<RwLock<PackCache>>,
+
+    // Dependencies between the installed mods of the game selected, built from the Pack cache.
+    dependency_graph: Arc<RwLock<DependencyGraph>>,
+
+    // Analyzer of the files overwritten between enabled packs, and the timer to pick up its results.
+    conflict_analyzer: ConflictAnalyzer,
+    conflicts_timer: QBox<QTimer>,
+
+    // Hasher of the contents of the installed mods, used to know when a mod actually changed.
+    pack_hasher: PackHasher,
+    hashing_timer: QBox<QTimer>,
+
+    // If packs got hashed since the merged packs were last requested, so they're requested again once hashing is done.
+    hashed_since_merge: Rc<RwLock<bool>>,
+
+    // Fetcher of the Workshop data of the installed mods, and the timer to pick it up.
+    workshop_fetcher: WorkshopFetcher,
+    workshop_timer: QBox<QTimer>,
+
+    // Prewarmer of the enabled packs, and the timer to report its passes.
+    prewarmer: Prewarmer,
+    prewarm_timer: QBox<QTimer>,
+
+    // Builder of the merged packs of the enabled mods, the amount it built since it was last idle, and the timer to report them.
+    merge_builder: MergeBuilder,
+    merged_packs_built: Rc<RwLock<usize>>,
+    merged_packs_timer: QBox<QTimer>,
+
+    // Thumbnails of the Workshop mods shown in the mod list, the ones being loaded, and the timers to request and pick them up.
+    thumbnail_loader: ThumbnailLoader,
+    thumbnails: Rc<RwLock<ThumbnailLru<CppBox<QIcon>>>>,
+    thumbnails_requested: Rc<RwLock<HashSet<ModHandle>>>,
+    thumbnails_timer: QBox<QTimer>,
+    visible_thumbnails_timer: QBox<QTimer>,
+
+    // Watcher over the pack folders of the game selected, so mods installed or updated in the background are picked up.
+    packs_watcher: QBox<QFileSystemWatcher>,
+    packs_watcher_timer: QBox<QTimer>,
+    watched_pack_folders: Rc<RwLock<HashSet<PathBuf>>>,
+    changed_pack_folders: Rc<RwLock<HashSet<PathBuf>>>,
+
+    // Watched folders new workshop mods appear in, and the packs of the game config by folder, to compare folders against.
+    content_pack_roots: Rc<RwLock<HashSet<PathBuf>>>,
+    pack_folder_index: Rc<RwLock<FolderIndex>>,
+
+    // Game switch job currently running, if any, and the timer to pick up its events.
+    game_switch_job: Rc<RwLock<Option<GameSwitchJob>>>,
+    game_switch_timer: QBox<QTimer>,
 
     // Game selected. Unlike RPFM, here it's not a global.
     game_selected: Rc<RwLock<GameInfo>>,
@@ -144,6 +260,7 @@ impl AppUI {
         status_bar.set_size_grip_enabled(false);
         let menu_bar_game_selected = menu_bar.add_menu_q_string(&qtr("menu_bar_game_selected"));
         let menu_bar_about = menu_bar.add_menu_q_string(&qtr("menu_bar_about"));
+        let menu_bar_debug = menu_bar.add_menu_q_string(&qtr("menu_bar_debug"));
 
         //-----------------------------------------------//
         // `Game Selected` Menu.
@@ -204,6 +321,12 @@ impl AppUI {
         let about_about_qt = menu_bar_about.add_action_q_string(&qtr("about_qt"));
         let about_about_runcher = menu_bar_about.add_action_q_string(&qtr("about_runcher"));
 
+        //-----------------------------------------------//
+        // `Debug` Menu.
+        //-----------------------------------------------//
+        let debug_timings = menu_bar_debug.add_action_q_string(&qtr("debug_timings"));
+        let debug_export_trace = menu_bar_debug.add_action_q_string(&qtr("debug_export_trace"));
+
         //-------------------------------------------------------------------------------//
         // `Actions` section.
         //-------------------------------------------------------------------------------//
@@ -219,6 +342,43 @@ impl AppUI {
         //-------------------------------------------------------------------------------//
         let pack_list_ui = PackListUI::new(&main_window)?;
 
+        let game_config_save_timer = QTimer::new_1a(&main_window);
+        game_config_save_timer.set_single_shot(true);
+        game_config_save_timer.set_interval(GAME_CONFIG_SAVE_DELAY);
+
+        let profiles_watcher = QFileSystemWatcher::new_1a(&main_window);
+        profiles_watcher.add_path(&QString::from_std_str(profiles_path()?.to_string_lossy()));
+
+        let conflicts_timer = QTimer::new_1a(&main_window);
+        conflicts_timer.set_interval(CONFLICTS_POLL_INTERVAL);
+
+        let hashing_timer = QTimer::new_1a(&main_window);
+        hashing_timer.set_interval(HASHING_POLL_INTERVAL);
+
+        let workshop_timer = QTimer::new_1a(&main_window);
+        workshop_timer.set_interval(WORKSHOP_POLL_INTERVAL);
+
+        let game_switch_timer = QTimer::new_1a(&main_window);
+        game_switch_timer.set_interval(GAME_SWITCH_POLL_INTERVAL);
+
+        let prewarm_timer = QTimer::new_1a(&main_window);
+        prewarm_timer.set_interval(PREWARM_POLL_INTERVAL);
+
+        let merged_packs_timer = QTimer::new_1a(&main_window);
+        merged_packs_timer.set_interval(MERGED_PACKS_POLL_INTERVAL);
+
+        let thumbnails_timer = QTimer::new_1a(&main_window);
+        thumbnails_timer.set_interval(THUMBNAILS_POLL_INTERVAL);
+
+        let visible_thumbnails_timer = QTimer::new_1a(&main_window);
+        visible_thumbnails_timer.set_single_shot(true);
+        visible_thumbnails_timer.set_interval(VISIBLE_THUMBNAILS_DELAY);
+
+        let packs_watcher = QFileSystemWatcher::new_1a(&main_window);
+        let packs_watcher_timer = QTimer::new_1a(&main_window);
+        packs_watcher_timer.set_single_shot(true);
+        packs_watcher_timer.set_interval(PACK_FOLDERS_UPDATE_DELAY);
+
         let app_ui = Arc::new(Self {
 
             //-------------------------------------------------------------------------------//
@@ -249,6 +409,12 @@ impl AppUI {
             about_about_qt,
             about_about_runcher,
 
+            //-------------------------------------------------------------------------------//
+            // "Debug" menu.
+            //-------------------------------------------------------------------------------//
+            debug_timings,
+            debug_export_trace,
+
             //-------------------------------------------------------------------------------//
             // `Actions` section.
             //-------------------------------------------------------------------------------//
@@ -269,8 +435,37 @@ impl AppUI {
             //-------------------------------------------------------------------------------//
             focused_widget: Rc::new(RwLock::new(None)),
             disabled_counter: Rc::new(RwLock::new(0)),
+            game_config_save_timer,
             game_config: Arc::new(RwLock::new(None)),
-            game_profiles: Arc::new(RwLock::new(HashMap::new())),
+            game_profiles: Arc::new(RwLock::new(BTreeSet::new())),
+            profiles_watcher,
+            pack_cache: Arc::new(RwLock::new(PackCache::default())),
+            dependency_graph: Arc::new(RwLock::new(DependencyGraph::default())),
+            conflict_analyzer: ConflictAnalyzer::spawn(),
+            conflicts_timer,
+            pack_hasher: PackHasher::spawn(),
+            hashing_timer,
+            hashed_since_merge: Rc::new(RwLock::new(false)),
+            workshop_fetcher: WorkshopFetcher::spawn(),
+            workshop_timer,
+            prewarmer: Prewarmer::spawn(),
+            prewarm_timer,
+            merge_builder: MergeBuilder::spawn(),
+            merged_packs_built: Rc::new(RwLock::new(0)),
+            merged_packs_timer,
+            thumbnail_loader: ThumbnailLoader::new(),
+            thumbnails: Rc::new(RwLock::new(ThumbnailLru::new(thumbnail_cache_budget()))),
+            thumbnails_requested: Rc::new(RwLock::new(HashSet::new())),
+            thumbnails_timer,
+            visible_thumbnails_timer,
+            packs_watcher,
+            packs_watcher_timer,
+            watched_pack_folders: Rc::new(RwLock::new(HashSet::new())),
+            changed_pack_folders: Rc::new(RwLock::new(HashSet::new())),
+            content_pack_roots: Rc::new(RwLock::new(HashSet::new())),
+            pack_folder_index: Rc::new(RwLock::new(FolderIndex::default())),
+            game_switch_job: Rc::new(RwLock::new(None)),
+            game_switch_timer,
 
             // NOTE: This loads arena on purpose, so ANY game selected triggers a game change properly.
             game_selected: Rc::new(RwLock::new(SUPPORTED_GAMES.game("arena").unwrap().clone())),
@@ -335,7 +530,29 @@ impl AppUI {
         self.about_about_qt().triggered().connect(slots.about_qt());
         self.about_about_runcher().triggered().connect(slots.about_runcher());
 
+        self.debug_timings().triggered().connect(slots.debug_timings());
+        self.debug_export_trace().triggered().connect(slots.debug_export_trace());
+
         self.mod_list_ui().model().item_changed().connect(slots.update_pack_list());
+        self.pack_list_ui().pin().triggered().connect(slots.pin_packs());
+        self.pack_list_ui().unpin().triggered().connect(slots.unpin_packs());
+        self.pack_list_ui().load_before().triggered().connect(slots.load_before());
+        self.pack_list_ui().load_after().triggered().connect(slots.load_after());
+        self.pack_list_ui().clear_rules().triggered().connect(slots.clear_load_order_rules());
+        self.game_config_save_timer().timeout().connect(slots.save_game_config());
+        self.profiles_watcher().directory_changed().connect(slots.refresh_profiles());
+        self.conflicts_timer().timeout().connect(slots.update_conflicts());
+        self.hashing_timer().timeout().connect(slots.update_hashes());
+        self.workshop_timer().timeout().connect(slots.update_workshop_data());
+        self.prewarm_timer().timeout().connect(slots.update_prewarm());
+        self.merged_packs_timer().timeout().connect(slots.update_merged_packs());
+        self.game_switch_timer().timeout().connect(slots.update_game_switch());
+        self.thumbnails_timer().timeout().connect(slots.update_thumbnails());
+        self.visible_thumbnails_timer().timeout().connect(slots.update_visible_thumbnails());
+        self.mod_list_ui().tree_view().vertical_scroll_bar().value_changed().connect(slots.request_visible_thumbnails());
+        self.mod_list_ui().tree_view().vertical_scroll_bar().range_changed().connect(slots.request_visible_thumbnails());
+        self.packs_watcher().directory_changed().connect(slots.pack_folder_changed());
+        self.packs_watcher_timer().timeout().connect(slots.update_pack_folders());
     }
 
     /// Function to toggle the main window on and off, while keeping the stupid focus from breaking.
@@ -375,6 +592,50 @@ impl AppUI {
         }
     }
 
+    /// This function saves the game config with the pending edits, and prepares the next launch if they changed the load order.
+    ///
+    /// Meant for the save timer. Anything else needing the config on disk should call [AppUI::flush_game_config].
+    pub unsafe fn save_game_config(&self) -> Result<()> {
+        if self.flush_game_config()? {
+            if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                self.build_merged_packs(game_config);
+                self.prewarm_packs(game_config);
+            }
+        }
+
+        Ok(())
+    }
+
+    /// This function saves the game config right away, if it has unsaved changes.
+    ///
+    /// Edits only mark the config as dirty and let the save timer coalesce them, so call this before anything that needs the config on disk.
+    /// Returns true if the solved load order changed, meaning the enabled mods or their order did.
+    pub unsafe fn flush_game_config(&self) -> Result<bool> {
+        self.game_config_save_timer().stop();
+
+        // Mid-switch, the config only has part of its mods discovered. It'll be saved on the next flush after the switch.
+        if self.game_switch_job().read().unwrap().is_some() {
+            return Ok(false);
+        }
+
+        if let Some(ref mut game_config) = *self.game_config().write().unwrap() {
+
+            // Launching reads the saved load order, so any change to the mods has to solve it again before saving.
+            // The order has all the enabled mods, so if it didn't change, neither did the enabled mods.
+            if *game_config.dirty() {
+                let previous_order = game_config.load_order().order().to_vec();
+                for cycle in update_load_order(game_config, &self.pack_cache().read().unwrap()) {
+                    warn!("Load order rules make a cycle, so they have been ignored: {}.", cycle.join(" > "));
+                }
+
+                game_config.save(&self.game_selected().read().unwrap(), config_format())?;
+                return Ok(previous_order != *game_config.load_order().order());
+            }
+        }
+
+        Ok(false)
+    }
+
     pub unsafe fn change_game_selected(&self) -> Result<()> {
 
         // Get the new `Game Selected` and clean his name up, so it ends up like "x_y".
@@ -390,119 +651,693 @@ impl AppUI {
         Ok(())
     }
 
+    /// This function changes the game selected, starting the background job that loads its config, profiles and mods.
+    ///
+    /// Returns as soon as the job is started. The ui keeps working while it runs, and [AppUI::update_game_switch] fills the
+    /// mod list as packs are found. If another game gets selected mid-switch, this job is cancelled and replaced.
     pub unsafe fn set_game_selected(&self, game: &str) -> Result<()> {
 
         // We may receive invalid games here, so rule out the invalid ones.
         match SUPPORTED_GAMES.game(game) {
             Some(game) => {
+
+                // Don't lose pending changes of the game we're leaving.
+                self.flush_game_config()?;
                 *self.game_selected().write().unwrap() = game.clone();
 
-                // Load the game's config.
-                *self.game_config().write().unwrap() = Some(GameConfig::load(game, true)?);
+                // If we don't have a path in the settings for the game, the mod discovery is skipped.
+                let game_path = setting_string(game.game_key_name());
+                let game_path = if game_path.is_empty() { None } else { Some(PathBuf::from(game_path)) };
+
+                // Cancel any switch still running. Its events are never read again.
+                let job = GameSwitchJob::spawn(game.clone(), game_path);
+                if let Some(previous) = self.game_switch_job().write().unwrap().replace(job) {
+                    previous.cancel();
+                }
+
+                // Until the switch is done, whatever we had from the previous game is invalid.
+                self.clear_game_state();
+                self.pack_hasher().clear();
+                self.hashing_timer().stop();
+                self.workshop_fetcher().clear();
+                self.workshop_timer().stop();
+                self.prewarmer().clear();
+                self.prewarm_timer().stop();
+                self.merge_builder().clear();
+                self.merged_packs_timer().stop();
+                self.clear_thumbnails();
+
+                // We don't lock the window, as the user has to be able to change the game selected mid-scan.
+                // Just the actions that need the full mod list.
+                self.actions_ui().play_button().set_enabled(false);
+                self.actions_ui().profile_load_button().set_enabled(false);
+                self.actions_ui().profile_save_button().set_enabled(false);
+
+                self.game_switch_timer().start_0a();
+                Ok(())
+            },
+            None => Err(anyhow!("Game {} is not a valid game.", game)),
+        }
+    }
+
+    /// This function applies the events the game switch job sent since the last call, and finishes the switch once the job is done.
+    ///
+    /// If the job fails or stops before finishing, the switch is aborted and the error returned. Whatever the job loaded is
+    /// dropped with it, so a config with half its mods discovered never gets saved.
+    pub unsafe fn update_game_switch(&self) -> Result<()> {
+        let _span = span("game_switch_update");
+        loop {
+            let event = match *self.game_switch_job().read().unwrap() {
+                Some(ref job) => job.receiver().try_recv(),
+                None => Err(TryRecvError::Empty),
+            };
+
+            match event {
+                Ok(GameSwitchEvent::ConfigLoaded(mut game_config)) => {
+
+                    // Clear the previous paths. Discovery will re-add the ones still valid.
+                    clear_mod_paths(&mut game_config);
+                    *self.game_config().write().unwrap() = Some(game_config);
+                }
+
+                Ok(GameSwitchEvent::ProfilesListed(profiles)) => {
+                    *self.game_profiles().write().unwrap() = profiles;
+                    self.update_profile_combobox();
+                }
 
-                // Load the profile's list.
-                *self.game_profiles().write().unwrap() = Profile::profiles_for_game(game)?;
-                self.actions_ui().profile_model().clear();
+                Ok(GameSwitchEvent::PacksProbed(packs)) => {
+                    if let Some(ref mut game_config) = *self.game_config().write().unwrap() {
+                        for mod_id in add_probed_packs(game_config, &packs) {
+                            if let Some(modd) = game_config.mods().get(&mod_id) {
+                                self.mod_list_ui().append_mod(modd);
+                            }
+                        }
+                    }
+                }
 
-                for profile in self.game_profiles().read().unwrap().keys() {
-                    self.actions_ui().profile_combobox().add_item_q_string(&QString::from_std_str(profile));
+                Ok(GameSwitchEvent::Finished(pack_cache, folders)) => {
+                    *self.pack_cache().write().unwrap() = pack_cache;
+                    *self.content_pack_roots().write().unwrap() = folders.content_roots.into_iter().collect();
+                    self.watch_pack_folders(folders.folders);
+                    self.end_game_switch();
+                    return self.populate_game_lists();
                 }
 
-                // If we don't have a path in the settings for the game, disable the play button.
-                let game_path = setting_string(game.game_key_name());
-                self.actions_ui().play_button().set_enabled(!game_path.is_empty());
-
-                // If we have a path, load all the mods to the UI.
-                if !game_path.is_empty() {
-                    let game_path = PathBuf::from(game_path);
-                    let data_paths = game.data_packs_paths(&game_path);
-                    let content_paths = game.content_packs_paths(&game_path);
-
-                    // Initialize the mods in loadable folders.
-                    {
-                        let mut mods = self.game_config().write().unwrap();
-                        if let Some(ref mut mods) = *mods {
-
-                            // Clear the previous paths.
-                            mods.mods_mut().values_mut().for_each(|modd| modd.paths_mut().clear());
-
-                            if let Some(ref paths) = data_paths {
-                                for path in paths {
-                                    let pack_name = path.file_name().unwrap().to_string_lossy().as_ref().to_owned();
-                                    let pack = Pack::read_and_merge(&[path.to_path_buf()], true, false)?;
-                                    if pack.pfh_file_type() == PFHFileType::Mod {
-                                        match mods.mods_mut().get_mut(&pack_name) {
-                                            Some(modd) => {
-                                                if !modd.paths().contains(path) {
-                                                    modd.paths_mut().push(path.to_path_buf());
-                                                }
-                                            }
-                                            None => {
-                                                let mut modd = Mod::default();
-                                                modd.set_name(pack_name.to_owned());
-                                                modd.set_id(pack_name.to_owned());
-                                                modd.set_paths(vec![path.to_path_buf()]);
-                                                mods.mods_mut().insert(pack_name, modd);
-                                            }
-                                        }
-                                    }
+                Ok(GameSwitchEvent::Error(error)) => {
+                    self.abort_game_switch();
+                    return Err(error);
+                }
+
+                Err(TryRecvError::Disconnected) => {
+                    self.abort_game_switch();
+                    return Err(anyhow!("Loading {} stopped before finishing.", self.game_selected().read().unwrap().display_name()));
+                }
+
+                // Nothing else for now. Wait for the next tick, so the ui can process its own events in between.
+                Err(TryRecvError::Empty) => return Ok(()),
+            }
+        }
+    }
+
+    /// This function stops polling the game switch job, and enables back the actions disabled while it ran.
+    unsafe fn end_game_switch(&self) {
+        self.game_switch_timer().stop();
+        *self.game_switch_job().write().unwrap() = None;
+
+        let game_path = setting_string(self.game_selected().read().unwrap().game_key_name());
+        self.actions_ui().play_button().set_enabled(!game_path.is_empty());
+        self.actions_ui().profile_load_button().set_enabled(true);
+        self.actions_ui().profile_save_button().set_enabled(true);
+    }
+
+    /// This function ends a game switch that didn't finish, dropping everything it had loaded.
+    unsafe fn abort_game_switch(&self) {
+        self.clear_game_state();
+        self.end_game_switch();
+    }
+
+    /// This function drops the config, profiles, Pack cache and lists of the game selected, and stops the workers over them.
+    unsafe fn clear_game_state(&self) {
+        *self.game_config().write().unwrap() = None;
+        *self.game_profiles().write().unwrap() = BTreeSet::new();
+        *self.pack_cache().write().unwrap() = PackCache::default();
+        self.unwatch_pack_folders();
+        self.conflict_analyzer().sync(vec![]);
+        self.actions_ui().profile_model().clear();
+        self.mod_list_ui().clear();
+        self.pack_list_ui().clear();
+    }
+
+    /// This function fills the lists and starts the background workers, once all the mods of the game selected are known.
+    unsafe fn populate_game_lists(&self) -> Result<()> {
+        let _span = span("game_switch_populate_lists");
+        let mods = self.game_config().read().unwrap();
+        if let Some(ref mods) = *mods {
+            *self.dependency_graph().write().unwrap() = DependencyGraph::build(mods, &self.pack_cache().read().unwrap());
+            *self.pack_folder_index().write().unwrap() = FolderIndex::build(mods);
+            self.mod_list_ui().sort();
+            self.pack_list_ui().load(mods, &self.pack_cache().read().unwrap())?;
+            self.sync_conflicts(mods);
+
+            let paths = mods.mods().values().flat_map(|modd| modd.paths().iter()).map(|path| path.as_path()).collect::<Vec<_>>();
+            self.queue_hashes(&self.pack_cache().read().unwrap(), &paths);
+            self.fetch_workshop_data(workshop_requests(mods.mods().values()));
+            self.build_merged_packs(mods);
+            self.prewarm_packs(mods);
+
+            let previews = mods.mods().values()
+                .filter_map(|modd| Some((modd.steam_id().clone()?, *modd.time_updated())))
+                .collect();
+            self.thumbnail_loader().prune_previews(mods.game_key(), previews);
+        }
+
+        self.visible_thumbnails_timer().start_0a();
+        Ok(())
+    }
+
+    /// This function makes the conflict analyzer work over the enabled mods of the provided game config, in the load order of the pack list.
+    pub unsafe fn sync_conflicts(&self, game_config: &GameConfig) {
+        let packs = self.pack_list_ui().mod_ids()
+            .into_iter()
+            .filter_map(|id| {
+                let path = game_config.mods().get(&id)?.paths().first()?.to_path_buf();
+                Some((id, path))
+            })
+            .collect();
+
+        self.conflict_analyzer().sync(packs);
+        self.conflicts_timer().start_0a();
+    }
+
+    /// This function tells the conflict analyzer the load order of the pack list, so it knows which pack wins each file.
+    ///
+    /// Call it after changing the pack list, once the analyzer has been told about the packs added or removed.
+    pub unsafe fn update_conflicts_order(&self) {
+        self.conflict_analyzer().set_order(self.pack_list_ui().mod_ids());
+        self.conflicts_timer().start_0a();
+    }
+
+    /// This function applies to the pack list whatever the conflict analyzer has finished, and stops polling once it's idle.
+    pub unsafe fn update_conflicts(&self) {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.conflict_analyzer().is_busy();
+        let updates = self.conflict_analyzer().updates();
+        if !updates.is_empty() {
+            if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                self.pack_list_ui().set_conflicts(game_config, updates);
+            }
+        }
+
+        if idle {
+            self.conflicts_timer().stop();
+        }
+    }
+
+    /// This function queues for hashing the provided packs, if they haven't been hashed since they last changed.
+    pub unsafe fn queue_hashes(&self, pack_cache: &PackCache, paths: &[&Path]) {
+        let requests = pack_cache.hash_requests(paths);
+        if !requests.is_empty() {
+            self.pack_hasher().queue(requests);
+            self.hashing_timer().start_0a();
+        }
+    }
+
+    /// This function stores the hashes finished so far in the pack cache, and re-indexes the conflicts of enabled mods whose files really changed.
+    pub unsafe fn update_hashes(&self) -> Result<()> {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.pack_hasher().is_busy();
+        let results = self.pack_hasher().results();
+
+        let mut pack_cache = self.pack_cache().write().unwrap();
+        let mut reindexed = false;
+        let mut hashed = *self.hashed_since_merge().read().unwrap();
+        for result in &results {
+            let stored = pack_cache.set_content_hash(result);
+            hashed |= stored;
+            if stored && *result.indexes_changed() == Some(true) {
+                if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                    let pack_name = result.path().file_name().unwrap().to_string_lossy();
+                    if let Some(modd) = game_config.mods().get(pack_name.as_ref()) {
+                        if *modd.enabled() && modd.paths().first() == Some(result.path()) {
+                            self.conflict_analyzer().insert(modd.id(), result.path().to_path_buf());
+                            reindexed = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        if reindexed {
+            self.conflicts_timer().start_0a();
+        }
+
+        // Hashes are expensive, so don't wait for the next game switch to persist them.
+        if idle {
+            self.hashing_timer().stop();
+            pack_cache.save(&self.game_selected().read().unwrap())?;
+        }
+
+        // Merged packs are named after the hashes, so once they're all in, the builder can adopt or build the runs waiting for them.
+        // Not before, as every new request cancels whatever it's building.
+        *self.hashed_since_merge().write().unwrap() = hashed && !idle;
+        if hashed && idle {
+            drop(pack_cache);
+            if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                self.build_merged_packs(game_config);
+            }
+        }
+
+        Ok(())
+    }
+
+    /// This function reads ahead the packs in the mod list of the provided game config, in load order, if enabled in the settings.
+    ///
+    /// The game reads them in the same order on start, so by the time it's launched most of them should be in memory.
+    /// With merging enabled, that's the merged packs already built, and the mods of the runs not yet merged.
+    pub unsafe fn prewarm_packs(&self, game_config: &GameConfig) {
+        let budget = prewarm_budget();
+        if budget == 0 {
+            return;
+        }
+
+        let pack_cache = self.pack_cache().read().unwrap();
+        let mods = load_order(game_config, &pack_cache);
+        let paths = mod_list_entries(&self.game_selected().read().unwrap(), &mods, &pack_cache, false)
+            .into_iter()
+            .map(|entry| match entry {
+                ModListEntry::Mod(modd) => modd.paths()[0].to_path_buf(),
+                ModListEntry::Merged(path) => path,
+            })
+            .collect();
+
+        if self.prewarmer().prewarm(paths, budget) {
+            self.prewarm_timer().start_0a();
+        }
+    }
+
+    /// This function stops whatever is being prewarmed. Meant for when the game is launched or Runcher is closed, as then
+    /// reading ahead only competes with the game for the disk.
+    pub unsafe fn stop_prewarm(&self) {
+        self.prewarmer().clear();
+        self.prewarm_timer().stop();
+    }
+
+    /// This function builds in the background the merged packs of the provided game config not yet cached, if merging is enabled.
+    ///
+    /// Whatever was being built for an older load order is dropped, as launching with it is no longer possible.
+    pub unsafe fn build_merged_packs(&self, game_config: &GameConfig) {
+        let max_size = merge_small_mods_max_size();
+        let game = self.game_selected().read().unwrap();
+        if max_size == 0 {
+            self.merge_builder().build(&game, vec![]);
+            return;
+        }
+
+        let pack_cache = self.pack_cache().read().unwrap();
+        match merge_jobs(&game, &load_order(game_config, &pack_cache), &pack_cache, max_size) {
+            Ok(jobs) => {
+                let building = !jobs.is_empty();
+                self.merge_builder().build(&game, jobs);
+                if building {
+                    self.merged_packs_timer().start_0a();
+                }
+            }
+            Err(error) => warn!("Merged packs not built, so mods will be launched on their own: {}", error),
+        }
+    }
+
+    /// This function stops polling the merge builder once it's idle, and reports what it built in the status bar.
+    ///
+    /// New merged packs change the packs the game reads on start, so they're prewarmed in place of their mods.
+    pub unsafe fn update_merged_packs(&self) {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.merge_builder().is_busy();
+        *self.merged_packs_built().write().unwrap() += self.merge_builder().results().len();
+
+        if idle {
+            self.merged_packs_timer().stop();
+
+            let built = std::mem::take(&mut *self.merged_packs_built().write().unwrap());
+            if built > 0 {
+                log_to_status_bar(self.main_window().status_bar(), &tre("merged_packs_built", &[&built.to_string()]));
+                if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                    self.prewarm_packs(game_config);
+                }
+            }
+        }
+    }
+
+    /// This function reports the prewarm passes finished so far in the status bar, and stops polling once the prewarmer is idle.
+    pub unsafe fn update_prewarm(&self) {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.prewarmer().is_busy();
+        if let Some(report) = self.prewarmer().results().last() {
+            let megabytes = (report.bytes() / (1024 * 1024)).to_string();
+            let packs = report.packs().to_string();
+            let millis = report.elapsed().as_millis().to_string();
+            log_to_status_bar(self.main_window().status_bar(), &tre("prewarm_finished", &[&megabytes, &packs, &millis]));
+        }
+
+        if idle {
+            self.prewarm_timer().stop();
+        }
+    }
+
+    /// This function requests the Workshop data of the provided mods. Results are applied as they arrive.
+    pub unsafe fn fetch_workshop_data(&self, requests: Vec<WorkshopRequest>) {
+        if !requests.is_empty() {
+            self.workshop_fetcher().fetch(&self.game_selected().read().unwrap(), requests);
+            self.workshop_timer().start_0a();
+        }
+    }
+
+    /// This function fills the mods with the Workshop data received so far, and updates their items in the mod list.
+    pub unsafe fn update_workshop_data(&self) {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.workshop_fetcher().is_busy();
+        let items = self.workshop_fetcher().results();
+
+        if !items.is_empty() {
+            if let Some(ref mut game_config) = *self.game_config().write().unwrap() {
+                let mod_ids = game_config.mods()
+                    .values()
+                    .filter_map(|modd| Some((modd.steam_id().clone()?, modd.id().to_owned())))
+                    .collect::<HashMap<_, _>>();
+
+                let game_key = game_config.game_key().to_owned();
+                let mut changed = false;
+                for item in &items {
+                    if let Some(modd) = mod_ids.get(item.steam_id()).and_then(|mod_id| game_config.mods_mut().get_mut(mod_id)) {
+                        let previous_update = *modd.time_updated();
+                        if item.apply(modd) {
+                            if previous_update != 0 && previous_update != *modd.time_updated() {
+                                self.thumbnail_loader().remove_preview(&game_key, item.steam_id(), previous_update);
+                            }
+
+                            self.mod_list_ui().update_mod(modd);
+                            changed = true;
+                        }
+                    }
+                }
+
+                if changed {
+                    self.mod_list_ui().sort();
+                    game_config.set_dirty(true);
+                    self.game_config_save_timer().start_0a();
+
+                    // Updated mods got new items, without thumbnails.
+                    self.visible_thumbnails_timer().start_0a();
+                }
+            }
+        }
+
+        if idle {
+            self.workshop_timer().stop();
+        }
+    }
+
+    /// This function loads the thumbnails of the Workshop mods in view that we don't have yet, and marks the rest as used.
+    ///
+    /// Only the rows in view are checked, so scrolling a big list only costs the thumbnails actually seen.
+    pub unsafe fn update_visible_thumbnails(&self) {
+        let game_config = self.game_config().read().unwrap();
+        let game_config = match *game_config {
+            Some(ref game_config) => game_config,
+            None => return,
+        };
+
+        let size = self.mod_list_ui().thumbnail_size();
+        let mut thumbnails = self.thumbnails().write().unwrap();
+        let mut requested = self.thumbnails_requested().write().unwrap();
+        let mut shown = vec![];
+        for handle in self.mod_list_ui().visible_mods() {
+            if thumbnails.get(handle).is_some() {
+                shown.push(handle);
+            } else if !requested.contains(&handle) {
+                if let Some(modd) = game_config.mod_by_handle(handle) {
+                    if let (Some(steam_id), Some(url)) = (modd.steam_id(), modd.preview_url()) {
+                        self.thumbnail_loader().load(ThumbnailRequest {
+                            handle,
+                            game_key: game_config.game_key().to_owned(),
+                            steam_id: steam_id.to_owned(),
+                            url: url.to_owned(),
+                            time_updated: *modd.time_updated(),
+                            size,
+                        });
+
+                        requested.insert(handle);
+                    }
+                }
+            }
+        }
+
+        // Items rebuilt since their thumbnail was loaded lost it.
+        let shown = shown.iter().map(|handle| (*handle, thumbnails.peek(*handle).map(|icon| &**icon))).collect::<Vec<_>>();
+        self.mod_list_ui().set_thumbnails(&shown);
+
+        if !requested.is_empty() {
+            self.thumbnails_timer().start_0a();
+        }
+    }
+
+    /// This function shows the thumbnails loaded so far, and removes the ones evicted to make room for them.
+    pub unsafe fn update_thumbnails(&self) {
+
+        // Check this first. If it was idle before taking the results, we have all of them.
+        let idle = !self.thumbnail_loader().is_busy();
+        let results = self.thumbnail_loader().results();
+
+        let mut thumbnails = self.thumbnails().write().unwrap();
+        let mut requested = self.thumbnails_requested().write().unwrap();
+        let mut changed = HashSet::new();
+        for thumbnail in &results {
+            requested.remove(thumbnail.handle());
+            let icon = ModListUI::thumbnail_icon(thumbnail);
+            changed.extend(thumbnails.insert(*thumbnail.handle(), icon, thumbnail.rgba().len()));
+            changed.insert(*thumbnail.handle());
+        }
+
+        let changed = changed.iter().map(|handle| (*handle, thumbnails.peek(*handle).map(|icon| &**icon))).collect::<Vec<_>>();
+        self.mod_list_ui().set_thumbnails(&changed);
+
+        // Failed loads are not reported, so once idle, whatever is left is not coming.
+        if idle {
+            requested.clear();
+            self.thumbnails_timer().stop();
+        }
+    }
+
+    /// This function drops all the thumbnails, and everything still being loaded.
+    pub unsafe fn clear_thumbnails(&self) {
+        self.thumbnail_loader().clear();
+        self.thumbnails_timer().stop();
+        self.visible_thumbnails_timer().stop();
+        self.thumbnails_requested().write().unwrap().clear();
+
+        let mut thumbnails = self.thumbnails().write().unwrap();
+        thumbnails.clear();
+        thumbnails.set_budget(thumbnail_cache_budget());
+    }
+
+    /// This function adds the provided folders to the pack folders watcher.
+    pub unsafe fn watch_pack_folders(&self, folders: Vec<PathBuf>) {
+        let mut watched = self.watched_pack_folders().write().unwrap();
+        for folder in folders {
+            if !watched.contains(&folder) && self.packs_watcher().add_path(&QString::from_std_str(folder.to_string_lossy())) {
+                watched.insert(folder);
+            }
+        }
+    }
+
+    /// This function stops watching all the pack folders, and drops any change still pending.
+    pub unsafe fn unwatch_pack_folders(&self) {
+        self.packs_watcher_timer().stop();
+        self.changed_pack_folders().write().unwrap().clear();
+
+        let directories = self.packs_watcher().directories();
+        if !directories.is_empty() {
+            self.packs_watcher().remove_paths(&directories);
+        }
+
+        self.watched_pack_folders().write().unwrap().clear();
+        self.content_pack_roots().write().unwrap().clear();
+        *self.pack_folder_index().write().unwrap() = FolderIndex::default();
+    }
+
+    /// This function queues a pack folder to be checked for changes, once the folders have been quiet for a bit.
+    pub unsafe fn pack_folder_changed(&self, folder: PathBuf) {
+        self.changed_pack_folders().write().unwrap().insert(folder);
+        self.packs_watcher_timer().start_0a();
+    }
+
+    /// This function updates the game config and both lists with the changes in the pack folders queued by the watcher.
+    ///
+    /// Only the changed folders are checked, and only the packs that changed in them are probed.
+    pub unsafe fn update_pack_folders(&self) -> Result<()> {
+        let mut folders = self.changed_pack_folders().write().unwrap().drain().collect::<Vec<_>>();
+
+        // Newly downloaded workshop mods get their own folder in a content root, which we need to start watching.
+        let content_roots = self.content_pack_roots().read().unwrap();
+        let new_folders = folders.iter()
+            .filter(|folder| content_roots.contains(*folder))
+            .flat_map(|folder| new_subfolders(folder, &self.watched_pack_folders().read().unwrap()))
+            .collect::<Vec<_>>();
+        drop(content_roots);
+        folders.extend_from_slice(&new_folders);
+        self.watch_pack_folders(new_folders);
+
+        // Qt stops watching deleted folders on its own.
+        self.watched_pack_folders().write().unwrap().retain(|folder| folder.is_dir());
+
+        let game = self.game_selected().read().unwrap().clone();
+        let mut game_config = self.game_config().write().unwrap();
+        let game_config = match *game_config {
+            Some(ref mut game_config) => game_config,
+            None => return Ok(()),
+        };
+
+        let mut pack_cache = self.pack_cache().write().unwrap();
+        let mut folder_index = self.pack_folder_index().write().unwrap();
+        let mut changed = false;
+        let mut hashes = vec![];
+        for folder in &folders {
+            let changes = folder_index.changes(&pack_cache, folder, &packs_in_folder(folder));
+            for path in changes.removed() {
+                pack_cache.remove(path);
+                folder_index.remove(path);
+                let mod_id = remove_mod_path(game_config, path);
+                self.dependency_graph().write().unwrap().update_pack(game_config, &pack_cache, path);
+                if let Some(mod_id) = mod_id {
+                    if let Some(modd) = game_config.mods().get(&mod_id) {
+                        self.mod_list_ui().remove_mod(modd);
+                    }
+
+                    self.pack_list_ui().remove_pack(game_config, &mod_id, &pack_cache)?;
+                    self.conflict_analyzer().remove(&mod_id);
+                }
+
+                changed = true;
+            }
+
+            for path in changes.added().iter().chain(changes.updated().iter()) {
+
+                // Packs still being written may not be readable yet. We'll get another change once they're done.
+                let header = match pack_cache.pack_header(path) {
+                    Ok(header) => header,
+                    Err(_) => continue,
+                };
+
+                if header.is_mod() {
+                    folder_index.insert(path);
+                    let mod_id = add_mod_path(game_config, path);
+                    self.dependency_graph().write().unwrap().update_pack(game_config, &pack_cache, path);
+                    match mod_id {
+                        Some(mod_id) => {
+                            if let Some(modd) = game_config.mods().get(&mod_id) {
+                                self.mod_list_ui().append_mod(modd);
+                                if *modd.enabled() {
+                                    self.pack_list_ui().insert_pack(game_config, modd, &pack_cache, &self.dependency_graph().read().unwrap())?;
+                                    self.conflict_analyzer().insert(&mod_id, path.to_path_buf());
                                 }
                             }
+                        }
 
-                            if let Some(ref paths) = content_paths {
-                                for path in paths {
-                                    let pack_name = path.file_name().unwrap().to_string_lossy().as_ref().to_owned();
-                                    let pack = Pack::read_and_merge(&[path.to_path_buf()], true, false)?;
-                                    if pack.pfh_file_type() == PFHFileType::Mod {
-                                        match mods.mods_mut().get_mut(&pack_name) {
-                                            Some(modd) => {
-                                                if !modd.paths().contains(path) {
-                                                    modd.paths_mut().push(path.to_path_buf());
-                                                }
-                                            }
-                                            None => {
-                                                let mut modd = Mod::default();
-                                                modd.set_name(pack_name.to_owned());
-                                                modd.set_id(pack_name.to_owned());
-                                                modd.set_paths(vec![path.to_path_buf()]);
-                                                mods.mods_mut().insert(pack_name, modd);
-                                            }
-                                        }
-                                    }
+                        // Already known mod. Its type and its contents may have changed.
+                        None => {
+                            let pack_name = path.file_name().unwrap().to_string_lossy();
+                            if let Some(modd) = game_config.mods().get(pack_name.as_ref()) {
+                                self.pack_list_ui().update_pack(game_config, modd, &pack_cache, &self.dependency_graph().read().unwrap())?;
+
+                                // If we can compare hashes, the conflicts get updated once we know it really changed.
+                                if *modd.enabled() && modd.paths().first() == Some(path) && !pack_cache.has_previous_hash(path) {
+                                    self.conflict_analyzer().insert(modd.id(), path.to_path_buf());
                                 }
                             }
                         }
                     }
 
-                    let mods = self.game_config().read().unwrap();
-                    if let Some(ref mods) = *mods {
-                        self.mod_list_ui().load(mods)?;
-                        self.pack_list_ui().load(mods)?;
+                    hashes.push(path.to_path_buf());
+                    changed = true;
+                }
+
+                // Packs that stopped being mods are treated like removed ones.
+                else {
+                    folder_index.remove(path);
+                    let mod_id = remove_mod_path(game_config, path);
+                    self.dependency_graph().write().unwrap().update_pack(game_config, &pack_cache, path);
+                    if let Some(mod_id) = mod_id {
+                        if let Some(modd) = game_config.mods().get(&mod_id) {
+                            self.mod_list_ui().remove_mod(modd);
+                        }
+
+                        self.pack_list_ui().remove_pack(game_config, &mod_id, &pack_cache)?;
+                        self.conflict_analyzer().remove(&mod_id);
+                        changed = true;
                     }
                 }
+            }
+        }
 
-                Ok(())
-            },
-            None => Err(anyhow!("Game {} is not a valid game.", game)),
+        let hashes = hashes.iter().map(|path| path.as_path()).collect::<Vec<_>>();
+        self.queue_hashes(&pack_cache, &hashes);
+        pack_cache.save(&game)?;
+
+        // New and updated Workshop mods may have new titles too. Unchanged ones are served from the Workshop cache.
+        let changed_mods = hashes.iter()
+            .filter_map(|path| game_config.mods().get(path.file_name()?.to_string_lossy().as_ref()))
+            .collect::<Vec<_>>();
+        self.fetch_workshop_data(workshop_requests(changed_mods.into_iter()));
+
+        if changed {
+            self.update_conflicts_order();
+            self.mod_list_ui().sort();
+            game_config.set_dirty(true);
+            self.game_config_save_timer().start_0a();
         }
+
+        Ok(())
     }
 
     pub unsafe fn open_settings(&self) {
         let game_selected = self.game_selected().read().unwrap();
         let game_key = game_selected.game_key_name();
         let game_path_old = setting_path(game_key);
+        let merge_max_size_old = merge_small_mods_max_size();
+        let prewarm_budget_old = prewarm_budget();
 
         match SettingsUI::new(self.main_window()) {
             Ok(saved) => {
                 if saved {
                     let game_path_new = setting_path(game_key);
 
+                    // If the thumbnails budget went down, drop whatever doesn't fit anymore.
+                    let evicted = self.thumbnails().write().unwrap().set_budget(thumbnail_cache_budget());
+                    let evicted = evicted.into_iter().map(|handle| (handle, None)).collect::<Vec<_>>();
+                    self.mod_list_ui().set_thumbnails(&evicted);
+
                     // If we have changed the path of any of the games, and that game is the current `GameSelected`,
                     // re-select the current `GameSelected` to force it to reload the game's files.
                     if game_path_old != game_path_new {
                         QAction::trigger(&self.game_selected_group.checked_action());
                     }
 
+                    // Otherwise, a new max size for merged mods means different merged packs for the same load order,
+                    // and a new prewarm budget means a different amount of it to read ahead.
+                    else if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                        if merge_small_mods_max_size() != merge_max_size_old {
+                            self.build_merged_packs(game_config);
+                        }
+
+                        if prewarm_budget() != prewarm_budget_old {
+                            self.prewarm_packs(game_config);
+                        }
+                    }
+
                     // If we detect a factory reset, reset the window's geometry and state, and the font.
                     let factory_reset = setting_bool("factoryReset");
                     if factory_reset {
@@ -518,88 +1353,153 @@ impl AppUI {
         set_setting_bool("factoryReset", false);
     }
 
-    pub unsafe fn launch_game(&self) -> Result<()> {
-        let pack_list = (0..self.pack_list_ui().model().row_count_0a())
-            .filter_map(|index| {
-                let item = self.pack_list_ui().model().item_1a(index);
-                Some(format!("mod \"{}\";", item.text().to_std_string()))
-                /*
-                if item.is_checkable() && item.check_state() == CheckState::Checked {
-                    Some(format!("mod \"{}\"", item.text().to_std_string()))
-                } else {
-                    None
-                }*/
-            })
-            .collect::<Vec<_>>()
-            .join("\n");
-
-        let game = self.game_selected().read().unwrap();
-        let game_path = setting_path(game.game_key_name());
-        let file_path = game_path.join("mod_list.txt");
+    /// This function shows the timings of everything measured so far, like startup phases, game switches and Pack reads.
+    pub unsafe fn show_timings(&self) {
+        let dialog = QDialog::new_1a(&self.main_window);
+        dialog.set_window_title(&qtr("debug_timings"));
+        dialog.set_attribute_1a(WidgetAttribute::WADeleteOnClose);
+        dialog.resize_2a(900, 600);
+
+        let layout = create_grid_layout(dialog.static_upcast());
+        let text = QPlainTextEdit::from_q_string_q_widget(&QString::from_std_str(summary()), &dialog);
+        text.set_read_only(true);
+        text.set_line_wrap_mode(LineWrapMode::NoWrap);
+        text.set_font(&QFontDatabase::system_font(SystemFont::FixedFont));
+        layout.add_widget_5a(&text, 0, 0, 1, 1);
+
+        dialog.exec();
+    }
 
-        let mut file = BufWriter::new(File::create(file_path)?);
-        file.write_all(pack_list.as_bytes())?;
-        file.flush()?;
+    /// This function exports everything measured so far as a Chrome trace, to a file chosen by the user.
+    pub unsafe fn export_trace(&self) -> Result<()> {
+        let path = QFileDialog::get_save_file_name_4a(
+            &self.main_window,
+            &qtr("debug_export_trace"),
+            &QString::from_std_str("runcher_trace.json"),
+            &QString::from_std_str("Chrome Trace (*.json)"),
+        );
+
+        if !path.is_empty() {
+            export_chrome_trace(&PathBuf::from(path.to_std_string()))?;
+        }
 
-        let exec_game = game.executable_path(&game_path).unwrap();
+        Ok(())
+    }
 
-        if cfg!(target_os = "windows") {
-            let mut command = Command::new("cmd");
-            command.arg("/C");
-            command.arg("start");
-            command.arg("/d");
-            command.arg(game_path.to_string_lossy().replace('\\', "/"));
-            command.arg(exec_game.file_name().unwrap().to_string_lossy().to_string());
-            command.arg("mod_list.txt;");
+    /// This function launches the game selected with the load order of its current config.
+    pub unsafe fn launch_game(&self) -> Result<()> {
 
-            // This disables the terminal when executing the command.
-            #[cfg(target_os = "windows")]command.creation_flags(CREATE_NO_WINDOW);
-            command.spawn()?;
+        // Runs not merged yet are launched on their own this time, but should be ready for the next one.
+        if self.flush_game_config()? {
+            if let Some(ref game_config) = *self.game_config().read().unwrap() {
+                self.build_merged_packs(game_config);
+            }
+        }
 
-            Ok(())
-        } else if cfg!(target_os = "linux") {
+        // Missing dependencies usually mean a crash on start, so give the user a chance to fix them before launching.
+        let missing = match *self.game_config().read().unwrap() {
+            Some(ref game_config) => self.dependency_graph().read().unwrap()
+                .all_missing_dependencies(game_config)
+                .iter()
+                .map(|(mod_id, dependencies)| format!("{}: {}", mod_id, dependencies.join(", ")))
+                .collect::<Vec<_>>(),
+            None => vec![],
+        };
+
+        if !missing.is_empty() {
+            let answer = QMessageBox::question_q_widget2_q_string(
+                &self.main_window,
+                &qtr("missing_dependencies_title"),
+                &qtre("missing_dependencies_launch", &[&missing.join("\n")]),
+            );
+
+            if answer != StandardButton::Yes {
+                return Ok(());
+            }
+        }
 
-            Ok(())
-        } else {
-            Err(anyhow!("Unsupported OS."))
+        let game = self.game_selected().read().unwrap();
+        let game_path = setting_path(game.game_key_name());
+        match *self.game_config().read().unwrap() {
+            Some(ref game_config) => {
+                self.stop_prewarm();
+
+                // What's built after this is for the next launch. Don't prewarm it over the game.
+                self.merged_packs_timer().stop();
+                *self.merged_packs_built().write().unwrap() = 0;
+                launch_game(&game, &game_path, game_config, &self.pack_cache().read().unwrap(), false)
+            }
+            None => Err(anyhow!("No config loaded for {}.", game.display_name())),
         }
     }
 
+    /// This function applies the profile selected in the profile combobox, after showing the user what it changes.
+    ///
+    /// Only the mods whose state changes are touched: their items, their rows in the pack list and their conflicts.
+    /// If nothing changes, nothing is saved either.
     pub unsafe fn load_profile(&self) -> Result<()> {
         let profile_name = self.actions_ui().profile_combobox().current_text().to_std_string();
         if profile_name.is_empty() {
             return Err(anyhow!("Profile name is empty."));
         }
 
-        match self.game_profiles().read().unwrap().get(&profile_name) {
-            Some(profile) => {
+        let profile = Profile::load(&self.game_selected().read().unwrap(), &profile_name, false)?;
+        let (diff, changes) = match *self.game_config().read().unwrap() {
+            Some(ref game_config) => {
+                let diff = profile.diff(game_config);
+                let mut enable = diff.enable().iter().filter_map(|handle| game_config.mod_id(*handle)).collect::<Vec<_>>();
+                let mut disable = diff.disable().iter().filter_map(|handle| game_config.mod_id(*handle)).collect::<Vec<_>>();
+                enable.sort_unstable();
+                disable.sort_unstable();
 
-                // First, disable all mods.
-                for cat in 0..self.mod_list_ui().model().row_count_0a() {
-                    let category = self.mod_list_ui().model().item_1a(cat);
-                    for row in 0..category.row_count() {
-                        let item = category.child_1a(row);
-                        item.set_check_state(CheckState::Unchecked);
-                    }
-                }
+                let changes = enable.iter().map(|mod_id| format!("+ {mod_id}"))
+                    .chain(disable.iter().map(|mod_id| format!("- {mod_id}")))
+                    .collect::<Vec<_>>();
 
-                for mod_id in profile.mods() {
-                    let mod_id = QString::from_std_str(mod_id);
-                    for cat in 0..self.mod_list_ui().model().row_count_0a() {
-                        let category = self.mod_list_ui().model().item_1a(cat);
-                        for row in 0..category.row_count() {
-                            let item = category.child_1a(row);
-                            if !item.is_null() && item.text().compare_q_string(&mod_id) == 0 {
-                                item.set_check_state(CheckState::Checked);
-                            }
-                        }
-                    }
+                (diff, changes)
+            }
+            None => return Ok(()),
+        };
+
+        if diff.is_empty() {
+            log_to_status_bar(self.main_window().status_bar(), &tre("profile_unchanged", &[&profile_name]));
+            return Ok(());
+        }
+
+        let message_box = QMessageBox::from_q_widget(&self.main_window);
+        message_box.set_icon(Icon::Question);
+        message_box.set_window_title(&qtr("load_profile"));
+        message_box.set_text(&qtre("profile_diff_text", &[&profile_name, &diff.enable().len().to_string(), &diff.disable().len().to_string()]));
+        message_box.set_detailed_text(&QString::from_std_str(changes.join("\n")));
+        message_box.set_standard_buttons(StandardButton::Yes | StandardButton::No);
+        message_box.set_default_button_standard_button(StandardButton::Yes);
+        if message_box.exec() != StandardButton::Yes.to_int() {
+            return Ok(());
+        }
+
+        self.mod_list_ui().apply_profile_diff(&diff);
+
+        if let Some(ref mut game_config) = *self.game_config().write().unwrap() {
+            diff.apply(game_config);
+            self.pack_list_ui().apply_profile_diff(game_config, &diff, &self.pack_cache().read().unwrap(), &self.dependency_graph().read().unwrap())?;
+
+            for handle in diff.disable() {
+                if let Some(mod_id) = game_config.mod_id(*handle) {
+                    self.conflict_analyzer().remove(mod_id);
                 }
+            }
 
-                Ok(())
+            for modd in diff.enable().iter().filter_map(|handle| game_config.mod_by_handle(*handle)) {
+                if let Some(path) = modd.paths().first() {
+                    self.conflict_analyzer().insert(modd.id(), path.to_path_buf());
+                }
             }
-            None => return Err(anyhow!("No profile with said name found."))
+
+            self.update_conflicts_order();
         }
+
+        self.game_config_save_timer().start_0a();
+        Ok(())
     }
 
     pub unsafe fn save_profile(&self) -> Result<()> {
@@ -619,16 +1519,165 @@ impl AppUI {
             profile.set_id(profile_name.to_owned());
             profile.set_mods(mods);
 
-            self.game_profiles().write().unwrap().insert(profile_name.to_owned(), profile.clone());
+            profile.save(&self.game_selected().read().unwrap(), &profile_name, config_format())?;
+
+            if self.game_profiles().write().unwrap().insert(profile_name) {
+                self.update_profile_combobox();
+            }
+        }
+
+        Ok(())
+    }
 
-            self.actions_ui().profile_model().clear();
-            for profile in self.game_profiles().read().unwrap().keys() {
-                self.actions_ui().profile_combobox().add_item_q_string(&QString::from_std_str(&profile));
+    /// This function tells the user about what toggling a mod broke: the Packs it needs if it was enabled, or the mods that
+    /// needed it if it was disabled.
+    ///
+    /// Only the edges of the toggled mod are checked, so this is cheap enough to do on every toggle.
+    pub unsafe fn check_dependencies(&self, game_config: &GameConfig, mod_id: &str, enabled: bool) {
+        let graph = self.dependency_graph().read().unwrap();
+        let message = if enabled {
+            let missing = graph.missing_dependencies(game_config, mod_id);
+            if missing.is_empty() {
+                return;
             }
 
-            return profile.save(&self.game_selected().read().unwrap(), &profile_name);
+            tre("missing_dependencies_enabled", &[mod_id, &missing.join(", ")])
+        } else {
+            let dependents = graph.enabled_dependents(game_config, mod_id);
+            if dependents.is_empty() {
+                return;
+            }
+
+            tre("missing_dependencies_disabled", &[mod_id, &dependents.join(", ")])
+        };
+
+        warn!("{}", message);
+        log_to_status_bar(self.main_window().status_bar(), &message);
+    }
+
+    /// This function pins the selected packs, so they load first among the packs of their type, or unpins them.
+    pub unsafe fn pin_selected_packs(&self, pin: bool) -> Result<()> {
+        let selected = self.pack_list_ui().selected_mod_ids();
+        self.edit_load_order(|load_order| {
+            if pin {
+                for mod_id in selected {
+                    if !load_order.pinned().contains(&mod_id) {
+                        load_order.pinned_mut().push(mod_id);
+                    }
+                }
+            } else {
+                load_order.pinned_mut().retain(|mod_id| !selected.contains(mod_id));
+            }
+
+            Ok(())
+        })
+    }
+
+    /// This function asks the user for a pack, and adds rules to load the selected packs before or after it.
+    ///
+    /// Rules that would make a cycle are rejected, counting the rules of disabled mods too, so enabling mods never breaks the order.
+    pub unsafe fn add_load_order_rule(&self, load_before: bool) -> Result<()> {
+        let selected = self.pack_list_ui().selected_mod_ids();
+        if selected.is_empty() {
+            return Ok(());
+        }
+
+        let candidates = match *self.game_config().read().unwrap() {
+            Some(ref game_config) => load_order(game_config, &self.pack_cache().read().unwrap())
+                .iter()
+                .map(|modd| modd.id().to_owned())
+                .filter(|mod_id| !selected.contains(mod_id))
+                .collect::<Vec<_>>(),
+            None => return Ok(()),
+        };
+
+        if candidates.is_empty() {
+            return Ok(());
+        }
+
+        let items = QStringList::new();
+        for mod_id in &candidates {
+            items.append_q_string(&QString::from_std_str(mod_id));
+        }
+
+        let label = if load_before { qtr("load_order_before_label") } else { qtr("load_order_after_label") };
+        let mut accepted = false;
+        let other = QInputDialog::get_item_7a(&self.main_window, &qtr("load_order_rule_title"), &label, &items, 0, false, &mut accepted).to_std_string();
+        if !accepted || other.is_empty() {
+            return Ok(());
+        }
+
+        self.edit_load_order(|load_order| {
+            let mut rules = load_order.rules().to_vec();
+            for mod_id in &selected {
+
+                // A new rule replaces any previous one between the same two packs.
+                rules.retain(|rule| !(rule.before() == mod_id && *rule.after() == other) && !(*rule.before() == other && rule.after() == mod_id));
+                rules.push(if load_before { LoadOrderRule::new(mod_id, &other) } else { LoadOrderRule::new(&other, mod_id) });
+            }
+
+            // Dependencies are rules too, so new rules can't contradict them either.
+            let mut all_rules = self.dependency_graph().read().unwrap().load_order_rules();
+            all_rules.extend_from_slice(&rules);
+            if let Some(cycle) = rule_cycle(&all_rules) {
+                return Err(anyhow!("This rule conflicts with others, as they'd need these packs to load in a circle: {}.", cycle.join(" > ")));
+            }
+
+            load_order.set_rules(rules);
+            Ok(())
+        })
+    }
+
+    /// This function removes all the load order rules of the selected packs.
+    pub unsafe fn clear_load_order_rules(&self) -> Result<()> {
+        let selected = self.pack_list_ui().selected_mod_ids();
+        self.edit_load_order(|load_order| {
+            load_order.rules_mut().retain(|rule| !selected.contains(rule.before()) && !selected.contains(rule.after()));
+            Ok(())
+        })
+    }
+
+    /// This function edits the pins and rules of the game selected, and rebuilds the pack list with the resulting load order.
+    unsafe fn edit_load_order<F: FnOnce(&mut LoadOrder) -> Result<()>>(&self, edit: F) -> Result<()> {
+        if let Some(ref mut game_config) = *self.game_config().write().unwrap() {
+            edit(game_config.load_order_mut())?;
+            game_config.set_dirty(true);
+            self.pack_list_ui().load(game_config, &self.pack_cache().read().unwrap())?;
+            self.update_conflicts_order();
+        }
+
+        self.game_config_save_timer().start_0a();
+        Ok(())
+    }
+
+    /// This function re-reads the profile names of the game selected from the profiles folder.
+    ///
+    /// Meant to be triggered by the profiles watcher, so profiles added or removed outside Runcher show up without a game switch.
+    pub unsafe fn refresh_profiles(&self) -> Result<()> {
+
+        // Mid game switch the names are going to be reloaded anyway.
+        if self.game_config().read().unwrap().is_none() {
+            return Ok(());
+        }
+
+        let profiles = Profile::profile_names_for_game(&self.game_selected().read().unwrap())?;
+        if profiles != *self.game_profiles().read().unwrap() {
+            *self.game_profiles().write().unwrap() = profiles;
+            self.update_profile_combobox();
         }
 
         Ok(())
     }
+
+    /// This function repopulates the profile combobox with the known profile names, keeping whatever the user had written in it.
+    pub unsafe fn update_profile_combobox(&self) {
+        let current_text = self.actions_ui().profile_combobox().current_text();
+
+        self.actions_ui().profile_model().clear();
+        for profile in self.game_profiles().read().unwrap().iter() {
+            self.actions_ui().profile_combobox().add_item_q_string(&QString::from_std_str(profile));
+        }
+
+        self.actions_ui().profile_combobox().set_current_text(&current_text);
+    }
 }
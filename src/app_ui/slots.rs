@@ -14,11 +14,13 @@ use qt_gui::SlotOfQStandardItem;
 
 use qt_core::QBox;
 use qt_core::SlotNoArgs;
+use qt_core::SlotOfQString;
 
 use std::sync::Arc;
 
 use rpfm_ui_common::clone;
 
+use crate::mod_list_ui::MOD_HANDLE_ROLE;
 use crate::VERSION;
 use crate::VERSION_SUBTITLE;
 
@@ -34,14 +36,36 @@ pub struct AppUISlots {
     launch_game: QBox<SlotNoArgs>,
     open_settings: QBox<SlotNoArgs>,
     change_game_selected: QBox<SlotNoArgs>,
+    update_game_switch: QBox<SlotNoArgs>,
 
     update_pack_list: QBox<SlotOfQStandardItem>,
+    save_game_config: QBox<SlotNoArgs>,
+    update_conflicts: QBox<SlotNoArgs>,
+    update_hashes: QBox<SlotNoArgs>,
+    update_workshop_data: QBox<SlotNoArgs>,
+    update_prewarm: QBox<SlotNoArgs>,
+    update_merged_packs: QBox<SlotNoArgs>,
+    request_visible_thumbnails: QBox<SlotNoArgs>,
+    update_visible_thumbnails: QBox<SlotNoArgs>,
+    update_thumbnails: QBox<SlotNoArgs>,
+    pack_folder_changed: QBox<SlotOfQString>,
+    update_pack_folders: QBox<SlotNoArgs>,
+
+    pin_packs: QBox<SlotNoArgs>,
+    unpin_packs: QBox<SlotNoArgs>,
+    load_before: QBox<SlotNoArgs>,
+    load_after: QBox<SlotNoArgs>,
+    clear_load_order_rules: QBox<SlotNoArgs>,
 
     about_qt: QBox<SlotNoArgs>,
     about_runcher: QBox<SlotNoArgs>,
 
+    debug_timings: QBox<SlotNoArgs>,
+    debug_export_trace: QBox<SlotNoArgs>,
+
     load_profile: QBox<SlotNoArgs>,
     save_profile: QBox<SlotNoArgs>,
+    refresh_profiles: QBox<SlotOfQString>,
 }
 
 //-------------------------------------------------------------------------------//
@@ -72,30 +96,115 @@ impl AppUISlots {
             }
         ));
 
+        let update_game_switch = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.update_game_switch() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
         let update_pack_list = SlotOfQStandardItem::new(&view.main_window, clone!(
             view => move |item| {
-            if item.column() == 0 {
-                let game_info = view.game_selected().read().unwrap();
+            // Category items have no handle. Reading one anyway gives handle 0, which belongs to an unrelated mod.
+            let handle = item.data_1a(MOD_HANDLE_ROLE);
+            if item.column() == 0 && handle.is_valid() {
+                let mut result = Ok(());
+                let mut changed = false;
                 if let Some(ref mut game_config) = *view.game_config().write().unwrap() {
-                    let mod_id = item.text().to_std_string();
-
-                    // Update the mod's status.
-                    if let Some(modd) = game_config.mods_mut().get_mut(&mod_id) {
-                        modd.set_enabled(item.check_state() == CheckState::Checked);
+                    let handle = ModHandle::from(handle.to_u_int_0a());
+                    let mod_id = game_config.mod_id(handle).unwrap_or_default().to_owned();
+
+                    // Update the mod's status, and only its row in the pack view.
+                    let enabled = item.check_state() == CheckState::Checked;
+                    changed = match game_config.mod_by_handle_mut(handle) {
+                        Some(modd) if *modd.enabled() != enabled => {
+                            modd.set_enabled(enabled);
+                            true
+                        }
+                        _ => false,
+                    };
+
+                    if changed {
+                        let pack_cache = view.pack_cache().read().unwrap();
+                        result = if enabled {
+                            let modd = &game_config.mods()[mod_id.as_str()];
+                            if let Some(path) = modd.paths().first() {
+                                view.conflict_analyzer().insert(&mod_id, path.to_path_buf());
+                            }
+
+                            view.pack_list_ui().insert_pack(game_config, modd, &pack_cache, &view.dependency_graph().read().unwrap())
+                        } else {
+                            view.conflict_analyzer().remove(&mod_id);
+                            view.pack_list_ui().remove_pack(game_config, &mod_id, &pack_cache)
+                        };
+
+                        view.check_dependencies(game_config, &mod_id, enabled);
+                        view.update_conflicts_order();
+                        game_config.set_dirty(true);
                     }
+                }
 
-                    // Reload the pack view.
-                    if let Err(error) = view.pack_list_ui().load(game_config) {
-                        show_dialog(view.main_window(), error, false);
-                    }
+                // Dialogs run their own event loop, so don't show them while holding the config.
+                if let Err(error) = result {
+                    show_dialog(view.main_window(), error, false);
+                }
 
-                    if let Err(error) = game_config.save(&game_info) {
-                        show_dialog(view.main_window(), error, false);
-                    }
+                // Saving is delayed, so toggling a bunch of mods in a row only causes one save.
+                if changed {
+                    view.game_config_save_timer().start_0a();
                 }
             }
         }));
 
+        let save_game_config = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.save_game_config() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let pin_packs = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.pin_selected_packs(true) {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let unpin_packs = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.pin_selected_packs(false) {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let load_before = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.add_load_order_rule(true) {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let load_after = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.add_load_order_rule(false) {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let clear_load_order_rules = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.clear_load_order_rules() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
         let about_qt = SlotNoArgs::new(&view.main_window, clone!(
             view => move || {
                 QMessageBox::about_qt_1a(&view.main_window);
@@ -135,6 +244,20 @@ impl AppUISlots {
             }
         ));
 
+        let debug_timings = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.show_timings();
+            }
+        ));
+
+        let debug_export_trace = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.export_trace() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
         let load_profile = SlotNoArgs::new(&view.main_window, clone!(
             view => move || {
                 if let Err(error) = view.load_profile() {
@@ -151,18 +274,112 @@ impl AppUISlots {
             }
         ));
 
+        let update_conflicts = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_conflicts();
+            }
+        ));
+
+        let update_hashes = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.update_hashes() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let update_workshop_data = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_workshop_data();
+            }
+        ));
+
+        let update_prewarm = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_prewarm();
+            }
+        ));
+
+        let update_merged_packs = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_merged_packs();
+            }
+        ));
+
+        let request_visible_thumbnails = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.visible_thumbnails_timer().start_0a();
+            }
+        ));
+
+        let update_visible_thumbnails = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_visible_thumbnails();
+            }
+        ));
+
+        let update_thumbnails = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                view.update_thumbnails();
+            }
+        ));
+
+        let pack_folder_changed = SlotOfQString::new(&view.main_window, clone!(
+            view => move |folder| {
+                view.pack_folder_changed(PathBuf::from(folder.to_std_string()));
+            }
+        ));
+
+        let update_pack_folders = SlotNoArgs::new(&view.main_window, clone!(
+            view => move || {
+                if let Err(error) = view.update_pack_folders() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
+        let refresh_profiles = SlotOfQString::new(&view.main_window, clone!(
+            view => move |_| {
+                if let Err(error) = view.refresh_profiles() {
+                    show_dialog(view.main_window(), error, false);
+                }
+            }
+        ));
+
         Self {
             launch_game,
             open_settings,
             change_game_selected,
+            update_game_switch,
 
             update_pack_list,
+            save_game_config,
+            update_conflicts,
+            update_hashes,
+            update_workshop_data,
+            update_prewarm,
+            update_merged_packs,
+            request_visible_thumbnails,
+            update_visible_thumbnails,
+            update_thumbnails,
+            pack_folder_changed,
+            update_pack_folders,
+
+            pin_packs,
+            unpin_packs,
+            load_before,
+            load_after,
+            clear_load_order_rules,
 
             about_qt,
             about_runcher,
 
+            debug_timings,
+            debug_export_trace,
+
             load_profile,
             save_profile,
+            refresh_profiles,
         }
     }
 }
@@ -0,0 +1,206 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Headless mode, for scripts.
+//!
+//! `runcher cli [--game <game key>] <command>` does what the ui would do, without starting Qt's ui or loading any template.
+//! Mods are discovered again before every command, but through the Pack cache, so unchanged Packs cost a `stat` each and a
+//! scripted launch takes milliseconds. Results go to stdout, one per line with tab-separated fields, and errors to stderr.
+//!
+//! On Windows release builds there's no console attached, so redirect the output to a file to see it.
+
+use anyhow::{anyhow, Result};
+
+use std::io::{stdout, BufWriter, Write};
+
+use rpfm_lib::games::GameInfo;
+
+use rpfm_ui_common::settings::*;
+
+use crate::integrations::{GameConfig, Profile};
+use crate::mod_manager::dependencies::DependencyGraph;
+use crate::mod_manager::discovery::discover_mods;
+use crate::mod_manager::launcher::{launch_game, write_load_order, MOD_LIST_FILE_NAME};
+use crate::mod_manager::load_order::{load_order, update_load_order};
+use crate::mod_manager::pack_cache::PackCache;
+use crate::settings_ui::{config_format, init_config_path};
+use crate::SUPPORTED_GAMES;
+
+/// First argument that makes Runcher run headless.
+pub const CLI_ARG: &str = "cli";
+
+const USAGE: &str = "Usage: runcher cli [--game <game key>] <command>
+
+Commands:
+    list-mods                           List all installed mods as: enabled, id, name, path.
+    list-profiles                       List the profiles of the game.
+    load-order                          List the enabled mods in the order the game loads them.
+    apply-profile <profile>             Enable the mods of a profile, and disable the rest.
+    write-mod-list [--profile <name>]   Write mod_list.txt in the game folder, applying a profile first if provided.
+    launch [--profile <name>]           Write mod_list.txt and start the game, applying a profile first if provided.
+
+If no game is provided, the default game is used.";
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+#[derive(Debug, PartialEq, Eq)]
+enum Command {
+    ListMods,
+    ListProfiles,
+    LoadOrder,
+    ApplyProfile(String),
+    WriteModList(Option<String>),
+    Launch(Option<String>),
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+/// This function runs a headless command, with the arguments after [CLI_ARG]. Returns the exit code of the program.
+pub fn run(args: &[String]) -> i32 {
+    match parse_args(args).and_then(|(game_key, command)| run_command(game_key.as_deref(), command)) {
+        Ok(()) => 0,
+        Err(error) => {
+            eprintln!("{error}");
+            1
+        }
+    }
+}
+
+fn parse_args(args: &[String]) -> Result<(Option<String>, Command)> {
+    let mut game_key = None;
+    let mut profile = None;
+    let mut positional = vec![];
+
+    let mut args = args.iter();
+    while let Some(arg) = args.next() {
+        match arg.as_str() {
+            "--game" => game_key = Some(args.next().ok_or_else(|| anyhow!("Missing game key after --game.\n\n{USAGE}"))?.to_owned()),
+            "--profile" => profile = Some(args.next().ok_or_else(|| anyhow!("Missing profile name after --profile.\n\n{USAGE}"))?.to_owned()),
+            "--help" | "-h" => return Err(anyhow!("{USAGE}")),
+            _ => positional.push(arg.as_str()),
+        }
+    }
+
+    let command = match positional.as_slice() {
+        ["list-mods"] => Command::ListMods,
+        ["list-profiles"] => Command::ListProfiles,
+        ["load-order"] => Command::LoadOrder,
+        ["apply-profile", name] => Command::ApplyProfile(name.to_string()),
+        ["write-mod-list"] => Command::WriteModList(profile),
+        ["launch"] => Command::Launch(profile),
+        _ => return Err(anyhow!("{USAGE}")),
+    };
+
+    Ok((game_key, command))
+}
+
+fn run_command(game_key: Option<&str>, command: Command) -> Result<()> {
+    init_config_path()?;
+
+    let game_key = game_key.map(|key| key.to_owned()).unwrap_or_else(|| setting_string("default_game"));
+    let game = SUPPORTED_GAMES.game(&game_key).ok_or_else(|| anyhow!("Unsupported game: {}.", game_key))?;
+
+    if command == Command::ListProfiles {
+        let mut out = BufWriter::new(stdout().lock());
+        for name in Profile::profile_names_for_game(game)? {
+            writeln!(out, "{name}")?;
+        }
+
+        return Ok(());
+    }
+
+    let (mut game_config, pack_cache) = load_game(game)?;
+    let mut out = BufWriter::new(stdout().lock());
+    match command {
+        Command::ListMods => {
+            let mut mods = game_config.mods().values().filter(|modd| !modd.paths().is_empty()).collect::<Vec<_>>();
+            mods.sort_unstable_by(|a, b| a.id().cmp(b.id()));
+
+            for modd in mods {
+                writeln!(out, "{}\t{}\t{}\t{}", u8::from(*modd.enabled()), modd.id(), modd.name(), modd.paths()[0].to_string_lossy())?;
+            }
+        }
+
+        Command::LoadOrder => {
+            for modd in load_order(&game_config, &pack_cache) {
+                writeln!(out, "{}", modd.id())?;
+            }
+        }
+
+        Command::ApplyProfile(ref profile) => Profile::load(game, profile, false)?.apply(&mut game_config),
+        Command::WriteModList(ref profile) | Command::Launch(ref profile) => {
+            if let Some(profile) = profile {
+                Profile::load(game, profile, false)?.apply(&mut game_config);
+            }
+
+            // Missing dependencies don't stop scripts, but they usually mean a crash on start, so say it.
+            for (mod_id, dependencies) in DependencyGraph::build(&game_config, &pack_cache).all_missing_dependencies(&game_config) {
+                eprintln!("{} needs these packs, which are not installed or not enabled: {}", mod_id, dependencies.join(", "));
+            }
+
+            let game_path = game_path(game)?;
+            if let Command::Launch(_) = command {
+                launch_game(game, &game_path, &game_config, &pack_cache, true)?;
+            } else if write_load_order(game, &game_path, &game_config, &pack_cache, true)? {
+                writeln!(out, "{} written.", game_path.join(MOD_LIST_FILE_NAME).to_string_lossy())?;
+            } else {
+                writeln!(out, "{} unchanged.", game_path.join(MOD_LIST_FILE_NAME).to_string_lossy())?;
+            }
+        }
+
+        Command::ListProfiles => unreachable!(),
+    }
+
+    // Save the mods just discovered and the profile applied, if any, so the ui picks them up on its next start.
+    if *game_config.dirty() {
+        for cycle in update_load_order(&mut game_config, &pack_cache) {
+            eprintln!("Load order rules make a cycle, so they have been ignored: {}.", cycle.join(" > "));
+        }
+    }
+
+    game_config.save_if_dirty(game, config_format())?;
+
+    out.flush()?;
+    Ok(())
+}
+
+/// This function loads the config of a game, with its mods discovered again through the Pack cache.
+///
+/// If the game has no valid path configured, the mods are the ones found last time. The config is only marked as dirty if
+/// discovery changed its mods, so read-only commands don't rewrite it.
+fn load_game(game: &GameInfo) -> Result<(GameConfig, PackCache)> {
+    let mut game_config = GameConfig::load(game, true)?;
+    let mut pack_cache = PackCache::load(game).unwrap_or_default();
+
+    let game_path = setting_path(game.game_key_name());
+    if game_path.is_dir() {
+        if discover_mods(&mut game_config, &mut pack_cache, game, &game_path)? {
+            game_config.set_dirty(true);
+        }
+
+        // Only saved if discovery had to read any Pack from disk, or forgot any.
+        pack_cache.save(game)?;
+    }
+
+    Ok((game_config, pack_cache))
+}
+
+fn game_path(game: &GameInfo) -> Result<std::path::PathBuf> {
+    let game_path = setting_path(game.game_key_name());
+    if game_path.is_dir() {
+        Ok(game_path)
+    } else {
+        Err(anyhow!("No valid path configured for {}.", game.display_name()))
+    }
+}
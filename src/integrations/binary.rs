@@ -0,0 +1,314 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Binary encoding of game configs and profiles.
+//!
+//! All files start with a 4 bytes magic and a u16 version, so we can evolve the format without breaking old files.
+//! Strings are stored as u16-length-prefixed UTF-8, and validated in place in the loaded buffer, so each one is allocated
+//! once, at its exact size. Paths are stored the same way, but with the bytes the OS uses for them, so paths that are not
+//! valid UTF-8 survive a round-trip.
+
+use anyhow::{anyhow, Result};
+
+use std::ffi::OsString;
+use std::io::{Cursor, Read, Write};
+use std::path::{Path, PathBuf};
+
+use rpfm_lib::binary::{ReadBytes, WriteBytes};
+
+use super::{GameConfig, LoadOrder, LoadOrderRule, Mod, Profile};
+use super::mod_ids::Mods;
+
+const GAME_CONFIG_MAGIC: &[u8; 4] = b"RGCF";
+const GAME_CONFIG_VERSION: u16 = 4;
+
+const PROFILE_MAGIC: &[u8; 4] = b"RPRF";
+const PROFILE_VERSION: u16 = 1;
+
+/// Minimum size in bytes of a string: just its u16 length.
+const MIN_STRING_SIZE: usize = 2;
+
+/// Minimum size in bytes of a mod: name, id, enabled, category flag and paths count.
+const MIN_MOD_SIZE: usize = MIN_STRING_SIZE * 2 + 1 + 1 + 4;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Trait for structs that can be saved with the binary config format.
+pub trait BinaryConfig: Sized {
+    fn encode_binary(&self) -> Result<Vec<u8>>;
+    fn decode_binary(data: &[u8]) -> Result<Self>;
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl BinaryConfig for GameConfig {
+    fn encode_binary(&self) -> Result<Vec<u8>> {
+        let mut data = Vec::with_capacity(64 + self.mods.len() * 256);
+        data.write_all(GAME_CONFIG_MAGIC)?;
+        data.write_u16(GAME_CONFIG_VERSION)?;
+        data.write_sized_string_u8(&self.game_key)?;
+
+        data.write_u32(self.mods.len() as u32)?;
+        for modd in self.mods.values() {
+            data.write_sized_string_u8(&modd.name)?;
+            data.write_sized_string_u8(&modd.id)?;
+            data.write_bool(modd.enabled)?;
+
+            write_optional_string(&mut data, &modd.category)?;
+
+            data.write_u32(modd.paths.len() as u32)?;
+            for path in &modd.paths {
+                write_path(&mut data, path)?;
+            }
+
+            write_optional_string(&mut data, &modd.steam_id)?;
+            write_optional_string(&mut data, &modd.preview_url)?;
+            data.write_u64(modd.time_updated)?;
+        }
+
+        write_strings(&mut data, &self.load_order.pinned)?;
+        data.write_u32(self.load_order.rules.len() as u32)?;
+        for rule in &self.load_order.rules {
+            data.write_sized_string_u8(&rule.before)?;
+            data.write_sized_string_u8(&rule.after)?;
+        }
+
+        write_strings(&mut data, &self.load_order.order)?;
+
+        Ok(data)
+    }
+
+    fn decode_binary(data: &[u8]) -> Result<Self> {
+        let mut data = Cursor::new(data);
+        let version = check_header(&mut data, GAME_CONFIG_MAGIC, GAME_CONFIG_VERSION)?;
+
+        let game_key = read_str(&mut data)?.to_owned();
+        let mods_count = read_count(&mut data, MIN_MOD_SIZE)?;
+        let mut mods = Mods::default();
+        for _ in 0..mods_count {
+            let name = read_str(&mut data)?.to_owned();
+            let id = read_str(&mut data)?.to_owned();
+            let enabled = data.read_bool()?;
+            let category = read_optional_string(&mut data)?;
+
+            // Paths were saved as UTF-8 before version 4.
+            let paths_count = read_count(&mut data, MIN_STRING_SIZE)?;
+            let mut paths = Vec::with_capacity(paths_count);
+            for _ in 0..paths_count {
+                paths.push(if version >= 4 { read_path(&mut data)? } else { PathBuf::from(read_str(&mut data)?) });
+            }
+
+            // Workshop data was added in version 2.
+            let (steam_id, preview_url, time_updated) = if version >= 2 {
+                (read_optional_string(&mut data)?, read_optional_string(&mut data)?, data.read_u64()?)
+            } else {
+                (None, None, 0)
+            };
+
+            mods.insert(Mod {
+                name,
+                id,
+                enabled,
+                category,
+                paths,
+                steam_id,
+                preview_url,
+                time_updated,
+                ..Default::default()
+            });
+        }
+
+        // Load order rules were added in version 3.
+        let load_order = if version >= 3 {
+            let pinned = read_strings(&mut data)?;
+            let rules_count = read_count(&mut data, MIN_STRING_SIZE * 2)?;
+            let mut rules = Vec::with_capacity(rules_count);
+            for _ in 0..rules_count {
+                rules.push(LoadOrderRule {
+                    before: read_str(&mut data)?.to_owned(),
+                    after: read_str(&mut data)?.to_owned(),
+                });
+            }
+
+            LoadOrder {
+                pinned,
+                rules,
+                order: read_strings(&mut data)?,
+            }
+        } else {
+            LoadOrder::default()
+        };
+
+        Ok(Self {
+            game_key,
+            mods,
+            load_order,
+            ..Default::default()
+        })
+    }
+}
+
+impl BinaryConfig for Profile {
+    fn encode_binary(&self) -> Result<Vec<u8>> {
+        let mut data = Vec::with_capacity(64 + self.mods.len() * 64);
+        data.write_all(PROFILE_MAGIC)?;
+        data.write_u16(PROFILE_VERSION)?;
+        data.write_sized_string_u8(&self.id)?;
+
+        data.write_u32(self.mods.len() as u32)?;
+        for modd in &self.mods {
+            data.write_sized_string_u8(modd)?;
+        }
+
+        Ok(data)
+    }
+
+    fn decode_binary(data: &[u8]) -> Result<Self> {
+        let mut data = Cursor::new(data);
+        check_header(&mut data, PROFILE_MAGIC, PROFILE_VERSION)?;
+
+        let id = read_str(&mut data)?.to_owned();
+        let mods_count = read_count(&mut data, MIN_STRING_SIZE)?;
+        let mut mods = Vec::with_capacity(mods_count);
+        for _ in 0..mods_count {
+            mods.push(read_str(&mut data)?.to_owned());
+        }
+
+        Ok(Self {
+            id,
+            mods,
+        })
+    }
+}
+
+/// This function checks the magic and version at the start of a binary config, returning the version.
+///
+/// Older versions are accepted, as decoders know how to fill what they lack.
+fn check_header(data: &mut Cursor<&[u8]>, magic: &[u8; 4], version: u16) -> Result<u16> {
+    let mut file_magic = [0; 4];
+    data.read_exact(&mut file_magic)?;
+    if &file_magic != magic {
+        return Err(anyhow!("Invalid binary config: unknown magic."));
+    }
+
+    let file_version = data.read_u16()?;
+    if file_version == 0 || file_version > version {
+        return Err(anyhow!("Unsupported binary config version: {}.", file_version));
+    }
+
+    Ok(file_version)
+}
+
+fn write_optional_string(data: &mut Vec<u8>, value: &Option<String>) -> Result<()> {
+    data.write_bool(value.is_some())?;
+    if let Some(value) = value {
+        data.write_sized_string_u8(value)?;
+    }
+
+    Ok(())
+}
+
+fn read_optional_string(data: &mut Cursor<&[u8]>) -> Result<Option<String>> {
+    if data.read_bool()? {
+        Ok(Some(read_str(data)?.to_owned()))
+    } else {
+        Ok(None)
+    }
+}
+
+fn write_strings(data: &mut Vec<u8>, values: &[String]) -> Result<()> {
+    data.write_u32(values.len() as u32)?;
+    for value in values {
+        data.write_sized_string_u8(value)?;
+    }
+
+    Ok(())
+}
+
+fn read_strings(data: &mut Cursor<&[u8]>) -> Result<Vec<String>> {
+    let count = read_count(data, MIN_STRING_SIZE)?;
+    let mut values = Vec::with_capacity(count);
+    for _ in 0..count {
+        values.push(read_str(data)?.to_owned());
+    }
+
+    Ok(values)
+}
+
+/// This function reads a u16-length-prefixed run of bytes, borrowing it from the buffer.
+fn read_sized_bytes<'a>(data: &mut Cursor<&'a [u8]>) -> Result<&'a [u8]> {
+    let len = data.read_u16()? as usize;
+    let buffer: &'a [u8] = data.get_ref();
+    let start = data.position() as usize;
+    let bytes = buffer.get(start..start + len).ok_or_else(|| anyhow!("Invalid binary config: string past the end of the file."))?;
+    data.set_position((start + len) as u64);
+    Ok(bytes)
+}
+
+/// This function reads a u16-length-prefixed UTF-8 string, borrowing it from the buffer.
+fn read_str<'a>(data: &mut Cursor<&'a [u8]>) -> Result<&'a str> {
+    Ok(std::str::from_utf8(read_sized_bytes(data)?)?)
+}
+
+/// This function writes a path as a u16-length-prefixed run of the bytes the OS uses for it: UTF-16LE on Windows, raw elsewhere.
+fn write_path(data: &mut Vec<u8>, path: &Path) -> Result<()> {
+    #[cfg(unix)] {
+        use std::os::unix::ffi::OsStrExt;
+        let bytes = path.as_os_str().as_bytes();
+        data.write_u16(u16::try_from(bytes.len())?)?;
+        data.write_all(bytes)?;
+    }
+
+    #[cfg(windows)] {
+        use std::os::windows::ffi::OsStrExt;
+        let bytes = path.as_os_str().encode_wide().flat_map(|unit| unit.to_le_bytes()).collect::<Vec<_>>();
+        data.write_u16(u16::try_from(bytes.len())?)?;
+        data.write_all(&bytes)?;
+    }
+
+    Ok(())
+}
+
+/// This function reads a path written by [write_path].
+fn read_path(data: &mut Cursor<&[u8]>) -> Result<PathBuf> {
+    let bytes = read_sized_bytes(data)?;
+
+    #[cfg(unix)]
+    let path: OsString = {
+        use std::os::unix::ffi::OsStrExt;
+        std::ffi::OsStr::from_bytes(bytes).to_owned()
+    };
+
+    #[cfg(windows)]
+    let path = {
+        use std::os::windows::ffi::OsStringExt;
+        let units = bytes.chunks_exact(2).map(|unit| u16::from_le_bytes([unit[0], unit[1]])).collect::<Vec<_>>();
+        OsString::from_wide(&units)
+    };
+
+    Ok(PathBuf::from(path))
+}
+
+/// This function reads the count of a list, checking the bytes left can hold that many entries of `min_entry_size` bytes.
+///
+/// Counts are used to preallocate, so a corrupt one has to fail here, before it asks for gigabytes of memory.
+fn read_count(data: &mut Cursor<&[u8]>, min_entry_size: usize) -> Result<usize> {
+    let count = data.read_u32()? as usize;
+    let remaining = data.get_ref().len().saturating_sub(data.position() as usize);
+    if count > remaining / min_entry_size {
+        return Err(anyhow!("Invalid binary config: {} entries don't fit in the {} bytes left.", count, remaining));
+    }
+
+    Ok(count)
+}
@@ -0,0 +1,95 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Epic Games Store installs.
+//!
+//! The Epic launcher keeps a small json manifest per installed game in its data folder, with the folder the game is installed in.
+//! Reading them is all it takes to find Epic installs, so we never have to go looking for games across drives. Manifests are
+//! only read the first time an install is requested, and kept for the rest of the session.
+
+use anyhow::Result;
+use lazy_static::lazy_static;
+use serde::Deserialize;
+
+use std::env;
+use std::fs::{read, read_dir};
+use std::path::{Path, PathBuf};
+
+use rpfm_lib::games::GameInfo;
+use rpfm_lib::integrations::log::*;
+
+/// Extension of the manifests of installed games.
+const MANIFEST_EXTENSION: &str = "item";
+
+lazy_static! {
+    static ref EPIC_INSTALLS: Vec<PathBuf> = epic_installs();
+}
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// The part of an Epic manifest we care about.
+#[derive(Debug, Deserialize)]
+#[serde(rename_all = "PascalCase")]
+struct EpicManifest {
+    install_location: PathBuf,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+/// This function returns the folder the provided game is installed in through Epic, if it is.
+///
+/// Manifests don't say which game they are in a way we can map to our games, so the right install is the one with the game's executable.
+pub fn epic_install_path(game: &GameInfo) -> Option<PathBuf> {
+    EPIC_INSTALLS.iter()
+        .find(|path| game.executable_path(path).map_or(false, |executable| executable.is_file()))
+        .cloned()
+}
+
+/// This function returns the folder where the Epic launcher keeps the manifests of the installed games, if it's installed.
+fn manifests_path() -> Option<PathBuf> {
+    if cfg!(target_os = "windows") {
+        let path = PathBuf::from(env::var_os("ProgramData")?).join("Epic/EpicGamesLauncher/Data/Manifests");
+        if path.is_dir() {
+            return Some(path);
+        }
+    }
+
+    None
+}
+
+/// This function returns the install folders of all the games installed through Epic.
+fn epic_installs() -> Vec<PathBuf> {
+    let mut installs = vec![];
+    let entries = match manifests_path().and_then(|path| read_dir(path).ok()) {
+        Some(entries) => entries,
+        None => return installs,
+    };
+
+    for path in entries.flatten().map(|entry| entry.path()) {
+        if path.extension().map_or(false, |extension| extension == MANIFEST_EXTENSION) {
+            match read_manifest(&path) {
+                Ok(manifest) => if manifest.install_location.is_dir() {
+                    installs.push(manifest.install_location);
+                },
+                Err(error) => info!("Epic manifest {} not read: {}", path.to_string_lossy(), error),
+            }
+        }
+    }
+
+    installs
+}
+
+fn read_manifest(path: &Path) -> Result<EpicManifest> {
+    serde_json::from_slice(&read(path)?).map_err(From::from)
+}
@@ -8,21 +8,38 @@
 // https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
 //---------------------------------------------------------------------------//
 
-use anyhow::Result;
+use anyhow::{anyhow, Result};
 use getset::*;
-use serde::{Deserialize, Serialize};
-use serde_json::to_string_pretty;
+use serde::{de::DeserializeOwned, Deserialize, Serialize};
 
-use std::collections::HashMap;
-use std::fs::{DirBuilder, File};
+use std::collections::{BTreeSet, HashMap, HashSet};
+use std::fs::{remove_file, rename, DirBuilder, File};
 use std::io::{BufReader, BufWriter, Read, Write};
-use std::path::PathBuf;
+use std::path::{Path, PathBuf};
 
 use rpfm_lib::games::GameInfo;
+use rpfm_lib::integrations::log::*;
 use rpfm_lib::utils::*;
 
 use crate::settings_ui::*;
 
+use self::binary::BinaryConfig;
+use self::mod_ids::{ModHandle, Mods};
+
+mod binary;
+pub mod epic;
+pub mod mod_ids;
+pub mod steam;
+
+const BINARY_EXTENSION: &str = "bin";
+const JSON_EXTENSION: &str = "json";
+
+/// Extensions of all the formats configs can be saved as.
+const CONFIG_EXTENSIONS: [&str; 2] = [BINARY_EXTENSION, JSON_EXTENSION];
+
+/// Extension appended to configs that failed to decode, so they're kept around but never loaded again.
+const CORRUPT_EXTENSION: &str = "corrupt";
+
 //-------------------------------------------------------------------------------//
 //                              Enums & Structs
 //-------------------------------------------------------------------------------//
@@ -31,7 +48,18 @@ use crate::settings_ui::*;
 #[getset(get = "pub", get_mut = "pub", set = "pub")]
 pub struct GameConfig {
     game_key: String,
-    mods: HashMap<String, Mod>,
+
+    // Mods of the game, by handle. Use [GameConfig::add_mod] to add new ones.
+    #[getset(skip)]
+    mods: Mods,
+
+    // User rules for the load order, and the last order solved with them.
+    #[serde(default)]
+    load_order: LoadOrder,
+
+    // If the config has changes not yet saved to disk.
+    #[serde(skip)]
+    dirty: bool,
 }
 
 #[derive(Debug, Default, Getters, MutGetters, Setters, Serialize, Deserialize)]
@@ -41,7 +69,8 @@ pub struct Mod {
     // Visual name of the mod.
     name: String,
 
-    // Pack name of the mod.
+    // Pack name of the mod. Fixed once the mod is created, as the config finds mods by it.
+    #[getset(skip)]
     id: String,
 
     // If the mod is enabled or not.
@@ -52,6 +81,49 @@ pub struct Mod {
 
     // Multiple paths in case it's both in data and in a secondary folder. /data always takes priority.
     paths: Vec<PathBuf>,
+
+    // Workshop id of the mod, if it's from there.
+    #[serde(default)]
+    steam_id: Option<String>,
+
+    // Url of the preview image of the mod in the Workshop.
+    #[serde(default)]
+    preview_url: Option<String>,
+
+    // Last time the mod was updated in the Workshop, in seconds since the epoch.
+    #[serde(default)]
+    time_updated: u64,
+
+    // Handle of the mod in its game config. Given by the config, so it can't be set from outside.
+    #[serde(skip)]
+    #[getset(skip)]
+    handle: ModHandle,
+}
+
+/// Load order of the enabled mods of a game, as decided by the user.
+///
+/// Pins and rules are what the user asked for. The order is what `mod_manager::load_order` solved from them the last time
+/// the enabled mods changed, so launching can read it without solving it again.
+#[derive(Clone, Debug, Default, Getters, MutGetters, Setters, Serialize, Deserialize)]
+#[getset(get = "pub", get_mut = "pub", set = "pub")]
+pub struct LoadOrder {
+
+    // Mods loaded first among the packs of their type, in the order they were pinned.
+    pinned: Vec<String>,
+
+    // Rules between pairs of mods.
+    rules: Vec<LoadOrderRule>,
+
+    // Ids of the enabled mods, in the order they were last solved.
+    order: Vec<String>,
+}
+
+/// A rule saying a mod must load before another one. Rules with disabled mods are ignored.
+#[derive(Clone, Debug, PartialEq, Eq, Getters, Serialize, Deserialize)]
+#[getset(get = "pub")]
+pub struct LoadOrderRule {
+    before: String,
+    after: String,
 }
 
 #[derive(Clone, Debug, Default, Getters, Setters, Serialize, Deserialize)]
@@ -61,6 +133,27 @@ pub struct Profile {
     mods: Vec<String>,
 }
 
+/// What applying a profile changes in a game config: the mods it enables and the ones it disables.
+#[derive(Clone, Debug, Default, Getters)]
+#[getset(get = "pub")]
+pub struct ProfileDiff {
+    enable: Vec<ModHandle>,
+    disable: Vec<ModHandle>,
+}
+
+/// Formats the configs and profiles can be saved as.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum ConfigFormat {
+
+    /// Versioned binary encoding. Smallest and fastest to load.
+    #[default]
+    Binary,
+    Json,
+
+    /// Slower and bigger, but easier to edit by hand.
+    PrettyJson,
+}
+
 //-------------------------------------------------------------------------------//
 //                             Implementations
 //-------------------------------------------------------------------------------//
@@ -68,84 +161,320 @@ pub struct Profile {
 impl GameConfig {
 
     pub fn load(game: &GameInfo, new_if_missing: bool) -> Result<Self> {
-        let path = game_config_path()?.join(format!("game_config_{}.json", game.game_key_name()));
-        if !path.is_file() && new_if_missing {
-            return Ok(Self {
+        let base_path = Self::base_path(game)?;
+        match load_config::<Self>(&base_path)? {
+            Some(config) => Ok(config),
+            None if new_if_missing => Ok(Self {
                 game_key: game.game_key_name().to_string(),
                 ..Default::default()
-            });
+            }),
+            None => Err(anyhow!("No config found for the game {}.", game.game_key_name())),
+        }
+    }
+
+    pub fn save(&mut self, game: &GameInfo, format: ConfigFormat) -> Result<()> {
+        save_config(&Self::base_path(game)?, self, format)?;
+
+        self.dirty = false;
+        Ok(())
+    }
+
+    /// This function saves the config, only if it has unsaved changes.
+    pub fn save_if_dirty(&mut self, game: &GameInfo, format: ConfigFormat) -> Result<()> {
+        if self.dirty {
+            self.save(game, format)?;
         }
 
-        let mut file = BufReader::new(File::open(path)?);
-        let mut data = Vec::with_capacity(file.get_ref().metadata()?.len() as usize);
-        file.read_to_end(&mut data)?;
+        Ok(())
+    }
 
-        let profile: Self = serde_json::from_slice(&data)?;
+    pub fn mods(&self) -> &Mods {
+        &self.mods
+    }
 
-        Ok(profile)
+    /// Mods can be changed, but not added, from here. Use [GameConfig::add_mod] for that.
+    pub(crate) fn mods_mut(&mut self) -> &mut Mods {
+        &mut self.mods
     }
 
-    pub fn save(&mut self, game: &GameInfo) -> Result<()> {
-        let path = game_config_path()?.join(format!("game_config_{}.json", game.game_key_name()));
+    /// This function adds a new mod to the config, giving it its handle.
+    pub fn add_mod(&mut self, modd: Mod) {
+        self.mods.insert(modd);
+    }
 
-        // Make sure the path exists to avoid problems with updating schemas.
-        if let Some(parent_folder) = path.parent() {
-            DirBuilder::new().recursive(true).create(parent_folder)?;
+    /// This function returns the handle of the mod with the provided id, if the config has it.
+    pub fn mod_handle(&self, mod_id: &str) -> Option<ModHandle> {
+        self.mods.handle(mod_id)
+    }
+
+    /// This function returns the id of the mod with the provided handle, if it's a handle of this config.
+    pub fn mod_id(&self, handle: ModHandle) -> Option<&str> {
+        self.mods.id(handle)
+    }
+
+    pub fn mod_by_handle(&self, handle: ModHandle) -> Option<&Mod> {
+        self.mods.by_handle(handle)
+    }
+
+    pub fn mod_by_handle_mut(&mut self, handle: ModHandle) -> Option<&mut Mod> {
+        self.mods.by_handle_mut(handle)
+    }
+
+    /// Path of the config, without extension, as that depends on the format it was saved as.
+    fn base_path(game: &GameInfo) -> Result<PathBuf> {
+        Ok(game_config_path()?.join(format!("game_config_{}", game.game_key_name())))
+    }
+}
+
+impl LoadOrderRule {
+    pub fn new(before: &str, after: &str) -> Self {
+        Self {
+            before: before.to_owned(),
+            after: after.to_owned(),
         }
+    }
+}
 
-        let mut file = BufWriter::new(File::create(path)?);
-        file.write_all(to_string_pretty(&self)?.as_bytes())?;
-        Ok(())
+impl Mod {
+
+    /// This function creates a mod for the Pack with the provided name, named after it until we know better.
+    pub fn new(pack_name: &str) -> Self {
+        Self {
+            name: pack_name.to_owned(),
+            id: pack_name.to_owned(),
+            ..Default::default()
+        }
+    }
+
+    pub fn id(&self) -> &String {
+        &self.id
+    }
+
+    pub fn handle(&self) -> ModHandle {
+        self.handle
     }
 }
 
 impl Profile {
 
-    pub fn profiles_for_game(game: &GameInfo) -> Result<HashMap<String, Self>> {
-        let mut profiles = HashMap::new();
+    /// This function returns the names of all the profiles of the provided game.
+    ///
+    /// Names are taken from the file names, so no profile is actually read from disk. Use `Profile::load` for that.
+    pub fn profile_names_for_game(game: &GameInfo) -> Result<BTreeSet<String>> {
+        let mut names = BTreeSet::new();
         let path = profiles_path()?;
         let file_name_start = format!("profile_{}_", game.game_key_name());
 
         let files = files_from_subdir(&path, false)?;
         for file in files {
-            let file_name = file.file_name().unwrap().to_string_lossy();
-            if file_name.starts_with(&file_name_start) && file_name.ends_with(".json") {
-                let file_name_no_end = file.file_stem().unwrap().to_string_lossy().strip_prefix(&file_name_start).unwrap().to_string();
-                let profile = Self::load(game, &file_name_no_end, false)?;
-                profiles.insert(file_name_no_end, profile);
+            let is_config = file.extension().map(|extension| CONFIG_EXTENSIONS.iter().any(|x| extension == *x)).unwrap_or(false);
+            if is_config {
+                if let Some(name) = file.file_stem().and_then(|stem| stem.to_str()).and_then(|stem| stem.strip_prefix(&file_name_start)) {
+                    names.insert(name.to_owned());
+                }
             }
         }
 
-        Ok(profiles)
+        Ok(names)
     }
 
     pub fn load(game: &GameInfo, profile: &str, new_if_missing: bool) -> Result<Self> {
-        let path = profiles_path()?.join(format!("profile_{}_{}.json", game.game_key_name(), profile));
-        if !path.is_file() && new_if_missing {
-            return Ok(Self {
+        let base_path = Self::base_path(game, profile)?;
+        match load_config(&base_path)? {
+            Some(profile) => Ok(profile),
+            None if new_if_missing => Ok(Self {
                 id: profile.to_string(),
                 ..Default::default()
-            });
+            }),
+            None => Err(anyhow!("No profile called {} found.", profile)),
+        }
+    }
+
+    pub fn save(&mut self, game: &GameInfo, profile: &str, format: ConfigFormat) -> Result<()> {
+        save_config(&Self::base_path(game, profile)?, self, format)
+    }
+
+    /// This function returns the handles of the mods enabled in the profile, in the provided game config.
+    ///
+    /// Mods the config doesn't know about are skipped, as there's nothing to enable for them.
+    pub fn enabled_mods(&self, game_config: &GameConfig) -> HashSet<ModHandle> {
+        self.mods.iter().filter_map(|mod_id| game_config.mod_handle(mod_id)).collect()
+    }
+
+    /// This function enables the mods of the profile in the provided game config, and disables the rest.
+    pub fn apply(&self, game_config: &mut GameConfig) {
+        self.diff(game_config).apply(game_config);
+    }
+
+    /// This function returns what applying the profile would change in the provided game config.
+    pub fn diff(&self, game_config: &GameConfig) -> ProfileDiff {
+        let enabled = self.enabled_mods(game_config);
+        let mut diff = ProfileDiff::default();
+        for modd in game_config.mods.values() {
+            match (modd.enabled, enabled.contains(&modd.handle)) {
+                (false, true) => diff.enable.push(modd.handle),
+                (true, false) => diff.disable.push(modd.handle),
+                _ => {}
+            }
         }
 
-        let mut file = BufReader::new(File::open(path)?);
-        let mut data = Vec::with_capacity(file.get_ref().metadata()?.len() as usize);
-        file.read_to_end(&mut data)?;
+        diff
+    }
 
-        let profile: Self = serde_json::from_slice(&data)?;
-        Ok(profile)
+    /// Path of the profile, without extension, as that depends on the format it was saved as.
+    fn base_path(game: &GameInfo, profile: &str) -> Result<PathBuf> {
+        Ok(profiles_path()?.join(format!("profile_{}_{}", game.game_key_name(), profile)))
     }
+}
 
-    pub fn save(&mut self, game: &GameInfo, profile: &str) -> Result<()> {
-        let path = profiles_path()?.join(format!("profile_{}_{}.json", game.game_key_name(), profile));
+impl ProfileDiff {
 
-        // Make sure the path exists to avoid problems with updating schemas.
-        if let Some(parent_folder) = path.parent() {
-            DirBuilder::new().recursive(true).create(parent_folder)?;
+    /// This function applies the diff to the provided game config. The config is only marked as changed if the diff changes anything.
+    pub fn apply(&self, game_config: &mut GameConfig) {
+        for (handles, enabled) in [(&self.enable, true), (&self.disable, false)] {
+            for handle in handles {
+                if let Some(modd) = game_config.mod_by_handle_mut(*handle) {
+                    modd.enabled = enabled;
+                }
+            }
         }
 
-        let mut file = BufWriter::new(File::create(path)?);
-        file.write_all(to_string_pretty(&self)?.as_bytes())?;
-        Ok(())
+        if !self.is_empty() {
+            game_config.dirty = true;
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.enable.is_empty() && self.disable.is_empty()
+    }
+
+    pub fn len(&self) -> usize {
+        self.enable.len() + self.disable.len()
+    }
+}
+
+impl ConfigFormat {
+
+    /// This function returns the format matching the provided settings key, defaulting to binary.
+    pub fn from_key(key: &str) -> Self {
+        match key {
+            "json" => Self::Json,
+            "pretty_json" => Self::PrettyJson,
+            _ => Self::Binary,
+        }
+    }
+
+    pub fn key(&self) -> &'static str {
+        match self {
+            Self::Binary => "binary",
+            Self::Json => "json",
+            Self::PrettyJson => "pretty_json",
+        }
+    }
+
+    pub fn extension(&self) -> &'static str {
+        match self {
+            Self::Binary => BINARY_EXTENSION,
+            Self::Json | Self::PrettyJson => JSON_EXTENSION,
+        }
     }
+
+    fn encode<T: Serialize + BinaryConfig>(&self, value: &T) -> Result<Vec<u8>> {
+        match self {
+            Self::Binary => value.encode_binary(),
+            Self::Json => serde_json::to_vec(value).map_err(From::from),
+            Self::PrettyJson => serde_json::to_vec_pretty(value).map_err(From::from),
+        }
+    }
+
+    fn decode<T: DeserializeOwned + BinaryConfig>(&self, data: &[u8]) -> Result<T> {
+        match self {
+            Self::Binary => T::decode_binary(data),
+            Self::Json | Self::PrettyJson => serde_json::from_slice(data).map_err(From::from),
+        }
+    }
+}
+
+/// This function returns the folder the provided game is installed in, if we can find it installed through Steam or Epic.
+///
+/// Launcher data is only read the first time an install is requested, and kept for the rest of the session.
+pub fn game_install_path(game: &GameInfo) -> Option<PathBuf> {
+    steam::steam_install_path(game).or_else(|| epic::epic_install_path(game))
+}
+
+/// This function loads a config saved in any of the supported formats, or returns `None` if there's none.
+///
+/// If for some reason there are files in more than one format, binary ones take priority. A file that can't be decoded is
+/// moved aside with a warning, so the next format is tried, and saving a fresh config doesn't overwrite it.
+fn load_config<T: DeserializeOwned + BinaryConfig>(base_path: &Path) -> Result<Option<T>> {
+    for format in [ConfigFormat::Binary, ConfigFormat::Json] {
+        let path = config_file_path(base_path, format.extension());
+        if path.is_file() {
+            let mut file = BufReader::new(File::open(&path)?);
+            let mut data = Vec::with_capacity(file.get_ref().metadata()?.len() as usize);
+            file.read_to_end(&mut data)?;
+
+            match format.decode(&data) {
+                Ok(config) => return Ok(Some(config)),
+                Err(error) => {
+                    let corrupt_path = config_file_path(&path, CORRUPT_EXTENSION);
+                    warn!("Config {} is corrupt, and has been moved to {}: {}", path.to_string_lossy(), corrupt_path.to_string_lossy(), error);
+                    rename(&path, &corrupt_path)?;
+                }
+            }
+        }
+    }
+
+    Ok(None)
+}
+
+/// This function saves a config in the provided format, removing any copy of it saved in other formats.
+///
+/// That's what migrates old json configs to binary, and back if the user wants to edit them by hand.
+fn save_config<T: Serialize + BinaryConfig>(base_path: &Path, value: &T, format: ConfigFormat) -> Result<()> {
+    write_atomic(&config_file_path(base_path, format.extension()), &format.encode(value)?)?;
+
+    for extension in CONFIG_EXTENSIONS {
+        let path = config_file_path(base_path, extension);
+        if extension != format.extension() && path.is_file() {
+            remove_file(path)?;
+        }
+    }
+
+    Ok(())
+}
+
+/// This function returns the path of a config file: the base path with the extension appended.
+///
+/// Not `Path::with_extension`, as profile names can have dots, and that would replace everything after the last one.
+fn config_file_path(base_path: &Path, extension: &str) -> PathBuf {
+    let mut path = base_path.as_os_str().to_owned();
+    path.push(".");
+    path.push(extension);
+    PathBuf::from(path)
+}
+
+/// This function replaces the file at the provided path with the provided data.
+///
+/// The data is written to a temporal file first and then renamed over the old file,
+/// so a crash mid-write never leaves a half-written file behind.
+pub fn write_atomic(path: &Path, data: &[u8]) -> Result<()> {
+
+    // Make sure the path exists to avoid problems with updating schemas.
+    if let Some(parent_folder) = path.parent() {
+        DirBuilder::new().recursive(true).create(parent_folder)?;
+    }
+
+    let mut temp_path = path.as_os_str().to_owned();
+    temp_path.push(".tmp");
+    let temp_path = PathBuf::from(temp_path);
+
+    let mut file = BufWriter::new(File::create(&temp_path)?);
+    file.write_all(data)?;
+    file.flush()?;
+    file.get_ref().sync_all()?;
+    drop(file);
+
+    rename(&temp_path, path)?;
+    Ok(())
 }
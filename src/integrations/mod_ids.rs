@@ -0,0 +1,155 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Compact handles for the mods of a game config, and the list of mods they index.
+//!
+//! Mod ids are pack names, so they're long, and the lists used to copy them into every item and compare them as strings.
+//! Instead, each game config gives its mods a [ModHandle]: a u32 that means the same mod for as long as the config lives.
+//! Items, rows and profile checks work with handles, and ids are only resolved back when something needs the text.
+//!
+//! Handles are not saved, and not valid across configs. Mods are never removed from a game config, so a handle is just the
+//! position of its mod in [Mods], and is never reused. Going from a handle to its mod is just indexing that list.
+
+use serde::{Deserialize, Deserializer, Serialize, Serializer};
+
+use std::collections::HashMap;
+use std::ops::Index;
+use std::slice::{Iter, IterMut};
+
+use super::Mod;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Handle of a mod in its game config. The default handle belongs to no mod.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub struct ModHandle(u32);
+
+/// Mods of a game config, by handle, with an index to find them by id.
+///
+/// Each id is stored twice: in its mod, and as the key of the index. Mods only get in through [Mods::insert], and their ids
+/// can't be changed from outside, so the index can't get out of sync. Saved as a map of id -> mod, like it always was.
+#[derive(Debug, Default)]
+pub struct Mods {
+    mods: Vec<Mod>,
+    handles: HashMap<String, ModHandle>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl Default for ModHandle {
+    fn default() -> Self {
+        Self(u32::MAX)
+    }
+}
+
+impl From<u32> for ModHandle {
+    fn from(value: u32) -> Self {
+        Self(value)
+    }
+}
+
+impl From<ModHandle> for u32 {
+    fn from(value: ModHandle) -> Self {
+        value.0
+    }
+}
+
+impl Mods {
+
+    /// This function adds a mod, giving it its handle. If there was already a mod with its id, it's replaced, keeping its handle.
+    pub fn insert(&mut self, mut modd: Mod) -> ModHandle {
+        match self.handles.get(&modd.id) {
+            Some(handle) => {
+                modd.handle = *handle;
+                self.mods[handle.0 as usize] = modd;
+                *handle
+            }
+            None => {
+                let handle = ModHandle(self.mods.len() as u32);
+                modd.handle = handle;
+                self.handles.insert(modd.id.to_owned(), handle);
+                self.mods.push(modd);
+                handle
+            }
+        }
+    }
+
+    pub fn get(&self, mod_id: &str) -> Option<&Mod> {
+        self.by_handle(self.handle(mod_id)?)
+    }
+
+    pub(crate) fn get_mut(&mut self, mod_id: &str) -> Option<&mut Mod> {
+        self.by_handle_mut(self.handle(mod_id)?)
+    }
+
+    pub fn by_handle(&self, handle: ModHandle) -> Option<&Mod> {
+        self.mods.get(handle.0 as usize)
+    }
+
+    pub(crate) fn by_handle_mut(&mut self, handle: ModHandle) -> Option<&mut Mod> {
+        self.mods.get_mut(handle.0 as usize)
+    }
+
+    /// This function returns the handle of the provided mod id, if it has one.
+    pub fn handle(&self, mod_id: &str) -> Option<ModHandle> {
+        self.handles.get(mod_id).copied()
+    }
+
+    /// This function returns the mod id of the provided handle, if it's a handle of these mods.
+    pub fn id(&self, handle: ModHandle) -> Option<&str> {
+        self.by_handle(handle).map(|modd| modd.id.as_str())
+    }
+
+    /// This function returns all the mods, in the order they were added.
+    pub fn values(&self) -> Iter<'_, Mod> {
+        self.mods.iter()
+    }
+
+    pub(crate) fn values_mut(&mut self) -> IterMut<'_, Mod> {
+        self.mods.iter_mut()
+    }
+
+    pub fn len(&self) -> usize {
+        self.mods.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.mods.is_empty()
+    }
+}
+
+impl Index<&str> for Mods {
+    type Output = Mod;
+
+    fn index(&self, mod_id: &str) -> &Mod {
+        self.get(mod_id).expect("No mod with the provided id.")
+    }
+}
+
+impl Serialize for Mods {
+    fn serialize<S: Serializer>(&self, serializer: S) -> Result<S::Ok, S::Error> {
+        serializer.collect_map(self.mods.iter().map(|modd| (&modd.id, modd)))
+    }
+}
+
+impl<'de> Deserialize<'de> for Mods {
+    fn deserialize<D: Deserializer<'de>>(deserializer: D) -> Result<Self, D::Error> {
+        let mut mods = Self::default();
+        for modd in HashMap::<String, Mod>::deserialize(deserializer)?.into_values() {
+            mods.insert(modd);
+        }
+
+        Ok(mods)
+    }
+}
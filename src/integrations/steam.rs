@@ -0,0 +1,606 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Steam Workshop metadata of the installed mods.
+//!
+//! Metadata is requested in bulk, up to [WORKSHOP_BATCH_SIZE] items per `GetPublishedFileDetails` call, with a few calls in flight
+//! at once, from a background thread. Whatever we get is kept in an on-disk cache per game, and items are only requested again
+//! once their cache entry is old, or their Pack changed on disk after we fetched them, which is what happens when Steam updates a mod.
+//! That means opening Runcher usually costs zero requests, and a thousand new subscriptions cost ten.
+//!
+//! This also finds the games installed through Steam. Steam lists its libraries, and the games in each of them, in
+//! `libraryfolders.vdf`, and each game has an `appmanifest_{app id}.acf` with its install folder, so finding our games takes
+//! reading only a few small files. That's done the first time an install is requested, and kept for the rest of the session.
+
+use anyhow::{anyhow, Result};
+use getset::*;
+use lazy_static::lazy_static;
+use rayon::prelude::*;
+use rayon::{ThreadPool, ThreadPoolBuilder};
+use serde::{Deserialize, Serialize};
+use steam_workshop_api::Workshop;
+
+use std::collections::{HashMap, HashSet};
+use std::env;
+use std::fs::{read_to_string, File};
+use std::io::{BufReader, Read};
+use std::iter::Peekable;
+use std::path::{Path, PathBuf};
+use std::str::Chars;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{SystemTime, UNIX_EPOCH};
+
+use rpfm_lib::games::{GameInfo, supported_games::*};
+use rpfm_lib::integrations::log::*;
+
+use crate::integrations::{Mod, write_atomic};
+use crate::mod_manager::pack_cache::file_stamp;
+use crate::settings_ui::workshop_cache_path;
+
+/// Max amount of items requested in a single call. Steam doesn't document a limit, but bigger calls start failing.
+pub const WORKSHOP_BATCH_SIZE: usize = 100;
+
+/// Amount of calls in flight at once.
+const WORKSHOP_REQUESTS_IN_FLIGHT: usize = 4;
+
+/// Time, in seconds, before a cached item is requested again even if its Pack didn't change.
+const WORKSHOP_CACHE_TTL: u64 = 24 * 60 * 60;
+
+/// Tag all mods have. Useless as a category.
+const GENERIC_TAG: &str = "mod";
+
+/// Steam app ids of the supported games, by game key.
+const STEAM_APP_IDS: [(&str, u32); 11] = [
+    (KEY_WARHAMMER_3, 1142710),
+    (KEY_TROY, 1099410),
+    (KEY_THREE_KINGDOMS, 779340),
+    (KEY_WARHAMMER_2, 594570),
+    (KEY_WARHAMMER, 364360),
+    (KEY_THRONES_OF_BRITANNIA, 712100),
+    (KEY_ATTILA, 325610),
+    (KEY_ROME_2, 214950),
+    (KEY_SHOGUN_2, 34330),
+    (KEY_NAPOLEON, 34030),
+    (KEY_EMPIRE, 10500),
+];
+
+lazy_static! {
+    static ref WORKSHOP_POOL: ThreadPool = ThreadPoolBuilder::new()
+        .num_threads(WORKSHOP_REQUESTS_IN_FLIGHT)
+        .thread_name(|index| format!("workshop_{index}"))
+        .build()
+        .expect("Failed to build the workshop thread pool.");
+
+    /// Install folders of the supported games installed through Steam, by app id.
+    static ref STEAM_INSTALLS: HashMap<u32, PathBuf> = steam_installs();
+}
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Metadata of a Workshop item we care about.
+#[derive(Clone, Debug, Default, Getters, Serialize, Deserialize)]
+#[getset(get = "pub")]
+pub struct WorkshopItem {
+    steam_id: String,
+    title: String,
+    preview_url: String,
+
+    // Last time the author updated the item, in seconds since the epoch.
+    time_updated: u64,
+    tags: Vec<String>,
+
+    // When we got this from Steam, in seconds since the epoch.
+    fetched: u64,
+}
+
+/// On-disk cache of the Workshop items of the mods of a game, by id.
+#[derive(Debug, Default, Serialize, Deserialize)]
+struct WorkshopCache {
+    game_key: String,
+    items: HashMap<String, WorkshopItem>,
+}
+
+/// A Workshop item to get metadata of.
+#[derive(Clone, Debug)]
+pub struct WorkshopRequest {
+    pub steam_id: String,
+
+    // Modification time of its Pack, in nanoseconds since the epoch, as returned by `file_stamp`.
+    pub modified: u64,
+}
+
+/// Handle to the Workshop thread.
+#[derive(Debug)]
+pub struct WorkshopFetcher {
+    sender: Sender<(u64, GameInfo, Vec<WorkshopRequest>)>,
+    receiver: Receiver<WorkshopItem>,
+
+    // Items requested but not yet received or failed.
+    pending: Arc<AtomicUsize>,
+
+    // Requests from older generations are skipped. Increased every time the queue is cleared.
+    generation: Arc<AtomicU64>,
+}
+
+/// A Steam library, and the app ids of the games in it, if Steam lists them.
+#[derive(Debug)]
+struct SteamLibrary {
+    path: PathBuf,
+    apps: Option<HashSet<u32>>,
+}
+
+/// An entry of a Valve KeyValues file, like the `.vdf` and `.acf` files of Steam.
+#[derive(Debug)]
+enum KeyValue {
+    Value(String),
+    Block(Vec<(String, KeyValue)>),
+}
+
+/// A token of a KeyValues file.
+enum Token {
+    Text(String),
+    Open,
+    Close,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl WorkshopItem {
+
+    /// This function fills the data of a mod with this item. Returns true if the mod changed.
+    ///
+    /// Categories are only filled for mods without one, so we never overwrite the ones chosen by the user.
+    pub fn apply(&self, modd: &mut Mod) -> bool {
+        let mut changed = false;
+        if !self.title.is_empty() && modd.name != self.title {
+            modd.name = self.title.to_owned();
+            changed = true;
+        }
+
+        if !self.preview_url.is_empty() && modd.preview_url.as_deref() != Some(&self.preview_url) {
+            modd.preview_url = Some(self.preview_url.to_owned());
+            changed = true;
+        }
+
+        if modd.time_updated != self.time_updated {
+            modd.time_updated = self.time_updated;
+            changed = true;
+        }
+
+        if modd.category.is_none() {
+            if let Some(tag) = self.tags.iter().find(|tag| !tag.eq_ignore_ascii_case(GENERIC_TAG)) {
+                modd.category = Some(tag.to_owned());
+                changed = true;
+            }
+        }
+
+        changed
+    }
+}
+
+impl WorkshopCache {
+
+    /// This function loads the Workshop cache of the provided game.
+    ///
+    /// Like the Pack cache, this is disposable, so if it's missing or it cannot be decoded we just start with an empty one.
+    fn load(game: &GameInfo) -> Result<Self> {
+        let path = Self::path(game)?;
+        let cache = if path.is_file() {
+            let mut file = BufReader::new(File::open(path)?);
+            let mut data = Vec::with_capacity(file.get_ref().metadata()?.len() as usize);
+            file.read_to_end(&mut data)?;
+
+            serde_json::from_slice::<Self>(&data).ok().filter(|cache| cache.game_key == game.game_key_name())
+        } else {
+            None
+        };
+
+        Ok(cache.unwrap_or_else(|| Self {
+            game_key: game.game_key_name().to_owned(),
+            ..Default::default()
+        }))
+    }
+
+    fn save(&self, game: &GameInfo) -> Result<()> {
+        write_atomic(&Self::path(game)?, &serde_json::to_vec(&self)?)
+    }
+
+    /// This function returns the cached item for a request, if it's still valid.
+    fn item(&self, request: &WorkshopRequest, now: u64) -> Option<&WorkshopItem> {
+        self.items.get(&request.steam_id)
+            .filter(|item| item.fetched + WORKSHOP_CACHE_TTL > now && request.modified / 1_000_000_000 <= item.fetched)
+    }
+
+    fn path(game: &GameInfo) -> Result<PathBuf> {
+        Ok(workshop_cache_path()?.join(format!("workshop_cache_{}.json", game.game_key_name())))
+    }
+}
+
+impl WorkshopFetcher {
+
+    /// This function starts the Workshop thread.
+    pub fn spawn() -> Self {
+        let (sender, requests) = channel::<(u64, GameInfo, Vec<WorkshopRequest>)>();
+        let (results, receiver) = channel();
+        let pending = Arc::new(AtomicUsize::new(0));
+        let generation = Arc::new(AtomicU64::new(0));
+
+        let thread_pending = pending.clone();
+        let thread_generation = generation.clone();
+        thread::spawn(move || {
+            let results = Mutex::new(results);
+            let mut cache: Option<WorkshopCache> = None;
+            while let Ok((request_generation, game, batch)) = requests.recv() {
+                let len = batch.len();
+                if request_generation == thread_generation.load(Ordering::SeqCst) {
+
+                    // Requests come per game, so keep the last cache loaded around.
+                    if cache.as_ref().map_or(true, |cache| cache.game_key != game.game_key_name()) {
+                        cache = Some(WorkshopCache::load(&game).unwrap_or_default());
+                    }
+
+                    if let Some(ref mut cache) = cache {
+                        let fetched = fetch_items(cache, &batch, &results, &thread_generation, request_generation);
+                        if fetched {
+                            if let Err(error) = cache.save(&game) {
+                                warn!("Error saving the workshop cache: {}", error);
+                            }
+                        }
+                    }
+                }
+
+                thread_pending.fetch_sub(len, Ordering::SeqCst);
+            }
+        });
+
+        Self {
+            sender,
+            receiver,
+            pending,
+            generation,
+        }
+    }
+
+    /// This function requests the metadata of the provided Workshop items.
+    ///
+    /// Cached items are returned right away, and the rest get requested in batches as they reach the Workshop thread.
+    pub fn fetch(&self, game: &GameInfo, requests: Vec<WorkshopRequest>) {
+        if requests.is_empty() {
+            return;
+        }
+
+        let len = requests.len();
+        self.pending.fetch_add(len, Ordering::SeqCst);
+        if self.sender.send((self.generation.load(Ordering::SeqCst), game.clone(), requests)).is_err() {
+            self.pending.fetch_sub(len, Ordering::SeqCst);
+            error!("Workshop thread is gone. Workshop data will not be available.");
+        }
+    }
+
+    /// This function drops everything requested, and stops sending results for them as soon as possible.
+    pub fn clear(&self) {
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        while self.receiver.try_recv().is_ok() {}
+    }
+
+    /// This function returns if there are items waiting for their metadata.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns all the items received since the last call. Never blocks.
+    pub fn results(&self) -> Vec<WorkshopItem> {
+        self.receiver.try_iter().collect()
+    }
+}
+
+impl KeyValue {
+    fn block(&self) -> Option<&[(String, KeyValue)]> {
+        match self {
+            Self::Block(entries) => Some(entries),
+            Self::Value(_) => None,
+        }
+    }
+}
+
+/// This function returns the Workshop requests for all the mods of the provided list that come from the Workshop.
+pub fn workshop_requests<'a>(mods: impl Iterator<Item = &'a Mod>) -> Vec<WorkshopRequest> {
+    mods.filter_map(|modd| {
+            let steam_id = modd.steam_id.as_ref()?;
+            let modified = modd.paths.iter()
+                .find(|path| steam_id_of(path).as_ref() == Some(steam_id))
+                .and_then(|path| file_stamp(path).ok())
+                .map(|(_, modified)| modified)?;
+
+            Some(WorkshopRequest {
+                steam_id: steam_id.to_owned(),
+                modified,
+            })
+        })
+        .collect()
+}
+
+/// This function returns the Workshop id of the mod with a Pack at the provided path, if it has any.
+///
+/// Workshop mods are downloaded to `content/{app id}/{workshop id}/`, so it's the name of the folder of the Pack.
+pub fn steam_id_of(path: &Path) -> Option<String> {
+    let folder = path.parent()?.file_name()?.to_str()?;
+    if !folder.is_empty() && folder.bytes().all(|byte| byte.is_ascii_digit()) {
+        Some(folder.to_owned())
+    } else {
+        None
+    }
+}
+
+/// This function sends the cached items, and fetches and sends the rest. Returns true if the cache changed.
+///
+/// If a batch fails, its items get their stale cached version, if any, so a Steam outage doesn't clear the titles we had.
+fn fetch_items(cache: &mut WorkshopCache, requests: &[WorkshopRequest], results: &Mutex<Sender<WorkshopItem>>, generation: &AtomicU64, request_generation: u64) -> bool {
+    let now = SystemTime::now().duration_since(UNIX_EPOCH).map(|time| time.as_secs()).unwrap_or_default();
+    let mut stale = vec![];
+    for request in requests {
+        match cache.item(request, now) {
+            Some(item) => { let _ = results.lock().unwrap().send(item.clone()); },
+            None => stale.push(request.steam_id.to_owned()),
+        }
+    }
+
+    if stale.is_empty() {
+        return false;
+    }
+
+    let fetched = WORKSHOP_POOL.install(|| stale.par_chunks(WORKSHOP_BATCH_SIZE)
+        .map(|batch| {
+            if generation.load(Ordering::SeqCst) != request_generation {
+                return vec![];
+            }
+
+            match fetch_batch(batch, now) {
+                Ok(items) => {
+                    let results = results.lock().unwrap();
+                    for item in &items {
+                        let _ = results.send(item.clone());
+                    }
+
+                    items
+                }
+                Err(error) => {
+                    warn!("Error getting the data of {} workshop items: {}", batch.len(), error);
+                    let results = results.lock().unwrap();
+                    for item in batch.iter().filter_map(|steam_id| cache.items.get(steam_id)) {
+                        let _ = results.send(item.clone());
+                    }
+
+                    vec![]
+                }
+            }
+        })
+        .flatten()
+        .collect::<Vec<_>>());
+
+    let changed = !fetched.is_empty();
+    for item in fetched {
+        cache.items.insert(item.steam_id.to_owned(), item);
+    }
+
+    changed
+}
+
+/// This function requests the metadata of a batch of Workshop items in a single call.
+fn fetch_batch(steam_ids: &[String], now: u64) -> Result<Vec<WorkshopItem>> {
+    let workshop = Workshop::new(None);
+    let items = workshop.get_published_file_details(steam_ids).map_err(|error| anyhow!("{}", error))?;
+
+    Ok(items.into_iter()
+        .map(|item| WorkshopItem {
+            steam_id: item.publishedfileid,
+            title: item.title,
+            preview_url: item.preview_url,
+            time_updated: item.time_updated as u64,
+            tags: item.tags.into_iter().map(|tag| tag.tag).collect(),
+            fetched: now,
+        })
+        .collect())
+}
+
+/// This function returns the folder the provided game is installed in through Steam, if it is.
+pub fn steam_install_path(game: &GameInfo) -> Option<PathBuf> {
+    let (_, app_id) = STEAM_APP_IDS.iter().find(|(key, _)| *key == game.game_key_name())?;
+    STEAM_INSTALLS.get(app_id).cloned()
+}
+
+/// This function returns the install folders of the supported games installed through Steam, by app id.
+///
+/// If a game is installed in more than one library, the first library listed wins.
+fn steam_installs() -> HashMap<u32, PathBuf> {
+    let mut installs = HashMap::new();
+    for library in steam_libraries() {
+        for (_, app_id) in STEAM_APP_IDS {
+            if installs.contains_key(&app_id) || library.apps.as_ref().map_or(false, |apps| !apps.contains(&app_id)) {
+                continue;
+            }
+
+            let steamapps = library.path.join("steamapps");
+            let manifest = match read_to_string(steamapps.join(format!("appmanifest_{app_id}.acf"))) {
+                Ok(manifest) => parse_key_values(&manifest),
+                Err(_) => continue,
+            };
+
+            let install_dir = match key_value(&manifest, "AppState").and_then(|state| key_value_text(state.block()?, "installdir")) {
+                Some(install_dir) => install_dir,
+                None => continue,
+            };
+
+            let path = steamapps.join("common").join(install_dir);
+            if path.is_dir() {
+                installs.insert(app_id, path);
+            }
+        }
+    }
+
+    installs
+}
+
+/// This function returns all the Steam libraries of all the Steam installs we can find, without duplicates.
+///
+/// Steam lists its own folder as a library, but old versions of `libraryfolders.vdf` don't, so we always add it.
+fn steam_libraries() -> Vec<SteamLibrary> {
+    let mut libraries: Vec<SteamLibrary> = vec![];
+    let mut seen = HashSet::new();
+    for root in steam_roots() {
+        let mut found = vec![];
+        if let Ok(data) = read_to_string(root.join("steamapps").join("libraryfolders.vdf")) {
+            let folders = parse_key_values(&data);
+            if let Some(folders) = key_value(&folders, "libraryfolders").and_then(KeyValue::block) {
+                for (key, value) in folders {
+                    if !key.bytes().all(|byte| byte.is_ascii_digit()) {
+                        continue;
+                    }
+
+                    match value {
+
+                        // Old format: just the path of the library.
+                        KeyValue::Value(path) => found.push(SteamLibrary { path: PathBuf::from(path), apps: None }),
+
+                        // New format: the path and the apps in the library.
+                        KeyValue::Block(library) => if let Some(path) = key_value_text(library, "path") {
+                            let apps = key_value(library, "apps")
+                                .and_then(KeyValue::block)
+                                .map(|apps| apps.iter().filter_map(|(app_id, _)| app_id.parse().ok()).collect());
+
+                            found.push(SteamLibrary { path: PathBuf::from(path), apps });
+                        },
+                    }
+                }
+            }
+        }
+
+        found.push(SteamLibrary { path: root, apps: None });
+
+        for library in found {
+            let key = library.path.canonicalize().unwrap_or_else(|_| library.path.to_owned());
+            if library.path.is_dir() && seen.insert(key) {
+                libraries.push(library);
+            }
+        }
+    }
+
+    libraries
+}
+
+/// This function returns the folders Steam may be installed in.
+///
+/// These are the default ones. Steam installed elsewhere is only found through the libraries of another Steam install.
+fn steam_roots() -> Vec<PathBuf> {
+    let mut roots = vec![];
+    if cfg!(target_os = "windows") {
+        for variable in ["ProgramFiles(x86)", "ProgramFiles"] {
+            if let Some(path) = env::var_os(variable) {
+                roots.push(PathBuf::from(path).join("Steam"));
+            }
+        }
+    } else if let Some(home) = env::var_os("HOME") {
+        let home = PathBuf::from(home);
+        roots.push(home.join(".steam/steam"));
+        roots.push(home.join(".local/share/Steam"));
+        roots.push(home.join(".var/app/com.valvesoftware.Steam/.local/share/Steam"));
+    }
+
+    roots.retain(|root| root.is_dir());
+    roots
+}
+
+/// This function returns the first entry with the provided key. Keys in KeyValues files are case insensitive.
+fn key_value<'a>(entries: &'a [(String, KeyValue)], key: &str) -> Option<&'a KeyValue> {
+    entries.iter().find(|(entry_key, _)| entry_key.eq_ignore_ascii_case(key)).map(|(_, value)| value)
+}
+
+fn key_value_text<'a>(entries: &'a [(String, KeyValue)], key: &str) -> Option<&'a str> {
+    match key_value(entries, key)? {
+        KeyValue::Value(value) => Some(value),
+        KeyValue::Block(_) => None,
+    }
+}
+
+/// This function parses a Valve KeyValues file. Broken files are parsed up to where they break.
+fn parse_key_values(data: &str) -> Vec<(String, KeyValue)> {
+    parse_key_values_block(&mut data.chars().peekable())
+}
+
+fn parse_key_values_block(chars: &mut Peekable<Chars>) -> Vec<(String, KeyValue)> {
+    let mut entries = vec![];
+    while let Some(token) = next_token(chars) {
+        match token {
+            Token::Text(key) => match next_token(chars) {
+                Some(Token::Text(value)) => entries.push((key, KeyValue::Value(value))),
+                Some(Token::Open) => entries.push((key, KeyValue::Block(parse_key_values_block(chars)))),
+                Some(Token::Close) | None => break,
+            },
+
+            // Blocks without key are broken. Skip them.
+            Token::Open => { parse_key_values_block(chars); },
+            Token::Close => break,
+        }
+    }
+
+    entries
+}
+
+fn next_token(chars: &mut Peekable<Chars>) -> Option<Token> {
+    loop {
+        match chars.next()? {
+            character if character.is_whitespace() => continue,
+            '/' if chars.peek() == Some(&'/') => {
+                for character in chars.by_ref() {
+                    if character == '\n' {
+                        break;
+                    }
+                }
+            }
+
+            '{' => return Some(Token::Open),
+            '}' => return Some(Token::Close),
+            '"' => {
+                let mut text = String::new();
+                while let Some(character) = chars.next() {
+                    match character {
+                        '"' => break,
+                        '\\' => match chars.next() {
+                            Some('n') => text.push('\n'),
+                            Some('t') => text.push('\t'),
+                            Some(character) => text.push(character),
+                            None => break,
+                        },
+                        character => text.push(character),
+                    }
+                }
+
+                return Some(Token::Text(text));
+            }
+
+            // Unquoted text goes until the next whitespace or special character.
+            character => {
+                let mut text = character.to_string();
+                while let Some(character) = chars.next_if(|character| !character.is_whitespace() && !matches!(character, '{' | '}' | '"')) {
+                    text.push(character);
+                }
+
+                return Some(Token::Text(text));
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here&: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Runcher, a generic launcher for Total War games since Empire: Total War.
+//!
+//! Everything lives in this library, so the launcher binary and the benchmarks share the same code. The `mod_manager` and
+//! `integrations` modules don't depend on the ui, and are what the benchmarks drive.
+
+// Disabled `Clippy` linters, with the reasons why they were disabled.
+#![allow(
+    clippy::cognitive_complexity,           // Disabled due to useless warnings.
+    //clippy::cyclomatic_complexity,          // Disabled due to useless warnings.
+    clippy::if_same_then_else,              // Disabled because some of the solutions it provides are freaking hard to read.
+    clippy::match_bool,                     // Disabled because the solutions it provides are harder to read than the current code.
+    clippy::new_ret_no_self,                // Disabled because the reported situations are special cases. So no, I'm not going to rewrite them.
+    clippy::suspicious_else_formatting,     // Disabled because the errors it gives are actually false positives due to comments.
+    clippy::match_wild_err_arm,             // Disabled because, despite being a bad practice, it's the intended behavior in the code it warns about.
+    clippy::clone_on_copy,                  // Disabled because triggers false positives on qt cloning.
+    clippy::mutex_atomic,                   // Disabled because in the only instance it triggers, we do it on purpose.
+    clippy::too_many_arguments              // Disabled because it gets annoying really quick.
+)]
+
+use lazy_static::lazy_static;
+
+use std::path::PathBuf;
+use std::sync::{Arc, RwLock};
+
+use rpfm_lib::games::supported_games::SupportedGames;
+use rpfm_lib::integrations::log::*;
+
+use rpfm_ui_common::settings::*;
+
+use crate::settings_ui::*;
+
+pub mod actions_ui;
+pub mod app_ui;
+pub mod cli;
+pub mod integrations;
+pub mod mod_list_ui;
+pub mod mod_manager;
+pub mod pack_list_ui;
+pub mod profiling;
+pub mod settings_ui;
+
+// Statics, so we don't need to pass them everywhere to use them.
+lazy_static! {
+
+    /// List of supported games and their configuration.
+    #[derive(Debug)]
+    pub static ref SUPPORTED_GAMES: SupportedGames = SupportedGames::default();
+    /*
+    /// Currently loaded schema.
+    static ref SCHEMA: Arc<RwLock<Option<Schema>>> = Arc::new(RwLock::new(None));
+    */
+    /// Sentry client guard, so we can reuse it later on and keep it in scope for the entire duration of the program.
+    pub static ref SENTRY_GUARD: Arc<RwLock<ClientInitGuard>> = Arc::new(RwLock::new(Logger::init(&{
+        init_config_path().expect("Error while trying to initialize config path. We're fucked.");
+        error_path().unwrap_or_else(|_| PathBuf::from("."))
+    }, true, true).unwrap()));
+    /*
+
+    /// Icons for the PackFile TreeView.
+    static ref TREEVIEW_ICONS: Icons = unsafe { Icons::new() };
+
+    /// Icons for the `Game Selected` in the TitleBar.
+    static ref GAME_SELECTED_ICONS: GameSelectedIcons = unsafe { GameSelectedIcons::new() };
+    */
+}
+
+pub const VERSION: &str = env!("CARGO_PKG_VERSION");
+pub const VERSION_SUBTITLE: &str = " -- A New Beginning";
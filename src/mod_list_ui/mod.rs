@@ -11,31 +11,44 @@
 use qt_widgets::QGridLayout;
 use qt_widgets::QLineEdit;
 use qt_widgets::QMainWindow;
+use qt_widgets::q_style::PixelMetric;
 use qt_widgets::QToolButton;
 use qt_widgets::QTreeView;
 
-use qt_gui::QListOfQStandardItem;
+use qt_gui::QIcon;
+use qt_gui::QImage;
+use qt_gui::q_image::Format;
+use qt_gui::QPixmap;
 use qt_gui::QStandardItem;
 use qt_gui::QStandardItemModel;
 
-use qt_core::CaseSensitivity;
 use qt_core::CheckState;
+use qt_core::ItemDataRole;
 use qt_core::QBox;
+use qt_core::QPoint;
 use qt_core::QPtr;
-use qt_core::QRegExp;
 use qt_core::QSortFilterProxyModel;
 use qt_core::QString;
 use qt_core::QTimer;
+use qt_core::QVariant;
 use qt_core::SortOrder;
 
+use cpp_core::{CppBox, Ptr};
+
 use anyhow::Result;
 use getset::*;
 
-use std::sync::Arc;
+use std::collections::HashMap;
+use std::sync::{Arc, RwLock};
 
+use rpfm_ui_common::locale::qtr;
 use rpfm_ui_common::utils::*;
 
-use crate::integrations::GameConfig;
+use crate::integrations::{GameConfig, Mod, ProfileDiff};
+use crate::integrations::mod_ids::ModHandle;
+use crate::mod_manager::filter::{FilterIndex, FilterOptions, FILTER_DELAY, FILTER_ROLE, FILTER_SCORE_ROLE, FILTER_VISIBLE};
+use crate::mod_manager::thumbnails::Thumbnail;
+use crate::profiling::span_with;
 
 use self::slots::ModListUISlots;
 
@@ -44,6 +57,9 @@ mod slots;
 const VIEW_DEBUG: &str = "ui_templates/filterable_tree_widget.ui";
 const VIEW_RELEASE: &str = "ui/filterable_tree_widget.ui";
 
+/// Data role of the mod items where we store the handle of their mod, as their text is the visual name of the mod.
+pub const MOD_HANDLE_ROLE: i32 = 30;
+
 //-------------------------------------------------------------------------------//
 //                              Enums & Structs
 //-------------------------------------------------------------------------------//
@@ -56,7 +72,18 @@ pub struct ModListUI {
     filter: QBox<QSortFilterProxyModel>,
     filter_line_edit: QPtr<QLineEdit>,
     filter_case_sensitive_button: QPtr<QToolButton>,
-    filter_timer: QBox<QTimer>
+    filter_regex_button: QPtr<QToolButton>,
+    filter_categories_button: QPtr<QToolButton>,
+    filter_paths_button: QPtr<QToolButton>,
+    filter_fuzzy_button: QPtr<QToolButton>,
+    filter_timer: QBox<QTimer>,
+
+    // Category and mod items of the model, by name and mod handle. Invalidated every time the model is cleared.
+    category_items: RwLock<HashMap<String, Ptr<QStandardItem>>>,
+    mod_items: RwLock<HashMap<ModHandle, Ptr<QStandardItem>>>,
+
+    // Searchable fields of the mods in the list.
+    filter_index: RwLock<FilterIndex>,
 }
 
 //-------------------------------------------------------------------------------//
@@ -70,20 +97,36 @@ impl ModListUI {
 
         // Load the UI Template.
         let template_path = if cfg!(debug_assertions) { VIEW_DEBUG } else { VIEW_RELEASE };
-        let main_widget = load_template(main_window, template_path)?;
+        let main_widget = {
+            let _span = span_with("load_template", template_path);
+            load_template(main_window, template_path)?
+        };
 
         let tree_view: QPtr<QTreeView> = find_widget(&main_widget.static_upcast(), "tree_view")?;
         let filter_line_edit: QPtr<QLineEdit> = find_widget(&main_widget.static_upcast(), "filter_line_edit")?;
         let filter_case_sensitive_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_case_sensitive_button")?;
+        let filter_regex_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_regex_button")?;
+        let filter_categories_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_categories_button")?;
+        let filter_paths_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_paths_button")?;
+        let filter_fuzzy_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_fuzzy_button")?;
+        filter_regex_button.set_tool_tip(&qtr("filter_regex"));
+        filter_categories_button.set_tool_tip(&qtr("filter_categories"));
+        filter_paths_button.set_tool_tip(&qtr("filter_paths"));
+        filter_fuzzy_button.set_tool_tip(&qtr("filter_fuzzy"));
 
         let model = QStandardItemModel::new_1a(&main_widget);
         let filter = QSortFilterProxyModel::new_1a(&main_widget);
         filter.set_source_model(&model);
+
+        // The proxy only checks the flag the filter index leaves in each mod. Categories are shown if any of their mods is.
+        filter.set_filter_role(FILTER_ROLE);
+        filter.set_recursive_filtering_enabled(true);
         model.set_parent(&tree_view);
         tree_view.set_model(&filter);
 
         let filter_timer = QTimer::new_1a(&main_widget);
         filter_timer.set_single_shot(true);
+        filter_timer.set_interval(FILTER_DELAY);
 
         layout.add_widget_5a(&main_widget, 0, 0, 2, 1);
 
@@ -93,7 +136,14 @@ impl ModListUI {
             filter,
             filter_line_edit,
             filter_case_sensitive_button,
+            filter_regex_button,
+            filter_categories_button,
+            filter_paths_button,
+            filter_fuzzy_button,
             filter_timer,
+            category_items: RwLock::new(HashMap::new()),
+            mod_items: RwLock::new(HashMap::new()),
+            filter_index: RwLock::new(FilterIndex::default()),
         });
 
         let slots = ModListUISlots::new(&list);
@@ -105,71 +155,289 @@ impl ModListUI {
     pub unsafe fn set_connections(&self, slots: &ModListUISlots) {
         self.filter_line_edit().text_changed().connect(slots.filter_line_edit());
         self.filter_case_sensitive_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_regex_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_categories_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_paths_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_fuzzy_button().toggled().connect(slots.filter_case_sensitive_button());
         self.filter_timer().timeout().connect(slots.filter_trigger());
     }
 
+    /// This function rebuilds the entire list from the provided game config.
+    ///
+    /// Each category is built detached from the model and then inserted in one go,
+    /// so the model and the view only get notified once per category, not once per mod.
     pub unsafe fn load(&self, game_config: &GameConfig) -> Result<()> {
-        for modd in game_config.mods().values() {
+        self.clear();
 
+        // Group the installed mods by category first, so we don't have to search for the parent of each mod.
+        let mut categories: HashMap<String, Vec<&Mod>> = HashMap::new();
+        for modd in game_config.mods().values() {
             if !modd.paths().is_empty() {
-                let category = QString::from_std_str(modd.category().clone().unwrap_or("Unassigned".to_owned()));
-                let mut parent = None;
-
-                // Find the parent category.
-                for index in 0..self.model().row_count_0a() {
-                    let item = self.model().item_1a(index);
-                    if !item.is_null() && item.text().compare_q_string(&category) == 0 {
-                        parent = Some(item);
-                        break;
-                    }
-                }
+                categories.entry(Self::category_name(modd)).or_default().push(modd);
+            }
+        }
+
+        let mut category_items = self.category_items.write().unwrap();
+        let mut mod_items = self.mod_items.write().unwrap();
+        let mut filter_index = self.filter_index.write().unwrap();
+        for (category, mods) in categories {
+            let parent = QStandardItem::from_q_string(&QString::from_std_str(&category)).into_ptr();
+            for modd in mods {
+                let item = Self::new_mod_item(modd).into_ptr();
+                parent.append_row_q_standard_item(item);
+                mod_items.insert(modd.handle(), item);
+                filter_index.insert(modd);
+            }
+
+            self.model().append_row_q_standard_item(parent.as_mut_raw_ptr());
+            category_items.insert(category, parent);
+        }
+
+        drop(category_items);
+        drop(mod_items);
+        drop(filter_index);
+
+        // Every category is new here, so they all start expanded.
+        self.tree_view().expand_all();
+        self.sort();
+        self.filter_list();
+        Ok(())
+    }
+
+    /// This function clears the list. Always use this instead of clearing the model directly, so the indexes are kept in sync.
+    pub unsafe fn clear(&self) {
+        self.category_items.write().unwrap().clear();
+        self.mod_items.write().unwrap().clear();
+        self.filter_index.write().unwrap().clear();
+        self.model().clear();
+    }
 
-                // If no parent is found, create the category parent.
-                if parent.is_none() {
-                    let item = QStandardItem::from_q_string(&category);
+    /// This function adds a mod to the list, under its category. Mods that are not installed are ignored.
+    ///
+    /// Remember to call [ModListUI::sort] once you're done adding mods.
+    pub unsafe fn append_mod(&self, modd: &Mod) {
+        if !modd.paths().is_empty() {
+            let category = Self::category_name(modd);
+            let mut category_items = self.category_items.write().unwrap();
+
+            // If no parent is found, create the category parent.
+            let (parent, is_new) = match category_items.get(&category) {
+                Some(parent) => (*parent, false),
+                None => {
+                    let item = QStandardItem::from_q_string(&QString::from_std_str(&category));
                     self.model().append_row_q_standard_item(item.into_ptr().as_mut_raw_ptr());
 
-                    parent = Some(self.model().item_1a(self.model().row_count_0a() - 1))
+                    let parent = self.model().item_1a(self.model().row_count_0a() - 1);
+                    category_items.insert(category, parent);
+                    (parent, true)
                 }
+            };
+
+            let item = Self::new_mod_item(modd).into_ptr();
+            parent.append_row_q_standard_item(item);
 
-                if let Some(ref parent) = parent {
-                    let row = QListOfQStandardItem::new();
-                    let pack_name = modd.paths()[0].file_name().unwrap().to_string_lossy().as_ref().to_owned();
-                    let item = QStandardItem::from_q_string(&QString::from_std_str(&pack_name));
-                    //let pack = Pack::read_and_merge(&[modd.pack().to_path_buf()], true, false)?;
-                    item.set_checkable(true);
-                    if *modd.enabled() {
-                        item.set_check_state(CheckState::Checked);
-                    }
+            // New categories start expanded. Existing ones keep whatever the user left them as.
+            if is_new {
+                self.tree_view().expand(&self.filter().map_from_source(&parent.index()));
+            }
+            self.mod_items.write().unwrap().insert(modd.handle(), item);
+            self.filter_index.write().unwrap().insert(modd);
+        }
+    }
+
+    /// This function removes a mod from the list, and its category if it was the last mod in it.
+    pub unsafe fn remove_mod(&self, modd: &Mod) {
+        self.filter_index.write().unwrap().remove(modd.handle());
+        if let Some(item) = self.mod_items.write().unwrap().remove(&modd.handle()) {
+            let parent = item.parent();
+            parent.remove_row(item.row());
+
+            if parent.row_count() == 0 {
+                self.category_items.write().unwrap().remove(&parent.text().to_std_string());
+                self.model().remove_row_1a(parent.row());
+            }
+        }
+    }
 
-                    row.append_q_standard_item(&item.into_ptr().as_mut_raw_ptr());
-                    parent.append_row_q_list_of_q_standard_item(row.into_ptr().as_ref().unwrap());
+    /// This function updates the item of a mod after its name or category changed, moving it to its new category if needed.
+    ///
+    /// The item is replaced instead of edited, as edits trigger the `item_changed` signal, and its slots need the game config.
+    /// Remember to call [ModListUI::sort] once you're done updating mods.
+    pub unsafe fn update_mod(&self, modd: &Mod) {
+        if self.mod_items.read().unwrap().contains_key(&modd.handle()) {
+            self.remove_mod(modd);
+            self.append_mod(modd);
+        }
+    }
 
+    /// This function returns the handles of the mods in the rows currently shown by the view, top to bottom.
+    pub unsafe fn visible_mods(&self) -> Vec<ModHandle> {
+        let bottom = self.tree_view().viewport().height();
+        let mut mods = vec![];
+        let mut index = self.tree_view().index_at(&QPoint::new_2a(0, 0));
+        while index.is_valid() && self.tree_view().visual_rect(&index).top() < bottom {
+            let item = self.model().item_from_index(&self.filter().map_to_source(&index));
+            if !item.is_null() {
+                let handle = item.data_1a(MOD_HANDLE_ROLE);
+                if handle.is_valid() {
+                    mods.push(ModHandle::from(handle.to_u_int_0a()));
                 }
             }
+
+            index = self.tree_view().index_below(&index);
         }
 
-        self.tree_view().expand_all();
+        mods
+    }
+
+    /// This function returns the size thumbnails should have to fit in the rows of the view.
+    pub unsafe fn thumbnail_size(&self) -> u32 {
+        self.tree_view().style().pixel_metric_1a(PixelMetric::PMSmallIconSize).max(1) as u32
+    }
+
+    /// This function turns a decoded thumbnail into an icon for the list.
+    pub unsafe fn thumbnail_icon(thumbnail: &Thumbnail) -> CppBox<QIcon> {
+
+        // The image only borrows the data, but the pixmap makes its own copy, so this is safe as long as the image doesn't outlive it.
+        let image = QImage::from_uchar2_int_format(thumbnail.rgba().as_ptr(), *thumbnail.width() as i32, *thumbnail.height() as i32, Format::FormatRGBA8888);
+        QIcon::from_q_pixmap(&QPixmap::from_image_1a(&image))
+    }
+
+    /// This function sets or removes the thumbnails of the provided mods, as a single batch.
+    ///
+    /// Like [ModListUI::apply_profile_diff], signals are blocked while doing it, so it just repaints the view at the end.
+    pub unsafe fn set_thumbnails(&self, thumbnails: &[(ModHandle, Option<&QIcon>)]) {
+        if thumbnails.is_empty() {
+            return;
+        }
+
+        let empty = QIcon::new();
+        let blocked = self.model().block_signals(true);
+        let mod_items = self.mod_items.read().unwrap();
+        for (handle, icon) in thumbnails {
+            if let Some(item) = mod_items.get(handle) {
+                item.set_icon(icon.unwrap_or(&empty));
+            }
+        }
+        self.model().block_signals(blocked);
+
+        self.tree_view().viewport().update();
+    }
+
+    /// This function checks and unchecks the mods a profile changes, as a single batch. Items of the other mods are not touched.
+    ///
+    /// Signals of the model are blocked while doing it, so nothing reacts to each individual change.
+    /// That means it's up to the caller to update whatever depends on the check state of the mods.
+    pub unsafe fn apply_profile_diff(&self, diff: &ProfileDiff) {
+        let blocked = self.model().block_signals(true);
+        let mod_items = self.mod_items.read().unwrap();
+        for (handles, state) in [(diff.enable(), CheckState::Checked), (diff.disable(), CheckState::Unchecked)] {
+            for handle in handles {
+                if let Some(item) = mod_items.get(handle) {
+                    item.set_check_state(state);
+                }
+            }
+        }
+        self.model().block_signals(blocked);
+
+        // The proxy and the view missed all the changes, so force them to pick them up.
+        self.filter().invalidate();
+    }
+
+    unsafe fn new_mod_item(modd: &Mod) -> CppBox<QStandardItem> {
+        let pack_name = modd.paths()[0].file_name().unwrap().to_string_lossy().as_ref().to_owned();
+
+        // Workshop mods show their Workshop title. The rest have their pack name as name.
+        let item = QStandardItem::from_q_string(&QString::from_std_str(modd.name()));
+        item.set_tool_tip(&QString::from_std_str(&pack_name));
+        item.set_data_2a(&QVariant::from_uint(modd.handle().into()), MOD_HANDLE_ROLE);
+        item.set_checkable(true);
+        if *modd.enabled() {
+            item.set_check_state(CheckState::Checked);
+        }
+
+        // New mods are visible until the next filter pass.
+        item.set_data_2a(&QVariant::from_q_string(&QString::from_std_str(FILTER_VISIBLE)), FILTER_ROLE);
+        item
+    }
+
+    fn category_name(modd: &Mod) -> String {
+        modd.category().clone().unwrap_or_else(|| "Unassigned".to_owned())
+    }
+
+    /// This function sorts the list by name. Categories keep whatever the user left them as.
+    pub unsafe fn sort(&self) {
         self.tree_view().sort_by_column_2a(0, SortOrder::AscendingOrder);
-        Ok(())
     }
 
+    /// This function filters the list with the current search, through the filter index.
+    ///
+    /// The index decides which mods pass and leaves a flag in each of them, so the proxy doesn't have to search anything.
+    /// Fuzzy searches also sort the list by score.
     pub unsafe fn filter_list(&self) {
+        let search = self.filter_line_edit().text().to_std_string();
+        let mut options = FilterOptions::default();
+        options.set_case_sensitive(self.filter_case_sensitive_button().is_checked());
+        options.set_regex(self.filter_regex_button().is_checked());
+        options.set_categories(self.filter_categories_button().is_checked());
+        options.set_paths(self.filter_paths_button().is_checked());
+        options.set_fuzzy(self.filter_fuzzy_button().is_checked());
+
+        let mut filter_index = self.filter_index.write().unwrap();
+        if filter_index.search(&search, &options) {
+            let visible = QVariant::from_q_string(&QString::from_std_str(FILTER_VISIBLE));
+            let hidden = QVariant::from_q_string(&QString::new());
+            let mod_items = self.mod_items.read().unwrap();
+
+            let blocked = self.model().block_signals(true);
+            for item in mod_items.values() {
+                item.set_data_2a(&hidden, FILTER_ROLE);
+            }
+
+            // Categories rank as their best mod.
+            let mut category_scores: HashMap<String, i32> = HashMap::new();
+            for (handle, score) in filter_index.results() {
+                if let Some(item) = mod_items.get(&handle) {
+                    item.set_data_2a(&visible, FILTER_ROLE);
+                    item.set_data_2a(&QVariant::from_int(score), FILTER_SCORE_ROLE);
+
+                    let category = category_scores.entry(item.parent().text().to_std_string()).or_insert(score);
+                    *category = (*category).max(score);
+                }
+            }
+
+            for (category, score) in &category_scores {
+                if let Some(item) = self.category_items.read().unwrap().get(category) {
+                    item.set_data_2a(&QVariant::from_int(*score), FILTER_SCORE_ROLE);
+                }
+            }
+            self.model().block_signals(blocked);
 
-        // Set the pattern to search.
-        let pattern = QRegExp::new_1a(&self.filter_line_edit.text());
+            self.filter().set_filter_fixed_string(&QString::from_std_str(FILTER_VISIBLE));
+            self.filter().invalidate();
 
-        // Check if the filter should be "Case Sensitive".
-        let case_sensitive = self.filter_case_sensitive_button.is_checked();
-        if case_sensitive { pattern.set_case_sensitivity(CaseSensitivity::CaseSensitive); }
-        else { pattern.set_case_sensitivity(CaseSensitivity::CaseInsensitive); }
+            // Categories hidden by an earlier search come back collapsed, and the matches have to be seen.
+            self.tree_view().expand_all();
 
-        // Filter whatever it's in that column by the text we got.
-        self.filter().set_filter_reg_exp_q_reg_exp(&pattern);
+            // Fuzzy results are shown best first.
+            if *options.fuzzy() && !*options.regex() {
+                self.filter().set_sort_role(FILTER_SCORE_ROLE);
+                self.tree_view().sort_by_column_2a(0, SortOrder::DescendingOrder);
+            } else {
+                self.filter().set_sort_role(ItemDataRole::DisplayRole.to_int());
+                self.sort();
+            }
+        }
+
+        // No search, so just let everything through.
+        else {
+            self.filter().set_filter_fixed_string(&QString::new());
+            self.filter().set_sort_role(ItemDataRole::DisplayRole.to_int());
+            self.sort();
+        }
     }
 
     pub unsafe fn delayed_updates(&self) {
-        self.filter_timer.set_interval(500);
         self.filter_timer.start_0a();
     }
 }
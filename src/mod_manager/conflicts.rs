@@ -0,0 +1,451 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Analysis of the files overwritten between enabled Packs.
+//!
+//! All enabled Packs share one index of file path -> Packs containing it. Paths are interned into u32 ids the first time
+//! they're seen, so each Pack is just a sorted list of ids, and the owners of each path are a short list of Pack handles.
+//! Toggling a Pack only re-indexes that Pack, and only the Packs sharing files with it get their conflicts recalculated.
+//!
+//! Owners are kept sorted by load order, so the first owner of a path is the Pack whose file the game uses: the game gives
+//! priority to the Packs that come first in the mod list. Changing the load order only re-sorts the paths with more than one
+//! owner, and only the Packs whose winner changed get reported again.
+//!
+//! The index lives in its own thread. The ui sends it commands and picks up the results whenever they're ready.
+
+use getset::*;
+
+use std::collections::{BTreeSet, HashMap, HashSet};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::Arc;
+use std::thread;
+
+use rpfm_lib::integrations::log::*;
+
+use crate::mod_manager::pack_view::PackView;
+
+/// Prefix of the paths of the tables inside a Pack.
+const TABLES_PREFIX: &str = "db/";
+
+/// Load order position of the Packs not in the load order. Sorts them after all the others.
+const UNORDERED: u32 = u32::MAX;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Conflicts of a single Pack with the rest of the enabled Packs.
+#[derive(Clone, Debug, Default, PartialEq, Eq, Getters)]
+#[getset(get = "pub")]
+pub struct PackConflicts {
+
+    // Amount of files of the Pack also present in other enabled Packs.
+    files: u32,
+
+    // Amount of those files that are tables.
+    tables: u32,
+
+    // Amount of those files, and tables, where another Pack wins, so the game never sees the ones in this Pack.
+    overwritten_files: u32,
+    overwritten_tables: u32,
+
+    // Names of the tables with overwritten files, sorted.
+    overwritten_table_names: Vec<String>,
+
+    // Ids of the Packs whose files this Pack overwrites, and of the ones overwriting files of this Pack, sorted.
+    overwrites: Vec<String>,
+    overwritten_by: Vec<String>,
+}
+
+/// Commands accepted by the analyzer thread.
+#[derive(Debug)]
+enum ConflictCommand {
+
+    /// Make the index contain exactly these Packs, re-indexing only the ones that changed. Packs come in load order.
+    Sync(Vec<(String, PathBuf)>),
+
+    /// Ids of the enabled Packs, in load order.
+    SetOrder(Vec<String>),
+
+    /// Index a Pack. If it was already indexed, it gets re-indexed.
+    Insert(String, PathBuf),
+    Remove(String),
+}
+
+/// Handle to the analyzer thread.
+#[derive(Debug)]
+pub struct ConflictAnalyzer {
+    sender: Sender<ConflictCommand>,
+    receiver: Receiver<HashMap<String, PackConflicts>>,
+
+    // Commands sent but not yet fully processed.
+    pending: Arc<AtomicUsize>,
+}
+
+/// Index of file paths across all enabled Packs.
+#[derive(Debug, Default)]
+pub struct ConflictIndex {
+
+    // Interned paths, lowercased with forward slashes, as the game treats them, and the other way around.
+    path_ids: HashMap<Arc<str>, u32>,
+    paths: Vec<Arc<str>>,
+
+    // Which of the interned paths are tables.
+    path_is_table: Vec<bool>,
+
+    // Reused buffer to normalize paths before looking them up, so known paths are found without allocating.
+    path_buffer: String,
+
+    // Packs containing each path, by path id, sorted by load order.
+    owners: Vec<Vec<u32>>,
+
+    // Load order position of each Pack id, and of each Pack, by handle.
+    order: HashMap<String, u32>,
+    positions: Vec<u32>,
+
+    // Handles of the Packs, by id.
+    pack_handles: HashMap<String, u32>,
+
+    // Data of each Pack, by handle. Packs removed from the index keep their handle, but lose their data.
+    packs: Vec<Option<IndexedPack>>,
+}
+
+#[derive(Debug)]
+struct IndexedPack {
+    id: String,
+    path: PathBuf,
+
+    // Sorted and deduplicated path ids.
+    files: Vec<u32>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl ConflictAnalyzer {
+
+    /// This function starts the analyzer thread.
+    pub fn spawn() -> Self {
+        let (sender, commands) = channel();
+        let (results, receiver) = channel();
+        let pending = Arc::new(AtomicUsize::new(0));
+
+        let thread_pending = pending.clone();
+        thread::spawn(move || {
+            let mut index = ConflictIndex::default();
+            while let Ok(command) = commands.recv() {
+
+                // Apply everything already queued before reporting, so bursts of toggles only get reported once.
+                let mut processed = 1;
+                let mut affected = index.apply(command);
+                while let Ok(command) = commands.try_recv() {
+                    affected.extend(index.apply(command));
+                    processed += 1;
+                }
+
+                if results.send(index.conflicts(&affected)).is_err() {
+                    break;
+                }
+
+                thread_pending.fetch_sub(processed, Ordering::SeqCst);
+            }
+        });
+
+        Self {
+            sender,
+            receiver,
+            pending,
+        }
+    }
+
+    /// This function replaces the indexed Packs with the provided ones, which must come in load order.
+    pub fn sync(&self, packs: Vec<(String, PathBuf)>) {
+        self.send(ConflictCommand::Sync(packs));
+    }
+
+    /// This function sets the load order of the enabled Packs, which decides which Pack wins each file.
+    ///
+    /// Packs inserted before knowing their position are sorted last until the next call.
+    pub fn set_order(&self, ids: Vec<String>) {
+        self.send(ConflictCommand::SetOrder(ids));
+    }
+
+    pub fn insert(&self, id: &str, path: PathBuf) {
+        self.send(ConflictCommand::Insert(id.to_owned(), path));
+    }
+
+    pub fn remove(&self, id: &str) {
+        self.send(ConflictCommand::Remove(id.to_owned()));
+    }
+
+    /// This function returns if there are commands still being processed.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns all the results sent by the analyzer since the last call, merged. Never blocks.
+    ///
+    /// Packs that are no longer indexed are returned with no conflicts.
+    pub fn updates(&self) -> HashMap<String, PackConflicts> {
+        let mut updates = HashMap::new();
+        while let Ok(results) = self.receiver.try_recv() {
+            updates.extend(results);
+        }
+
+        updates
+    }
+
+    fn send(&self, command: ConflictCommand) {
+        self.pending.fetch_add(1, Ordering::SeqCst);
+        if self.sender.send(command).is_err() {
+            self.pending.fetch_sub(1, Ordering::SeqCst);
+            error!("Conflict analyzer thread is gone. Conflicts will not be updated.");
+        }
+    }
+}
+
+impl ConflictIndex {
+
+    /// This function applies a command to the index, returning the ids of the Packs whose conflicts may have changed.
+    fn apply(&mut self, command: ConflictCommand) -> HashSet<String> {
+        match command {
+
+            // Nothing enabled: drop the whole index, interned paths included, so it doesn't keep growing between games.
+            ConflictCommand::Sync(packs) if packs.is_empty() => {
+                let affected = self.packs.iter().flatten().map(|pack| pack.id.to_owned()).collect();
+                *self = Self::default();
+                affected
+            }
+            ConflictCommand::Sync(packs) => {
+                let mut affected = self.set_order(packs.iter().map(|(id, _)| id.to_owned()).collect());
+                let wanted = packs.iter().map(|(id, path)| (id.as_str(), path)).collect::<HashMap<_, _>>();
+                let stale = self.packs.iter()
+                    .flatten()
+                    .filter(|pack| wanted.get(pack.id.as_str()) != Some(&&pack.path))
+                    .map(|pack| pack.id.to_owned())
+                    .collect::<Vec<_>>();
+
+                for id in stale {
+                    affected.extend(self.remove(&id));
+                }
+
+                for (id, path) in packs {
+                    if !self.contains(&id) {
+                        affected.extend(self.insert(&id, path));
+                    }
+                }
+
+                affected
+            }
+            ConflictCommand::Insert(id, path) => {
+                let mut affected = self.remove(&id);
+                affected.extend(self.insert(&id, path));
+                affected
+            }
+            ConflictCommand::Remove(id) => self.remove(&id),
+            ConflictCommand::SetOrder(ids) => self.set_order(ids),
+        }
+    }
+
+    /// This function sets the load order of the Packs, returning the Packs whose files got a different winner.
+    fn set_order(&mut self, ids: Vec<String>) -> HashSet<String> {
+        self.order = ids.into_iter().enumerate().map(|(position, id)| (id, position as u32)).collect();
+        for (handle, pack) in self.packs.iter().enumerate() {
+            if let Some(pack) = pack {
+                self.positions[handle] = self.order.get(&pack.id).copied().unwrap_or(UNORDERED);
+            }
+        }
+
+        let positions = &self.positions;
+        let mut affected = HashSet::new();
+        for owners in self.owners.iter_mut().filter(|owners| owners.len() > 1) {
+            let winner = owners[0];
+            owners.sort_unstable_by_key(|owner| (positions[*owner as usize], *owner));
+            if owners[0] != winner {
+                affected.extend(owners.iter().copied());
+            }
+        }
+
+        self.pack_ids(&affected)
+    }
+
+    fn contains(&self, id: &str) -> bool {
+        self.pack_handles.get(id).map(|handle| self.packs[*handle as usize].is_some()).unwrap_or(false)
+    }
+
+    /// This function indexes a Pack, returning the Packs affected by it. Packs that cannot be read are left out of the index.
+    fn insert(&mut self, id: &str, path: PathBuf) -> HashSet<String> {
+        let files = PackView::open(&path).and_then(|view| view.files()
+            .map(|entry| entry.map(|entry| self.intern(entry.path())))
+            .collect::<anyhow::Result<Vec<_>>>());
+
+        let mut files = match files {
+            Ok(files) => files,
+            Err(error) => {
+                warn!("Pack {} not included in the conflict analysis: {}", id, error);
+                return HashSet::new();
+            }
+        };
+        files.sort_unstable();
+        files.dedup();
+
+        let handle = match self.pack_handles.get(id) {
+            Some(handle) => *handle,
+            None => {
+                let handle = self.packs.len() as u32;
+                self.packs.push(None);
+                self.positions.push(UNORDERED);
+                self.pack_handles.insert(id.to_owned(), handle);
+                handle
+            }
+        };
+
+        self.positions[handle as usize] = self.order.get(id).copied().unwrap_or(UNORDERED);
+
+        let positions = &self.positions;
+        let key = (positions[handle as usize], handle);
+        let mut affected = HashSet::new();
+        for file in &files {
+            let owners = &mut self.owners[*file as usize];
+            affected.extend(owners.iter().copied());
+
+            let index = owners.partition_point(|owner| (positions[*owner as usize], *owner) < key);
+            owners.insert(index, handle);
+        }
+        affected.insert(handle);
+
+        self.packs[handle as usize] = Some(IndexedPack {
+            id: id.to_owned(),
+            path,
+            files,
+        });
+
+        self.pack_ids(&affected)
+    }
+
+    /// This function removes a Pack from the index, returning the Packs affected by it, the removed one included.
+    fn remove(&mut self, id: &str) -> HashSet<String> {
+        let handle = match self.pack_handles.get(id) {
+            Some(handle) => *handle,
+            None => return HashSet::new(),
+        };
+
+        let pack = match self.packs[handle as usize].take() {
+            Some(pack) => pack,
+            None => return HashSet::new(),
+        };
+
+        let mut affected = HashSet::new();
+        for file in &pack.files {
+            let owners = &mut self.owners[*file as usize];
+            owners.retain(|owner| *owner != handle);
+            affected.extend(owners.iter().copied());
+        }
+
+        let mut affected = self.pack_ids(&affected);
+        affected.insert(pack.id);
+        affected
+    }
+
+    /// This function returns the current conflicts of the provided Packs.
+    fn conflicts(&self, ids: &HashSet<String>) -> HashMap<String, PackConflicts> {
+        ids.iter()
+            .map(|id| {
+                let pack = self.pack_handles.get(id).and_then(|handle| Some((*handle, self.packs[*handle as usize].as_ref()?)));
+                let conflicts = match pack {
+                    Some((handle, pack)) => self.pack_conflicts(handle, pack),
+                    None => PackConflicts::default(),
+                };
+
+                (id.to_owned(), conflicts)
+            })
+            .collect()
+    }
+
+    fn pack_conflicts(&self, handle: u32, pack: &IndexedPack) -> PackConflicts {
+        let mut conflicts = PackConflicts::default();
+        let mut overwrites = BTreeSet::new();
+        let mut overwritten_by = BTreeSet::new();
+        let mut overwritten_table_names = BTreeSet::new();
+        for file in &pack.files {
+            let owners = &self.owners[*file as usize];
+            if owners.len() > 1 {
+                let is_table = self.path_is_table[*file as usize];
+                conflicts.files += 1;
+                if is_table {
+                    conflicts.tables += 1;
+                }
+
+                // Only the winner's file is loaded, so it's the one overwriting all the others.
+                if owners[0] == handle {
+                    overwrites.extend(owners[1..].iter().copied());
+                } else {
+                    overwritten_by.insert(owners[0]);
+                    conflicts.overwritten_files += 1;
+                    if is_table {
+                        conflicts.overwritten_tables += 1;
+                        if let Some(table_name) = self.paths[*file as usize][TABLES_PREFIX.len()..].split('/').next() {
+                            overwritten_table_names.insert(table_name);
+                        }
+                    }
+                }
+            }
+        }
+
+        conflicts.overwrites = self.sorted_pack_ids(&overwrites);
+        conflicts.overwritten_by = self.sorted_pack_ids(&overwritten_by);
+        conflicts.overwritten_table_names = overwritten_table_names.into_iter().map(|name| name.to_owned()).collect();
+        conflicts
+    }
+
+    /// This function returns the id of a path, interning it if it's the first time we see it.
+    fn intern(&mut self, path: &str) -> u32 {
+        self.path_buffer.clear();
+        for character in path.chars() {
+            match character {
+                '\\' => self.path_buffer.push('/'),
+                character => self.path_buffer.extend(character.to_lowercase()),
+            }
+        }
+
+        match self.path_ids.get(self.path_buffer.as_str()) {
+            Some(id) => *id,
+            None => {
+                let id = self.owners.len() as u32;
+                let path: Arc<str> = Arc::from(self.path_buffer.as_str());
+                self.path_is_table.push(path.starts_with(TABLES_PREFIX));
+                self.owners.push(vec![]);
+                self.paths.push(path.clone());
+                self.path_ids.insert(path, id);
+                id
+            }
+        }
+    }
+
+    fn pack_ids(&self, handles: &HashSet<u32>) -> HashSet<String> {
+        handles.iter()
+            .filter_map(|handle| self.packs[*handle as usize].as_ref())
+            .map(|pack| pack.id.to_owned())
+            .collect()
+    }
+
+    fn sorted_pack_ids(&self, handles: &BTreeSet<u32>) -> Vec<String> {
+        let mut ids = handles.iter()
+            .filter_map(|handle| self.packs[*handle as usize].as_ref())
+            .map(|pack| pack.id.to_owned())
+            .collect::<Vec<_>>();
+
+        ids.sort_unstable();
+        ids
+    }
+}
@@ -0,0 +1,176 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Dependencies between the mods of a game.
+//!
+//! Packs declare the names of the Packs they need in their pack index. Those are read once during discovery and kept in the
+//! Pack cache, so the graph here is built from memory, and kept both ways: what each mod needs, and who needs each Pack. That
+//! way, checking what enabling or disabling a mod breaks only looks at that mod's edges, no matter how many mods there are.
+
+use std::collections::{HashMap, HashSet};
+use std::path::Path;
+
+use crate::integrations::{GameConfig, LoadOrderRule};
+use crate::mod_manager::pack_cache::PackCache;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+#[derive(Debug, Default)]
+pub struct DependencyGraph {
+
+    // Packs each mod depends on, by mod id.
+    dependencies: HashMap<String, Vec<String>>,
+
+    // Mods that depend on each Pack, by Pack name.
+    dependents: HashMap<String, Vec<String>>,
+
+    // Names of the Packs of the game that are not mods, so they're always loaded.
+    game_packs: HashSet<String>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl DependencyGraph {
+
+    /// This function builds the graph of all the installed mods of a game config, from the dependencies in the Pack cache.
+    pub fn build(game_config: &GameConfig, pack_cache: &PackCache) -> Self {
+        let mut graph = Self {
+            game_packs: pack_cache.packs()
+                .iter()
+                .filter(|(_, cached)| !cached.header().is_mod())
+                .filter_map(|(path, _)| Some(path.file_name()?.to_string_lossy().into_owned()))
+                .collect(),
+            ..Default::default()
+        };
+
+        for modd in game_config.mods().values() {
+            if let Some(path) = modd.paths().first() {
+                let dependencies = pack_cache.last_known_dependencies(path);
+                if !dependencies.is_empty() {
+                    for dependency in dependencies {
+                        graph.dependents.entry(dependency.to_owned()).or_default().push(modd.id().to_owned());
+                    }
+
+                    graph.dependencies.insert(modd.id().to_owned(), dependencies.to_vec());
+                }
+            }
+        }
+
+        graph
+    }
+
+    /// This function updates the graph after a Pack got added, changed or removed from disk, touching only the edges of its mod.
+    ///
+    /// Call it after both the Pack cache and the game config know about the change.
+    pub fn update_pack(&mut self, game_config: &GameConfig, pack_cache: &PackCache, path: &Path) {
+        let pack_name = match path.file_name() {
+            Some(pack_name) => pack_name.to_string_lossy().into_owned(),
+            None => return,
+        };
+
+        match pack_cache.packs().get(path) {
+            Some(cached) if !cached.header().is_mod() => { self.game_packs.insert(pack_name.clone()); },
+            _ => { self.game_packs.remove(&pack_name); },
+        }
+
+        // Mods may have the same Pack in more than one folder. Like in the full build, the first one is the one that counts.
+        let dependencies = game_config.mods()
+            .get(&pack_name)
+            .and_then(|modd| modd.paths().first())
+            .map(|path| pack_cache.last_known_dependencies(path).to_vec())
+            .unwrap_or_default();
+
+        self.set_dependencies(&pack_name, dependencies);
+    }
+
+    /// This function replaces the dependencies of the provided mod, keeping the reverse edges in sync.
+    fn set_dependencies(&mut self, mod_id: &str, dependencies: Vec<String>) {
+        if self.dependencies.get(mod_id).map_or(dependencies.is_empty(), |old| *old == dependencies) {
+            return;
+        }
+
+        for dependency in self.dependencies.remove(mod_id).unwrap_or_default() {
+            if let Some(dependents) = self.dependents.get_mut(&dependency) {
+                dependents.retain(|dependent| dependent != mod_id);
+                if dependents.is_empty() {
+                    self.dependents.remove(&dependency);
+                }
+            }
+        }
+
+        if !dependencies.is_empty() {
+            for dependency in &dependencies {
+                self.dependents.entry(dependency.to_owned()).or_default().push(mod_id.to_owned());
+            }
+
+            self.dependencies.insert(mod_id.to_owned(), dependencies);
+        }
+    }
+
+    /// This function returns the Packs the provided mod depends on, found or not.
+    pub fn dependencies(&self, mod_id: &str) -> &[String] {
+        self.dependencies.get(mod_id).map_or(&[], |dependencies| dependencies.as_slice())
+    }
+
+    /// This function returns the Packs the provided mod needs that are not going to be loaded, because they're not installed or not enabled.
+    pub fn missing_dependencies<'a>(&'a self, game_config: &GameConfig, mod_id: &str) -> Vec<&'a str> {
+        self.dependencies.get(mod_id)
+            .map(|dependencies| dependencies.iter()
+                .filter(|dependency| !self.is_loaded(game_config, dependency))
+                .map(|dependency| dependency.as_str())
+                .collect())
+            .unwrap_or_default()
+    }
+
+    /// This function returns the enabled mods that need the provided Pack.
+    pub fn enabled_dependents<'a>(&'a self, game_config: &GameConfig, pack_name: &str) -> Vec<&'a str> {
+        self.dependents.get(pack_name)
+            .map(|dependents| dependents.iter()
+                .filter(|dependent| is_enabled(game_config, dependent))
+                .map(|dependent| dependent.as_str())
+                .collect())
+            .unwrap_or_default()
+    }
+
+    /// This function returns the enabled mods with missing dependencies, with the Packs they're missing, sorted by mod id.
+    pub fn all_missing_dependencies<'a>(&'a self, game_config: &GameConfig) -> Vec<(&'a str, Vec<&'a str>)> {
+        let mut missing = self.dependencies.keys()
+            .filter(|mod_id| is_enabled(game_config, mod_id))
+            .map(|mod_id| (mod_id.as_str(), self.missing_dependencies(game_config, mod_id)))
+            .filter(|(_, dependencies)| !dependencies.is_empty())
+            .collect::<Vec<_>>();
+
+        missing.sort_unstable_by(|(a, _), (b, _)| a.cmp(b));
+        missing
+    }
+
+    /// This function returns the dependencies as load order rules: every mod goes before the Packs it needs, so it has priority over them.
+    ///
+    /// Meant to check new user rules against them. The load order engine reads dependencies from the Pack cache on its own.
+    pub fn load_order_rules(&self) -> Vec<LoadOrderRule> {
+        self.dependencies.iter()
+            .flat_map(|(mod_id, dependencies)| dependencies.iter().map(move |dependency| LoadOrderRule::new(mod_id, dependency)))
+            .collect()
+    }
+
+    /// This function returns if the game is going to load the provided Pack: if it's one of the game's own Packs, or an enabled mod.
+    fn is_loaded(&self, game_config: &GameConfig, pack_name: &str) -> bool {
+        self.game_packs.contains(pack_name) || is_enabled(game_config, pack_name)
+    }
+}
+
+/// This function returns if the provided Pack is an installed and enabled mod.
+fn is_enabled(game_config: &GameConfig, pack_name: &str) -> bool {
+    game_config.mods().get(pack_name).map_or(false, |modd| *modd.enabled() && !modd.paths().is_empty())
+}
@@ -0,0 +1,146 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Discovery of the mods available for a game.
+//!
+//! Probing packs is pure I/O wait, more so with workshop folders on spinning disks, so probes fan out
+//! over a dedicated pool bigger than the amount of cores, and then get merged back in a deterministic order.
+
+use anyhow::Result;
+use lazy_static::lazy_static;
+use rayon::{ThreadPool, ThreadPoolBuilder};
+
+use std::collections::HashSet;
+use std::path::{Path, PathBuf};
+use std::thread::available_parallelism;
+
+use rpfm_lib::games::GameInfo;
+
+use crate::integrations::{GameConfig, Mod};
+use crate::integrations::steam::steam_id_of;
+use crate::mod_manager::pack_cache::PackCache;
+use crate::mod_manager::pack_header::PackHeader;
+
+lazy_static! {
+
+    /// Pool used to probe packs. Oversized on purpose so we keep the disk queue full while threads wait on I/O.
+    static ref DISCOVERY_POOL: ThreadPool = ThreadPoolBuilder::new()
+        .num_threads(available_parallelism().map(|cores| cores.get() * 2).unwrap_or(8).max(4))
+        .thread_name(|index| format!("discovery_{index}"))
+        .build()
+        .expect("Failed to build the discovery thread pool.");
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+/// This function finds all the mods in the data and content folders of the game, and updates the game config with them.
+///
+/// Paths of mods that are no longer found are cleared, as the rest of the program relies on them to know if a mod is installed.
+/// Returns if any mod was found, lost, or moved to another path. The Pack cache is left for the caller to save.
+pub fn discover_mods(game_config: &mut GameConfig, pack_cache: &mut PackCache, game: &GameInfo, game_path: &Path) -> Result<bool> {
+    let mut data_paths = game.data_packs_paths(game_path).unwrap_or_default();
+    let mut content_paths = game.content_packs_paths(game_path).unwrap_or_default();
+
+    // Directory listing order is not stable across filesystems, so sort them to keep the merge deterministic.
+    data_paths.sort();
+    content_paths.sort();
+
+    let data_headers = probe_packs(pack_cache, &data_paths)?;
+    let content_headers = probe_packs(pack_cache, &content_paths)?;
+
+    // Clear the previous paths, keeping them to know what changed.
+    let previous = game_config.mods_mut().values_mut().map(|modd| std::mem::take(modd.paths_mut())).collect::<Vec<_>>();
+
+    // Data goes first, so /data paths always take priority.
+    for (path, header) in data_paths.iter().zip(data_headers.iter()).chain(content_paths.iter().zip(content_headers.iter())) {
+        if header.is_mod() {
+            add_mod_path(game_config, path);
+        }
+    }
+
+    // Forget about packs that no longer exist.
+    let found = data_paths.iter()
+        .chain(content_paths.iter())
+        .map(|path| path.as_path())
+        .collect::<HashSet<_>>();
+    pack_cache.retain(&found);
+
+    // New mods are added at the end, so they show up as a different length.
+    let mods = game_config.mods();
+    Ok(mods.len() != previous.len() || mods.values().zip(&previous).any(|(modd, paths)| modd.paths() != paths))
+}
+
+/// This function returns the headers of the provided packs, in the same order, probing in parallel the ones not in the cache.
+pub fn probe_packs(pack_cache: &mut PackCache, paths: &[PathBuf]) -> Result<Vec<PackHeader>> {
+    DISCOVERY_POOL.install(|| pack_cache.pack_headers(paths))
+}
+
+/// This function clears the paths of all the mods of a game config, so discovery can re-add the ones still valid.
+pub fn clear_mod_paths(game_config: &mut GameConfig) {
+    game_config.mods_mut().values_mut().for_each(|modd| modd.paths_mut().clear());
+}
+
+/// This function adds the mods among a batch of probed packs to the game config, in the order they come.
+///
+/// Returns the ids of the mods that just became available.
+pub fn add_probed_packs(game_config: &mut GameConfig, packs: &[(PathBuf, PackHeader)]) -> Vec<String> {
+    packs.iter()
+        .filter(|(_, header)| header.is_mod())
+        .filter_map(|(path, _)| add_mod_path(game_config, path))
+        .collect()
+}
+
+/// This function adds a path to the mod it belongs to, creating the mod if it's not yet in the game config.
+///
+/// Returns the id of the mod if this was its first path, meaning the mod just became available.
+pub fn add_mod_path(game_config: &mut GameConfig, path: &Path) -> Option<String> {
+    let pack_name = path.file_name().unwrap().to_string_lossy().as_ref().to_owned();
+    match game_config.mods_mut().get_mut(&pack_name) {
+        Some(modd) => {
+            if !modd.paths().iter().any(|mod_path| mod_path == path) {
+                modd.paths_mut().push(path.to_path_buf());
+                if modd.steam_id().is_none() {
+                    modd.set_steam_id(steam_id_of(path));
+                }
+
+                if modd.paths().len() == 1 {
+                    return Some(pack_name);
+                }
+            }
+
+            None
+        }
+        None => {
+            let mut modd = Mod::new(&pack_name);
+            modd.set_paths(vec![path.to_path_buf()]);
+            modd.set_steam_id(steam_id_of(path));
+            game_config.add_mod(modd);
+            Some(pack_name)
+        }
+    }
+}
+
+/// This function removes a path from the mod it belongs to.
+///
+/// Returns the id of the mod if this was its last path, meaning the mod is no longer available.
+pub fn remove_mod_path(game_config: &mut GameConfig, path: &Path) -> Option<String> {
+    let pack_name = path.file_name()?.to_string_lossy().as_ref().to_owned();
+    let modd = game_config.mods_mut().get_mut(&pack_name)?;
+    let index = modd.paths().iter().position(|mod_path| mod_path == path)?;
+    modd.paths_mut().remove(index);
+
+    if modd.paths().is_empty() {
+        Some(pack_name)
+    } else {
+        None
+    }
+}
@@ -0,0 +1,234 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Filter engine for the mod and pack lists.
+//!
+//! Instead of running a regex over every row of the model on each keystroke, the lists keep an index of the searchable
+//! fields of each mod, already lowercased, and ask it which mods match. Plain text search is the default, and it's a
+//! substring search over the index. Regex search is opt-in, and so is fuzzy search, which ranks the mods by how well their names,
+//! pack names and Workshop titles match, and only keeps the best ones.
+
+use getset::*;
+use regex::{Regex, RegexBuilder};
+
+use std::collections::HashMap;
+
+use crate::integrations::Mod;
+use crate::integrations::mod_ids::ModHandle;
+use crate::mod_manager::fuzzy::FuzzyMatcher;
+
+/// Data role of the list items where we store if they pass the filter. The proxy models only check this role.
+pub const FILTER_ROLE: i32 = 40;
+
+/// Value of [FILTER_ROLE] for items that pass the filter.
+pub const FILTER_VISIBLE: &str = "1";
+
+/// Data role of the list items where we store their fuzzy search score, to sort them by it.
+pub const FILTER_SCORE_ROLE: i32 = 41;
+
+/// Max amount of results of a fuzzy search.
+const FUZZY_RESULTS: usize = 100;
+
+/// Time, in milliseconds, the lists wait after the last keystroke before filtering.
+pub const FILTER_DELAY: i32 = 50;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// What to search, and how.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Getters, Setters)]
+#[getset(get = "pub", set = "pub")]
+pub struct FilterOptions {
+    case_sensitive: bool,
+    regex: bool,
+
+    // Ranked fuzzy search over names, pack names and Workshop titles. Ignored if regex is enabled.
+    fuzzy: bool,
+
+    // Search also over the categories of the mods.
+    categories: bool,
+
+    // Search also over the paths of the mods.
+    paths: bool,
+}
+
+/// Index of the searchable fields of a list of mods.
+#[derive(Debug)]
+pub struct FilterIndex {
+    entries: Vec<FilterEntry>,
+
+    // Position of each mod in the entries, by mod handle.
+    positions: HashMap<ModHandle, usize>,
+
+    // Buffers reused between searches.
+    matcher: FuzzyMatcher,
+    results: Vec<(usize, i32)>,
+}
+
+#[derive(Debug)]
+struct FilterEntry {
+    handle: ModHandle,
+    name: SearchField,
+    id: SearchField,
+    category: SearchField,
+    path: SearchField,
+}
+
+/// A field as written, and its lowercased version for case insensitive searches.
+#[derive(Debug)]
+struct SearchField {
+    text: String,
+    lowercase: String,
+}
+
+/// A search, ready to be matched against the index.
+enum Pattern {
+    Text(String),
+    Regex(Regex),
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl Default for FilterIndex {
+    fn default() -> Self {
+        Self {
+            entries: vec![],
+            positions: HashMap::new(),
+            matcher: FuzzyMatcher::new(FUZZY_RESULTS),
+            results: Vec::with_capacity(FUZZY_RESULTS),
+        }
+    }
+}
+
+impl FilterIndex {
+
+    /// This function adds a mod to the index, replacing it if it was already in it.
+    pub fn insert(&mut self, modd: &Mod) {
+        let entry = FilterEntry {
+            handle: modd.handle(),
+            name: SearchField::new(modd.name()),
+            id: SearchField::new(modd.id()),
+            category: SearchField::new(modd.category().as_deref().unwrap_or_default()),
+            path: SearchField::new(&modd.paths().first().map(|path| path.to_string_lossy()).unwrap_or_default()),
+        };
+
+        match self.positions.get(&modd.handle()) {
+            Some(position) => self.entries[*position] = entry,
+            None => {
+                self.positions.insert(modd.handle(), self.entries.len());
+                self.entries.push(entry);
+            }
+        }
+    }
+
+    pub fn remove(&mut self, handle: ModHandle) {
+        if let Some(position) = self.positions.remove(&handle) {
+            self.entries.swap_remove(position);
+            if let Some(moved) = self.entries.get(position) {
+                self.positions.insert(moved.handle, position);
+            }
+        }
+    }
+
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.positions.clear();
+        self.results.clear();
+    }
+
+    /// This function searches the index, leaving the matches in [FilterIndex::results]. Returns false if nothing should be filtered out.
+    ///
+    /// An invalid regex matches nothing, as that's usually a regex still being written.
+    pub fn search(&mut self, search: &str, options: &FilterOptions) -> bool {
+        self.results.clear();
+        if search.is_empty() {
+            return false;
+        }
+
+        if *options.fuzzy() && !*options.regex() {
+            self.matcher.set_query(search, *options.case_sensitive());
+            for (index, entry) in self.entries.iter().enumerate() {
+                if let Some(score) = entry.score(&self.matcher) {
+                    self.matcher.push(score, index);
+                }
+            }
+
+            self.matcher.drain_into(&mut self.results);
+            return true;
+        }
+
+        let pattern = if *options.regex() {
+            match RegexBuilder::new(search).case_insensitive(!options.case_sensitive()).build() {
+                Ok(regex) => Pattern::Regex(regex),
+                Err(_) => return true,
+            }
+        } else if *options.case_sensitive() {
+            Pattern::Text(search.to_owned())
+        } else {
+            Pattern::Text(search.to_lowercase())
+        };
+
+        let results = self.entries.iter()
+            .enumerate()
+            .filter(|(_, entry)| entry.matches(&pattern, options))
+            .map(|(index, _)| (index, 0));
+
+        self.results.extend(results);
+        true
+    }
+
+    /// This function returns the handles of the mods matching the last search, with their scores, best first.
+    ///
+    /// Scores are only meaningful for fuzzy searches. Other searches return all their matches with a score of 0.
+    pub fn results(&self) -> impl Iterator<Item = (ModHandle, i32)> + '_ {
+        self.results.iter().map(|(index, score)| (self.entries[*index].handle, *score))
+    }
+}
+
+impl FilterEntry {
+    fn matches(&self, pattern: &Pattern, options: &FilterOptions) -> bool {
+        self.name.matches(pattern, options) ||
+            self.id.matches(pattern, options) ||
+            (*options.categories() && self.category.matches(pattern, options)) ||
+            (*options.paths() && self.path.matches(pattern, options))
+    }
+
+    /// This function returns the best fuzzy score of the names of the mod, or `None` if none of them matches.
+    ///
+    /// The name of Workshop mods is their Workshop title.
+    fn score(&self, matcher: &FuzzyMatcher) -> Option<i32> {
+        [&self.name, &self.id]
+            .into_iter()
+            .filter_map(|field| matcher.score(if matcher.case_sensitive() { &field.text } else { &field.lowercase }))
+            .max()
+    }
+}
+
+impl SearchField {
+    fn new(text: &str) -> Self {
+        Self {
+            text: text.to_owned(),
+            lowercase: text.to_lowercase(),
+        }
+    }
+
+    fn matches(&self, pattern: &Pattern, options: &FilterOptions) -> bool {
+        match pattern {
+            Pattern::Text(text) if *options.case_sensitive() => self.text.contains(text.as_str()),
+            Pattern::Text(text) => self.lowercase.contains(text.as_str()),
+
+            // Regexes deal with case on their own.
+            Pattern::Regex(regex) => regex.is_match(&self.text),
+        }
+    }
+}
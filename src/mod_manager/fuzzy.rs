@@ -0,0 +1,177 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Ranked fuzzy matching for the filter index.
+//!
+//! A text matches a query if the characters of the query appear in it in order, not necessarily together, so `smxyz` finds
+//! `!!!!!!_sm_xyz_v2.pack`. Short queries get a few of their characters skipped too, to survive typos. Matches are scored by
+//! how tight they are and how many of them land at the start of words, and only the best ones are kept.
+//!
+//! This runs on every keystroke over thousands of mods, so the matcher owns all its buffers and reuses them between searches.
+//! Nothing allocates while scoring or ranking.
+
+use std::cmp::Reverse;
+use std::collections::BinaryHeap;
+
+/// Score of each matched character.
+const MATCH_SCORE: i32 = 16;
+
+/// Extra score for characters matched right after the previous one.
+const CONSECUTIVE_BONUS: i32 = 12;
+
+/// Extra score for characters matched at the start of a word.
+const BOUNDARY_BONUS: i32 = 10;
+
+/// Max penalty for the characters skipped between two matches.
+const MAX_GAP_PENALTY: i32 = 6;
+
+/// Penalty for each character of the query not found in the text.
+const TYPO_PENALTY: i32 = 24;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Fuzzy matcher keeping the best scored entries of a search.
+#[derive(Debug)]
+pub struct FuzzyMatcher {
+
+    // Characters of the current query, already lowercased if the search is case insensitive.
+    query: Vec<char>,
+    case_sensitive: bool,
+
+    // Characters of the query that can be missing from a text before it stops matching.
+    max_typos: usize,
+
+    // Best entries so far, as a min-heap of (score, entry index), so the worst one is always at the top.
+    limit: usize,
+    best: BinaryHeap<Reverse<(i32, usize)>>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl FuzzyMatcher {
+
+    /// This function creates a matcher keeping at most `limit` results per search.
+    pub fn new(limit: usize) -> Self {
+        Self {
+            query: Vec::with_capacity(64),
+            case_sensitive: false,
+            max_typos: 0,
+            limit,
+            best: BinaryHeap::with_capacity(limit),
+        }
+    }
+
+    /// This function starts a new search, dropping the results of the previous one.
+    pub fn set_query(&mut self, query: &str, case_sensitive: bool) {
+        self.query.clear();
+        if case_sensitive {
+            self.query.extend(query.chars());
+        } else {
+            self.query.extend(query.chars().flat_map(char::to_lowercase));
+        }
+
+        self.case_sensitive = case_sensitive;
+        self.max_typos = match self.query.len() {
+            0..=3 => 0,
+            4..=7 => 1,
+            _ => 2,
+        };
+
+        self.best.clear();
+    }
+
+    /// This function returns if the current search is case sensitive, to know which version of the texts to score.
+    pub fn case_sensitive(&self) -> bool {
+        self.case_sensitive
+    }
+
+    /// This function scores a text against the current query, or returns `None` if it doesn't match.
+    ///
+    /// Matching is greedy: each character of the query takes the first occurrence after the previous match. If one is not found,
+    /// it counts as a typo and the search goes on from the previous match with the next character.
+    pub fn score(&self, text: &str) -> Option<i32> {
+        if self.query.is_empty() {
+            return None;
+        }
+
+        let mut score = 0;
+        let mut typos = 0;
+        let mut query_index = 0;
+        let mut gap = 0;
+        let mut consecutive = false;
+
+        // Where to resume after a typo: right after the last matched character.
+        let mut chars = text.chars();
+        let mut previous: Option<char> = None;
+        let mut checkpoint = (chars.clone(), previous);
+
+        while query_index < self.query.len() {
+            match chars.next() {
+                Some(character) if character == self.query[query_index] => {
+                    score += MATCH_SCORE - gap.min(MAX_GAP_PENALTY);
+                    if consecutive {
+                        score += CONSECUTIVE_BONUS;
+                    }
+
+                    if previous.map_or(true, |previous| !previous.is_alphanumeric()) {
+                        score += BOUNDARY_BONUS;
+                    }
+
+                    query_index += 1;
+                    gap = 0;
+                    consecutive = true;
+                    previous = Some(character);
+                    checkpoint = (chars.clone(), previous);
+                }
+
+                Some(character) => {
+                    gap += 1;
+                    consecutive = false;
+                    previous = Some(character);
+                }
+
+                None if typos < self.max_typos => {
+                    typos += 1;
+                    score -= TYPO_PENALTY;
+                    query_index += 1;
+                    gap = 0;
+                    consecutive = false;
+                    (chars, previous) = checkpoint.clone();
+                }
+
+                None => return None,
+            }
+        }
+
+        Some(score)
+    }
+
+    /// This function offers an entry to the results, keeping it only if it's among the best ones so far.
+    pub fn push(&mut self, score: i32, index: usize) {
+        if self.best.len() < self.limit {
+            self.best.push(Reverse((score, index)));
+        } else if let Some(mut worst) = self.best.peek_mut() {
+            if score > worst.0.0 {
+                *worst = Reverse((score, index));
+            }
+        }
+    }
+
+    /// This function moves the results of the search to the provided buffer, as (entry index, score), best first.
+    pub fn drain_into(&mut self, results: &mut Vec<(usize, i32)>) {
+        results.clear();
+        results.extend(self.best.drain().map(|Reverse((score, index))| (index, score)));
+        results.sort_unstable_by(|(index_a, score_a), (index_b, score_b)| score_b.cmp(score_a).then(index_a.cmp(index_b)));
+    }
+}
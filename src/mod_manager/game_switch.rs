@@ -0,0 +1,160 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Background job that does all the disk work needed when changing the game selected.
+//!
+//! The job goes through all its stages in order (config, profiles, pack discovery) and reports each one
+//! through a channel, so the ui can start populating itself while the rest of the job is still running.
+
+use anyhow::Result;
+
+use std::collections::BTreeSet;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::Arc;
+use std::thread;
+
+use rpfm_lib::games::GameInfo;
+
+use crate::integrations::{GameConfig, Profile};
+use crate::mod_manager::discovery::probe_packs;
+use crate::mod_manager::pack_cache::PackCache;
+use crate::mod_manager::pack_header::PackHeader;
+use crate::mod_manager::pack_watcher::{folders_to_watch, PackFolders};
+use crate::profiling::span;
+
+/// Amount of packs probed before reporting them back. Small enough for the list to start filling quickly.
+const DISCOVERY_BATCH_SIZE: usize = 64;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Events sent by the game switch job to the ui, in the order they're listed here.
+#[derive(Debug)]
+pub enum GameSwitchEvent {
+    ConfigLoaded(GameConfig),
+
+    /// Names of the profiles of the game. Profiles themselves are only read when loaded.
+    ProfilesListed(BTreeSet<String>),
+
+    /// Batch of probed packs. Data packs are always sent before content packs.
+    PacksProbed(Vec<(PathBuf, PackHeader)>),
+
+    /// Last event of a successful job. Returns the updated pack cache, and the folders to watch for pack changes.
+    Finished(PackCache, PackFolders),
+    Error(anyhow::Error),
+}
+
+/// Handle to a running game switch job.
+#[derive(Debug)]
+pub struct GameSwitchJob {
+    receiver: Receiver<GameSwitchEvent>,
+    cancelled: Arc<AtomicBool>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl GameSwitchJob {
+
+    /// This function starts a game switch job in a separate thread.
+    ///
+    /// If no game path is provided, the job skips the pack discovery stage.
+    pub fn spawn(game: GameInfo, game_path: Option<PathBuf>) -> Self {
+        let (sender, receiver) = channel();
+        let cancelled = Arc::new(AtomicBool::new(false));
+
+        let thread_cancelled = cancelled.clone();
+        thread::spawn(move || {
+            if let Err(error) = game_switch(&game, game_path, &sender, &thread_cancelled) {
+                let _ = sender.send(GameSwitchEvent::Error(error));
+            }
+        });
+
+        Self {
+            receiver,
+            cancelled,
+        }
+    }
+
+    pub fn receiver(&self) -> &Receiver<GameSwitchEvent> {
+        &self.receiver
+    }
+
+    /// This function cancels the job. It stops at the next stage or batch.
+    pub fn cancel(&self) {
+        self.cancelled.store(true, Ordering::SeqCst);
+    }
+}
+
+/// Body of the game switch job. Stops as soon as it notices it has been cancelled, or the receiver is gone.
+fn game_switch(game: &GameInfo, game_path: Option<PathBuf>, sender: &Sender<GameSwitchEvent>, cancelled: &AtomicBool) -> Result<()> {
+    let alive = |event| !cancelled.load(Ordering::SeqCst) && sender.send(event).is_ok();
+
+    let game_config = {
+        let _span = span("game_switch_load_config");
+        GameConfig::load(game, true)?
+    };
+
+    if !alive(GameSwitchEvent::ConfigLoaded(game_config)) {
+        return Ok(());
+    }
+
+    let profiles = {
+        let _span = span("game_switch_list_profiles");
+        Profile::profile_names_for_game(game)?
+    };
+
+    if !alive(GameSwitchEvent::ProfilesListed(profiles)) {
+        return Ok(());
+    }
+
+    let mut pack_cache = {
+        let _span = span("game_switch_load_pack_cache");
+        PackCache::load(game)?
+    };
+
+    let discovery_span = span("game_switch_discovery");
+    let mut folders = PackFolders::default();
+    if let Some(game_path) = game_path {
+        let mut data_paths = game.data_packs_paths(&game_path).unwrap_or_default();
+        let mut content_paths = game.content_packs_paths(&game_path).unwrap_or_default();
+        data_paths.sort();
+        content_paths.sort();
+
+        // Data goes first, so /data paths always take priority.
+        for paths in [&data_paths, &content_paths] {
+            for batch in paths.chunks(DISCOVERY_BATCH_SIZE) {
+                let headers = probe_packs(&mut pack_cache, batch)?;
+                if !alive(GameSwitchEvent::PacksProbed(batch.iter().cloned().zip(headers).collect())) {
+                    return Ok(());
+                }
+            }
+        }
+
+        let found = data_paths.iter()
+            .chain(content_paths.iter())
+            .map(|path| path.as_path())
+            .collect();
+        pack_cache.retain(&found);
+
+        folders = folders_to_watch(&data_paths, &content_paths);
+    }
+
+    drop(discovery_span);
+
+    let _span = span("game_switch_save_pack_cache");
+    pack_cache.save(game)?;
+    alive(GameSwitchEvent::Finished(pack_cache, folders));
+    Ok(())
+}
@@ -0,0 +1,166 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Game launching.
+//!
+//! Launching means writing the load order to the `mod_list.txt` of the game folder, and starting the game pointing to it.
+//! The load order comes from the game config, not from the ui, so the same path serves both the Play button and launching
+//! on start, where no ui is built at all. The file is only rewritten when its contents change, and always atomically.
+//!
+//! If enabled in the settings, small mods are launched merged into cached Packs, as explained in `mod_manager::merged_packs`.
+
+use anyhow::{anyhow, Result};
+
+use std::fs::{metadata, read};
+#[cfg(target_os = "windows")] use std::os::windows::process::CommandExt;
+use std::path::Path;
+use std::process::Command;
+
+use rpfm_lib::games::GameInfo;
+use rpfm_lib::integrations::log::*;
+
+use rpfm_ui_common::settings::*;
+
+use crate::integrations::{write_atomic, GameConfig, Mod};
+use crate::mod_manager::load_order::load_order;
+use crate::mod_manager::merged_packs::{merge_small_mods, ModListEntry};
+use crate::mod_manager::pack_cache::PackCache;
+use crate::settings_ui::merge_small_mods_max_size;
+use crate::SUPPORTED_GAMES;
+
+/// Name of the file with the load order, in the game folder.
+pub const MOD_LIST_FILE_NAME: &str = "mod_list.txt";
+
+/// Argument to launch the default game, or the game with the key passed after it, right away.
+pub const AUTOSTART_ARG: &str = "--autostart";
+
+const CREATE_NO_WINDOW: u32 = 0x08000000;
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+/// This function writes the load order of the provided game config to the game folder, and starts the game.
+///
+/// See [write_load_order] for what `build_merged` means.
+pub fn launch_game(game: &GameInfo, game_path: &Path, game_config: &GameConfig, pack_cache: &PackCache, build_merged: bool) -> Result<()> {
+    write_load_order(game, game_path, game_config, pack_cache, build_merged)?;
+
+    let exec_game = game.executable_path(game_path).ok_or_else(|| anyhow!("Executable of {} not found.", game.display_name()))?;
+
+    if cfg!(target_os = "windows") {
+        let mut command = Command::new("cmd");
+        command.arg("/C");
+        command.arg("start");
+        command.arg("/d");
+        command.arg(game_path.to_string_lossy().replace('\\', "/"));
+        command.arg(exec_game.file_name().unwrap().to_string_lossy().to_string());
+        command.arg(format!("{MOD_LIST_FILE_NAME};"));
+
+        // This disables the terminal when executing the command.
+        #[cfg(target_os = "windows")]command.creation_flags(CREATE_NO_WINDOW);
+        command.spawn()?;
+
+        Ok(())
+    } else if cfg!(target_os = "linux") {
+
+        Ok(())
+    } else {
+        Err(anyhow!("Unsupported OS."))
+    }
+}
+
+/// This function launches a game straight from its saved config, without discovering its mods again or building any ui.
+///
+/// If no game key is provided, the default game is launched.
+pub fn launch_game_on_start(game_key: Option<&str>) -> Result<()> {
+    let game_key = game_key.map(|key| key.to_owned()).unwrap_or_else(|| setting_string("default_game"));
+    let game = SUPPORTED_GAMES.game(&game_key).ok_or_else(|| anyhow!("Unsupported game: {}.", game_key))?;
+    let game_path = setting_path(game.game_key_name());
+    if !game_path.is_dir() {
+        return Err(anyhow!("No valid path configured for {}.", game.display_name()));
+    }
+
+    // The Pack cache only affects the order of the non-mod packs, so we can launch without it.
+    let game_config = GameConfig::load(game, false)?;
+    let pack_cache = PackCache::load(game).unwrap_or_default();
+    launch_game(game, &game_path, &game_config, &pack_cache, true)
+}
+
+/// This function writes the load order of the provided game config to the game folder, only if it changed.
+///
+/// If merging is enabled, merged Packs not yet cached are built here if `build_merged` is true. Otherwise, their mods are loaded
+/// on their own, so callers that can't wait, like the ui, should build them beforehand with a `MergeBuilder`.
+///
+/// Returns true if the file was written.
+pub fn write_load_order(game: &GameInfo, game_path: &Path, game_config: &GameConfig, pack_cache: &PackCache, build_merged: bool) -> Result<bool> {
+    let mods = load_order(game_config, pack_cache);
+    let entries = mod_list_entries(game, &mods, pack_cache, build_merged);
+
+    // Merged Packs are not in any folder the game looks into, so point it to theirs.
+    let mut mod_list = vec![];
+    let merged_folder = entries.iter().find_map(|entry| match entry {
+        ModListEntry::Merged(path) => path.parent(),
+        ModListEntry::Mod(_) => None,
+    });
+
+    if let Some(folder) = merged_folder {
+        mod_list.push(format!("add_working_directory \"{}\";", folder.to_string_lossy().replace('\\', "/")));
+    }
+
+    for entry in &entries {
+        let pack_name = match entry {
+            ModListEntry::Mod(modd) => modd.paths()[0].file_name(),
+            ModListEntry::Merged(path) => path.file_name(),
+        };
+
+        mod_list.push(format!("mod \"{}\";", pack_name.unwrap_or_default().to_string_lossy()));
+    }
+
+    let mod_list = mod_list.join("\n");
+
+    let written = write_mod_list(game_path, mod_list.as_bytes())?;
+    if !written {
+        info!("Load order unchanged. {} not rewritten.", MOD_LIST_FILE_NAME);
+    }
+
+    Ok(written)
+}
+
+/// This function returns the entries of the mod list of the provided load order, merging the small mods if enabled in the settings.
+pub fn mod_list_entries<'a>(game: &GameInfo, mods: &[&'a Mod], pack_cache: &PackCache, build_merged: bool) -> Vec<ModListEntry<'a>> {
+    let max_size = merge_small_mods_max_size();
+    if max_size == 0 {
+        return mods.iter().copied().map(ModListEntry::Mod).collect();
+    }
+
+    merge_small_mods(game, mods, pack_cache, max_size, build_merged).unwrap_or_else(|error| {
+        warn!("Mods not merged, so they'll be loaded on their own: {}", error);
+        mods.iter().copied().map(ModListEntry::Mod).collect()
+    })
+}
+
+/// This function writes the provided mod list to the game folder, only if it's different from the one already there.
+///
+/// Returns true if the file was written.
+fn write_mod_list(game_path: &Path, mod_list: &[u8]) -> Result<bool> {
+    let path = game_path.join(MOD_LIST_FILE_NAME);
+
+    // Different sizes mean different lists, so only read the old one when that's not enough.
+    let unchanged = metadata(&path).map_or(false, |metadata| metadata.len() == mod_list.len() as u64) &&
+        read(&path).map_or(false, |old| old == mod_list);
+
+    if unchanged {
+        return Ok(false);
+    }
+
+    write_atomic(&path, mod_list)?;
+    Ok(true)
+}
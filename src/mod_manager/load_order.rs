@@ -0,0 +1,344 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Load order of the enabled mods of a game.
+//!
+//! The load order only depends on the game config and the Pack cache, so it's built here, away from the ui. The pack list
+//! shows it, and the launcher writes it for the game, and both get the same order from the same place.
+//!
+//! Mods are first sorted by a [SortKey]: pack type, then pin, then id. Then the user rules are applied with a topological
+//! sort that, among the mods free to go next, always picks the one with the lowest key. Without rules that's just the sorted
+//! list, and with them mods only move as much as their rules require. Keys are compared once per sort and the topological
+//! sort works on their positions, so solving 500 mods is a plain O(n log n) sort plus a heap pass over the rules.
+//!
+//! Always picking the lowest key splits the order into blocks, each starting at a mod with a higher key than all the mods
+//! before it, and made only of mods linked to each other by rules or dependencies. So the order is also just those blocks
+//! sorted by their first key, and each mod has an [OrderKey] that doesn't depend on the mods it's not linked to. That's what
+//! lets the pack list solve again only the group of a mod that gets toggled, and move only the rows that changed.
+//!
+//! "Before" always means earlier in the mod list, and the game gives priority to the Packs that come first in it. So besides
+//! the user rules, every mod goes before the Packs it depends on, as read from the Pack cache during discovery: a submod has
+//! to win over the parent mod it changes, or its changes would never be seen.
+//!
+//! Cycles of rules can't be satisfied. They're reported, and the rules inside them ignored.
+
+use getset::*;
+
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, BTreeSet, HashMap, HashSet};
+
+use rpfm_lib::games::pfh_file_type::PFHFileType;
+
+use crate::integrations::{GameConfig, LoadOrder, LoadOrderRule, Mod};
+use crate::mod_manager::pack_cache::PackCache;
+
+/// Pin of the mods that are not pinned. Sorts them after the pinned ones.
+const UNPINNED: u32 = u32::MAX;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Key mods are sorted by before applying the rules: first by pack type, then by pin, then by the bytes of their id.
+///
+/// The id is kept as a string instead of a rank of the ids, because a rank would need recomputing for every row each time a new
+/// mod is found. Only a few keys get compared per toggle, so comparing strings there costs less than keeping ranks in sync.
+#[derive(Clone, Debug, PartialEq, Eq, PartialOrd, Ord, Getters)]
+#[getset(get = "pub")]
+pub struct SortKey {
+    pfh_file_type: u32,
+    pin: u32,
+    id: String,
+}
+
+/// Position of a mod in the load order: the key of the first mod of its block, and the index of the mod in that block.
+///
+/// Sorting mods by it gives the load order, and it only changes when the group of linked mods the mod belongs to changes.
+#[derive(Clone, Debug, PartialEq, Eq, PartialOrd, Ord, Getters)]
+#[getset(get = "pub")]
+pub struct OrderKey {
+    block: SortKey,
+    index: u32,
+}
+
+/// The load order of the enabled mods of a game, with the rules applied.
+#[derive(Debug, Getters)]
+#[getset(get = "pub")]
+pub struct SolvedLoadOrder<'a> {
+    mods: Vec<(SortKey, &'a Mod)>,
+
+    // Ids of the mods of each cycle of rules found, in rule order.
+    cycles: Vec<Vec<String>>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl<'a> SolvedLoadOrder<'a> {
+
+    /// This function returns the mods in load order, with their sort keys.
+    pub fn into_mods(self) -> Vec<(SortKey, &'a Mod)> {
+        self.mods
+    }
+}
+
+/// This function returns the enabled and installed mods of a game, in the order the game should load them.
+///
+/// If the order saved in the game config still has exactly the enabled mods, it's used as is. Otherwise, it's solved again.
+pub fn load_order<'a>(game_config: &'a GameConfig, pack_cache: &PackCache) -> Vec<&'a Mod> {
+    let saved = game_config.load_order().order()
+        .iter()
+        .filter_map(|mod_id| game_config.mods().get(mod_id))
+        .filter(|modd| *modd.enabled() && !modd.paths().is_empty())
+        .collect::<Vec<_>>();
+
+    let enabled = game_config.mods().values().filter(|modd| *modd.enabled() && !modd.paths().is_empty()).count();
+    if saved.len() == enabled && saved.len() == game_config.load_order().order().len() {
+        saved
+    } else {
+        solve_load_order(game_config, pack_cache).mods.into_iter().map(|(_, modd)| modd).collect()
+    }
+}
+
+/// This function solves the load order of the enabled and installed mods of a game, with its pins and rules.
+pub fn solve_load_order<'a>(game_config: &'a GameConfig, pack_cache: &PackCache) -> SolvedLoadOrder<'a> {
+    let pins = pins(game_config.load_order());
+    let mods = game_config.mods()
+        .values()
+        .filter(|modd| *modd.enabled() && !modd.paths().is_empty())
+        .map(|modd| (sort_key(modd, pins.get(modd.id().as_str()).copied().unwrap_or(UNPINNED), pack_cache), modd))
+        .collect::<Vec<_>>();
+
+    solve_mods(mods, game_config.load_order(), pack_cache)
+}
+
+/// This function solves the load order of just the provided mods, with their keys, as if they were the only ones enabled.
+///
+/// Solving a whole group of linked mods this way gives the same order they have in the full load order.
+pub fn solve_mods<'a>(mut mods: Vec<(SortKey, &'a Mod)>, load_order: &LoadOrder, pack_cache: &PackCache) -> SolvedLoadOrder<'a> {
+    mods.sort_unstable_by(|(a, _), (b, _)| a.cmp(b));
+
+    let rules = load_order.rules();
+    if rules.is_empty() && !mods.iter().any(|(_, modd)| !dependencies(modd, pack_cache).is_empty()) {
+        return SolvedLoadOrder {
+            mods,
+            cycles: vec![],
+        };
+    }
+
+    // From here on, mods are just their position in the sorted list.
+    let positions = mods.iter()
+        .enumerate()
+        .map(|(position, (key, _))| (key.id.as_str(), position))
+        .collect::<HashMap<_, _>>();
+
+    let dependency_rules = mods.iter()
+        .flat_map(|(key, modd)| dependencies(modd, pack_cache).iter().map(move |dependency| (key.id.as_str(), dependency.as_str())));
+
+    let edges = rules.iter()
+        .map(|rule| (rule.before().as_str(), rule.after().as_str()))
+        .chain(dependency_rules)
+        .filter_map(|(before, after)| Some((*positions.get(before)?, *positions.get(after)?)))
+        .collect::<Vec<_>>();
+
+    let (order, cycles) = topological_order(mods.len(), &edges);
+    let cycles = cycles.into_iter()
+        .map(|cycle| cycle.into_iter().map(|position| mods[position].0.id.to_owned()).collect())
+        .collect();
+
+    let mut mods = mods.into_iter().map(Some).collect::<Vec<_>>();
+    SolvedLoadOrder {
+        mods: order.into_iter().filter_map(|position| mods[position].take()).collect(),
+        cycles,
+    }
+}
+
+/// This function solves the load order of a game config again, and saves it in the config if it changed.
+///
+/// Returns the cycles of rules found, if any.
+pub fn update_load_order(game_config: &mut GameConfig, pack_cache: &PackCache) -> Vec<Vec<String>> {
+    let solved = solve_load_order(game_config, pack_cache);
+    let changed = solved.mods.len() != game_config.load_order().order().len() ||
+        solved.mods.iter().zip(game_config.load_order().order().iter()).any(|((key, _), mod_id)| key.id() != mod_id);
+
+    let cycles = solved.cycles;
+    if changed {
+        let order = solved.mods.iter().map(|(key, _)| key.id.to_owned()).collect();
+        game_config.load_order_mut().set_order(order);
+        game_config.set_dirty(true);
+    }
+
+    cycles
+}
+
+/// This function returns the order keys of a solved list of mods, given their sort keys in load order.
+pub fn order_keys<'a>(keys: impl IntoIterator<Item = &'a SortKey>) -> Vec<OrderKey> {
+    let mut order_keys: Vec<OrderKey> = vec![];
+    for key in keys {
+        let order_key = match order_keys.last() {
+            Some(last) if *key < last.block => OrderKey {
+                block: last.block.clone(),
+                index: last.index + 1,
+            },
+            _ => OrderKey {
+                block: key.clone(),
+                index: 0,
+            },
+        };
+
+        order_keys.push(order_key);
+    }
+
+    order_keys
+}
+
+/// This function returns the ids of the mods on the other side of the rules of the provided one. Its dependencies, and the mods
+/// depending on it, are kept both ways in the [DependencyGraph].
+///
+/// [DependencyGraph]: crate::mod_manager::dependencies::DependencyGraph
+pub fn rule_links<'a>(mod_id: &'a str, load_order: &'a LoadOrder) -> impl Iterator<Item = &'a str> {
+    load_order.rules().iter().filter_map(move |rule| {
+        if rule.before() == mod_id {
+            Some(rule.after().as_str())
+        } else if rule.after() == mod_id {
+            Some(rule.before().as_str())
+        } else {
+            None
+        }
+    })
+}
+
+/// This function returns the key used to sort the provided mod before applying the rules.
+///
+/// The type comes from the metadata found during discovery, so this never touches the disk.
+pub fn load_order_key(modd: &Mod, load_order: &LoadOrder, pack_cache: &PackCache) -> SortKey {
+    let pin = load_order.pinned().iter().position(|mod_id| mod_id == modd.id()).map_or(UNPINNED, |pin| pin as u32);
+    sort_key(modd, pin, pack_cache)
+}
+
+/// This function returns the cycle the provided rules would make, if they make any, counting all mods, enabled or not.
+///
+/// Use it to check a new rule before adding it, so enabling a mod later can't break the load order. Dependencies must be
+/// passed as rules too, with each mod before the Packs it depends on, as that's how the load order applies them.
+pub fn rule_cycle(rules: &[LoadOrderRule]) -> Option<Vec<String>> {
+    let ids = rules.iter()
+        .flat_map(|rule| [rule.before().as_str(), rule.after().as_str()])
+        .collect::<BTreeSet<_>>()
+        .into_iter()
+        .collect::<Vec<_>>();
+
+    let positions = ids.iter().enumerate().map(|(position, id)| (*id, position)).collect::<HashMap<_, _>>();
+    let edges = rules.iter()
+        .map(|rule| (positions[rule.before().as_str()], positions[rule.after().as_str()]))
+        .collect::<Vec<_>>();
+
+    let (_, cycles) = topological_order(ids.len(), &edges);
+    cycles.into_iter().next().map(|cycle| cycle.into_iter().map(|position| ids[position].to_owned()).collect())
+}
+
+fn sort_key(modd: &Mod, pin: u32, pack_cache: &PackCache) -> SortKey {
+    let pfh_file_type = modd.paths()
+        .first()
+        .and_then(|path| pack_cache.last_known_header(path))
+        .map(|header| *header.pfh_file_type())
+        .unwrap_or(PFHFileType::Mod as u32);
+
+    SortKey {
+        pfh_file_type,
+        pin,
+        id: modd.id().to_owned(),
+    }
+}
+
+fn dependencies<'a>(modd: &Mod, pack_cache: &'a PackCache) -> &'a [String] {
+    modd.paths().first().map(|path| pack_cache.last_known_dependencies(path)).unwrap_or_default()
+}
+
+fn pins(load_order: &LoadOrder) -> HashMap<&str, u32> {
+    load_order.pinned().iter().enumerate().map(|(pin, mod_id)| (mod_id.as_str(), pin as u32)).collect()
+}
+
+/// This function sorts `0..count` so every edge goes from an earlier node to a later one, picking the lowest node free to go
+/// next each time.
+///
+/// Edges that are part of a cycle can't be honored. Each cycle found is returned, in edge order, and its edges dropped.
+fn topological_order(count: usize, edges: &[(usize, usize)]) -> (Vec<usize>, Vec<Vec<usize>>) {
+    let edges = edges.iter().copied().filter(|(from, to)| from != to).collect::<HashSet<_>>();
+    let mut successors = vec![vec![]; count];
+    let mut predecessors = vec![vec![]; count];
+    let mut in_degree = vec![0_usize; count];
+    for &(from, to) in &edges {
+        successors[from].push(to);
+        predecessors[to].push(from);
+        in_degree[to] += 1;
+    }
+
+    let mut ready = (0..count).filter(|node| in_degree[*node] == 0).map(Reverse).collect::<BinaryHeap<_>>();
+    let mut done = vec![false; count];
+    let mut dropped = HashSet::new();
+    let mut order = Vec::with_capacity(count);
+    let mut cycles = vec![];
+
+    while order.len() < count {
+        match ready.pop() {
+            Some(Reverse(node)) => {
+                done[node] = true;
+                order.push(node);
+
+                for &next in &successors[node] {
+                    if !dropped.contains(&(node, next)) {
+                        in_degree[next] -= 1;
+                        if in_degree[next] == 0 {
+                            ready.push(Reverse(next));
+                        }
+                    }
+                }
+            }
+
+            // Everything left waits on something else left, so there's a cycle. Walk back from the lowest one until we find it.
+            None => {
+                let start = (0..count).find(|node| !done[*node]).unwrap();
+                let mut path = vec![start];
+                let mut seen = HashMap::from([(start, 0)]);
+                let cycle_start = loop {
+                    let node = *path.last().unwrap();
+                    let previous = predecessors[node].iter()
+                        .copied()
+                        .find(|previous| !done[*previous] && !dropped.contains(&(*previous, node)))
+                        .unwrap();
+
+                    if let Some(&index) = seen.get(&previous) {
+                        break index;
+                    }
+
+                    seen.insert(previous, path.len());
+                    path.push(previous);
+                };
+
+                let mut cycle = path.split_off(cycle_start);
+                cycle.reverse();
+
+                for (index, &from) in cycle.iter().enumerate() {
+                    let to = cycle[(index + 1) % cycle.len()];
+                    dropped.insert((from, to));
+                    in_degree[to] -= 1;
+                    if in_degree[to] == 0 {
+                        ready.push(Reverse(to));
+                    }
+                }
+
+                cycles.push(cycle);
+            }
+        }
+    }
+
+    (order, cycles)
+}
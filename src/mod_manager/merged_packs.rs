@@ -0,0 +1,428 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Merged Packs, to start the game faster.
+//!
+//! The game opens and indexes every Pack in the mod list on start, so hundreds of small mods take a while to load. When merging
+//! is enabled, each run of consecutive small mods in the load order is merged into one Pack, which is launched instead of them.
+//! Mods too big to merge split the runs, so every file keeps the priority it had against every other mod.
+//!
+//! Merged Packs are cached in the config folder, named after a hash of the names and content hashes of the mods in them, so a
+//! cached Pack with the right name is always up to date, and Steam bumping the modification time of a mod doesn't make it stale.
+//! Until all the mods of a run are hashed, the name uses their sizes and modification times instead, and once they are, the
+//! Pack built under that name gets renamed instead of rebuilt. While the hash of a mod that changed is pending, the merged Pack
+//! of its previous version may still be the right one, so its run is not built and nothing gets pruned until the hash is done.
+//!
+//! The ui builds them on a [MergeBuilder] thread as soon as the enabled mods change, so launching never waits for them: runs
+//! whose merged Pack is not built yet are just launched on their own.
+
+use anyhow::Result;
+use xxhash_rust::xxh3::Xxh3;
+
+use std::collections::HashSet;
+use std::fs::{read_dir, remove_file, rename, DirBuilder};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::Arc;
+use std::thread;
+
+use rpfm_lib::files::{Container, pack::Pack};
+use rpfm_lib::games::GameInfo;
+use rpfm_lib::games::pfh_file_type::PFHFileType;
+use rpfm_lib::integrations::log::*;
+
+use crate::integrations::Mod;
+use crate::mod_manager::pack_cache::{file_stamp, PackCache};
+use crate::profiling::span_with;
+use crate::settings_ui::merged_packs_path;
+
+/// Start of the names of the merged Packs, so we know which files in their folder are ours.
+const MERGED_PACK_PREFIX: &str = "runcher_merged_";
+
+/// Extension of the merged Packs. Packs still being written have another one after it.
+const MERGED_PACK_EXTENSION: &str = ".pack";
+
+/// Changing this makes every cached merged Pack stale, in case how they're built ever changes.
+const MERGED_PACK_VERSION: u64 = 2;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// An entry of the mod list: a mod loaded on its own, or a merged Pack loaded in place of a run of mods.
+#[derive(Debug)]
+pub enum ModListEntry<'a> {
+    Mod(&'a Mod),
+    Merged(PathBuf),
+}
+
+/// A merged Pack to build: where it goes, and the Packs merged into it, in load order.
+#[derive(Clone, Debug)]
+pub struct MergeJob {
+    path: PathBuf,
+    packs: Vec<PathBuf>,
+}
+
+/// Handle to the thread building merged Packs.
+#[derive(Debug)]
+pub struct MergeBuilder {
+    sender: Sender<(u64, GameInfo, Vec<MergeJob>)>,
+    receiver: Receiver<PathBuf>,
+
+    // Merged Packs queued but not yet built or skipped.
+    pending: Arc<AtomicUsize>,
+
+    // Jobs from older generations are skipped. Increased with every new request, as it replaces the previous one.
+    generation: Arc<AtomicU64>,
+}
+
+/// A group of consecutive mods of a load order: a mod that can't be merged, or a run of mods that can.
+enum Run<'a> {
+    Single(&'a Mod),
+    Mergeable(Vec<&'a Mod>),
+}
+
+/// Paths the merged Pack of a run of mods can have.
+struct RunPaths {
+
+    // Path named after the content hashes of the mods, if all of them have one for their current version.
+    content: Option<PathBuf>,
+
+    // Path named after the sizes and modification times of the mods. Used until all of them are hashed.
+    stamp: PathBuf,
+
+    // If any of the mods changed and is waiting for its new hash, which may bring back the merged Pack of its previous version.
+    hash_pending: bool,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl MergeBuilder {
+
+    /// This function starts the thread building merged Packs.
+    pub fn spawn() -> Self {
+        let (sender, requests) = channel::<(u64, GameInfo, Vec<MergeJob>)>();
+        let (results, receiver) = channel();
+        let pending = Arc::new(AtomicUsize::new(0));
+        let generation = Arc::new(AtomicU64::new(0));
+
+        let thread_pending = pending.clone();
+        let thread_generation = generation.clone();
+        thread::Builder::new().name("merged_packs".to_owned()).spawn(move || {
+            while let Ok((request_generation, game, jobs)) = requests.recv() {
+                for job in &jobs {
+                    let cancelled = || thread_generation.load(Ordering::SeqCst) != request_generation;
+                    if !cancelled() {
+                        match build_merged_pack(&game, job, &cancelled) {
+                            Ok(true) => { let _ = results.send(job.path.to_path_buf()); },
+                            Ok(false) => {},
+                            Err(error) => warn!("Merged Pack {} not built, so its mods will be loaded on their own: {}", job.path.to_string_lossy(), error),
+                        }
+                    }
+
+                    thread_pending.fetch_sub(1, Ordering::SeqCst);
+                }
+            }
+        }).expect("Failed to start the merged Packs thread.");
+
+        Self {
+            sender,
+            receiver,
+            pending,
+            generation,
+        }
+    }
+
+    /// This function builds the provided merged Packs in the background, dropping whatever was being built before.
+    pub fn build(&self, game: &GameInfo, jobs: Vec<MergeJob>) {
+        let generation = self.generation.fetch_add(1, Ordering::SeqCst) + 1;
+        if jobs.is_empty() {
+            return;
+        }
+
+        let len = jobs.len();
+        self.pending.fetch_add(len, Ordering::SeqCst);
+        if self.sender.send((generation, game.clone(), jobs)).is_err() {
+            self.pending.fetch_sub(len, Ordering::SeqCst);
+            error!("Merged Packs thread is gone. Mods will be launched on their own.");
+        }
+    }
+
+    /// This function stops whatever is being built as soon as possible.
+    pub fn clear(&self) {
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        while self.receiver.try_recv().is_ok() {}
+    }
+
+    /// This function returns if there are merged Packs waiting to be built.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns the paths of the merged Packs built since the last call. Never blocks.
+    pub fn results(&self) -> Vec<PathBuf> {
+        self.receiver.try_iter().collect()
+    }
+}
+
+/// This function replaces each run of consecutive mods smaller than `max_size` in the provided load order with its merged Pack.
+/// Returns the entries of the mod list, in the same order.
+///
+/// Only regular mods are merged, as other Pack types are loaded differently. Runs whose merged Pack is not cached are merged
+/// here if `build_missing` is true, and loaded on their own otherwise, as is any run that fails to merge. So a broken mod
+/// never stops the game from launching.
+pub fn merge_small_mods<'a>(game: &GameInfo, mods: &[&'a Mod], pack_cache: &PackCache, max_size: u64, build_missing: bool) -> Result<Vec<ModListEntry<'a>>> {
+    let folder = merged_packs_folder(game)?;
+    let mut entries = Vec::with_capacity(mods.len());
+    let mut hash_pending = false;
+    for run in runs(mods, pack_cache, max_size) {
+        match run {
+            Run::Single(modd) => entries.push(ModListEntry::Mod(modd)),
+            Run::Mergeable(run) => match merged_pack(game, &run, pack_cache, &folder, build_missing, &mut hash_pending) {
+                Ok(Some(path)) => entries.push(ModListEntry::Merged(path)),
+                Ok(None) => {
+                    info!("Mods {} not merged yet, so they'll be loaded on their own.", run[0].id());
+                    entries.extend(run.into_iter().map(ModListEntry::Mod));
+                }
+                Err(error) => {
+                    warn!("Mods {} not merged, so they'll be loaded on their own: {}", run[0].id(), error);
+                    entries.extend(run.into_iter().map(ModListEntry::Mod));
+                }
+            },
+        }
+    }
+
+    // Merged Packs of older runs are not coming back unless their exact mods do, so don't let them pile up.
+    // Packs still being written are skipped, as they may be new ones the builder is working on.
+    if hash_pending {
+        return Ok(entries);
+    }
+
+    let used = entries.iter()
+        .filter_map(|entry| match entry {
+            ModListEntry::Merged(path) => Some(path.as_path()),
+            ModListEntry::Mod(_) => None,
+        })
+        .collect::<HashSet<_>>();
+
+    for entry in read_dir(&folder)?.flatten() {
+        let path = entry.path();
+        let file_name = entry.file_name().to_string_lossy().to_string();
+        if !used.contains(path.as_path()) && file_name.starts_with(MERGED_PACK_PREFIX) && file_name.ends_with(MERGED_PACK_EXTENSION) {
+            let _ = remove_file(path);
+        }
+    }
+
+    Ok(entries)
+}
+
+/// This function returns the merged Packs the provided load order needs that are not cached yet, for a [MergeBuilder].
+pub fn merge_jobs(game: &GameInfo, mods: &[&Mod], pack_cache: &PackCache, max_size: u64) -> Result<Vec<MergeJob>> {
+    let folder = merged_packs_folder(game)?;
+    let mut jobs = vec![];
+    for run in runs(mods, pack_cache, max_size) {
+        if let Run::Mergeable(run) = run {
+            let paths = run_paths(&run, pack_cache, &folder)?;
+            if !paths.hash_pending && cached_merged_pack(&paths).is_none() {
+                jobs.push(merge_job(&run, paths));
+            }
+        }
+    }
+
+    Ok(jobs)
+}
+
+/// This function splits a load order into runs of mergeable mods, and the mods between them.
+///
+/// A run of just one mod gains nothing from merging, so it's returned as a single mod.
+fn runs<'a>(mods: &[&'a Mod], pack_cache: &PackCache, max_size: u64) -> Vec<Run<'a>> {
+    let mut runs = vec![];
+    let mut run = vec![];
+    for modd in mods {
+        if is_mergeable(modd, pack_cache, max_size) {
+            run.push(*modd);
+        } else {
+            push_run(&mut runs, &mut run);
+            runs.push(Run::Single(modd));
+        }
+    }
+
+    push_run(&mut runs, &mut run);
+    runs
+}
+
+/// This function adds a run of mergeable mods to the runs, and empties it.
+fn push_run<'a>(runs: &mut Vec<Run<'a>>, run: &mut Vec<&'a Mod>) {
+    match run.len() {
+        0 => {},
+        1 => runs.push(Run::Single(run[0])),
+        _ => runs.push(Run::Mergeable(run.drain(..).collect())),
+    }
+
+    run.clear();
+}
+
+/// This function returns the merged Pack of the provided run of mods, or `None` if it's not cached and we can't build it here.
+///
+/// Sets `hash_pending` if the run has mods waiting for their hash.
+fn merged_pack(game: &GameInfo, run: &[&Mod], pack_cache: &PackCache, folder: &Path, build_missing: bool, hash_pending: &mut bool) -> Result<Option<PathBuf>> {
+    let paths = run_paths(run, pack_cache, folder)?;
+    *hash_pending |= paths.hash_pending;
+    if let Some(path) = cached_merged_pack(&paths) {
+        return Ok(Some(path));
+    }
+
+    if !build_missing {
+        return Ok(None);
+    }
+
+    let job = merge_job(run, paths);
+    build_merged_pack(game, &job, &|| false)?;
+    Ok(Some(job.path))
+}
+
+/// This function returns the path of the merged Pack of a run, if it's built.
+///
+/// A Pack built under the stamps of its mods is renamed after their content hashes once they have them, so it's not rebuilt.
+fn cached_merged_pack(paths: &RunPaths) -> Option<PathBuf> {
+    match paths.content {
+        Some(ref content) if content.is_file() => Some(content.to_path_buf()),
+        Some(ref content) if paths.stamp.is_file() => match rename(&paths.stamp, content) {
+            Ok(_) => Some(content.to_path_buf()),
+            Err(_) => Some(paths.stamp.to_path_buf()),
+        },
+        _ if paths.stamp.is_file() => Some(paths.stamp.to_path_buf()),
+        _ => None,
+    }
+}
+
+/// This function returns the paths the merged Pack of a run of mods can have.
+fn run_paths(run: &[&Mod], pack_cache: &PackCache, folder: &Path) -> Result<RunPaths> {
+    let path = |hash: u64| folder.join(format!("{}{:016x}{}", MERGED_PACK_PREFIX, hash, MERGED_PACK_EXTENSION));
+    let mut content_hashes = Vec::with_capacity(run.len());
+    let mut hash_pending = false;
+    for modd in run {
+        let path = &modd.paths()[0];
+        match pack_cache.pack(path).and_then(|cached| cached.content_hash().as_ref()) {
+            Some(content_hash) => content_hashes.push(*content_hash.hash()),
+            None => hash_pending |= pack_cache.has_previous_hash(path),
+        }
+    }
+
+    let content = match content_hashes.len() == run.len() {
+        true => Some(path(run_content_hash(run, &content_hashes))),
+        false => None,
+    };
+
+    Ok(RunPaths {
+        content,
+        stamp: path(run_stamp_hash(run)?),
+        hash_pending,
+    })
+}
+
+/// This function returns what's needed to build the merged Pack of a run of mods, under its best name.
+fn merge_job(run: &[&Mod], paths: RunPaths) -> MergeJob {
+    MergeJob {
+        path: paths.content.unwrap_or(paths.stamp),
+        packs: run.iter().map(|modd| modd.paths()[0].to_path_buf()).collect(),
+    }
+}
+
+/// This function merges the Packs of a job into its merged Pack. Returns false if `cancelled` said so mid-way.
+fn build_merged_pack(game: &GameInfo, job: &MergeJob, cancelled: &dyn Fn() -> bool) -> Result<bool> {
+    let _span = span_with("merge_packs", format!("{} mods", job.packs.len()));
+
+    // The game gives priority to the Packs that come first in the mod list, and here later inserts replace earlier ones,
+    // so mods are merged from the last of the run to the first.
+    let mut merged: Option<Pack> = None;
+    for path in job.packs.iter().rev() {
+        if cancelled() {
+            return Ok(false);
+        }
+
+        let pack = Pack::read_and_merge(&[path.to_path_buf()], true, false)?;
+        match merged {
+            Some(ref mut merged) => {
+                for file in pack.files().values() {
+                    merged.insert(file.clone())?;
+                }
+            }
+            None => merged = Some(pack),
+        }
+    }
+
+    // Save it with a temporal name first, so a half-written Pack never passes as a cached one.
+    if let Some(mut merged) = merged {
+        let mut temp_path = job.path.as_os_str().to_owned();
+        temp_path.push(".tmp");
+        let temp_path = PathBuf::from(temp_path);
+
+        merged.save(Some(&temp_path), game, &None)?;
+        rename(&temp_path, &job.path)?;
+    }
+
+    Ok(true)
+}
+
+/// This function returns the folder with the merged Packs of a game, creating it if needed.
+fn merged_packs_folder(game: &GameInfo) -> Result<PathBuf> {
+    let folder = merged_packs_path()?.join(game.game_key_name());
+    DirBuilder::new().recursive(true).create(&folder)?;
+    Ok(folder)
+}
+
+/// This function returns if a mod can be merged: if it's a regular mod no bigger than `max_size`.
+fn is_mergeable(modd: &Mod, pack_cache: &PackCache, max_size: u64) -> bool {
+    match modd.paths().first() {
+        Some(path) => {
+            let is_mod = pack_cache.last_known_header(path).map_or(false, |header| *header.pfh_file_type() == PFHFileType::Mod as u32);
+            is_mod && file_stamp(path).map_or(false, |(size, _)| size <= max_size)
+        }
+        None => false,
+    }
+}
+
+/// This function returns the hash that identifies the merged Pack of a run of mods by their order, names and content hashes.
+fn run_content_hash(run: &[&Mod], content_hashes: &[u64]) -> u64 {
+    let mut hasher = Xxh3::new();
+    hasher.update(&MERGED_PACK_VERSION.to_le_bytes());
+    hasher.update(b"content");
+
+    for (modd, content_hash) in run.iter().zip(content_hashes) {
+        hasher.update(modd.paths()[0].file_name().unwrap_or_default().to_string_lossy().as_bytes());
+        hasher.update(&[0]);
+        hasher.update(&content_hash.to_le_bytes());
+    }
+
+    hasher.digest()
+}
+
+/// This function returns the hash that identifies the merged Pack of a run of mods by their order, names, sizes and modification
+/// times, for runs with mods not yet hashed.
+fn run_stamp_hash(run: &[&Mod]) -> Result<u64> {
+    let mut hasher = Xxh3::new();
+    hasher.update(&MERGED_PACK_VERSION.to_le_bytes());
+
+    for modd in run {
+        let path = &modd.paths()[0];
+        hasher.update(path.file_name().unwrap_or_default().to_string_lossy().as_bytes());
+        hasher.update(&[0]);
+
+        let (size, modified) = file_stamp(path)?;
+        hasher.update(&size.to_le_bytes());
+        hasher.update(&modified.to_le_bytes());
+    }
+
+    Ok(hasher.digest())
+}
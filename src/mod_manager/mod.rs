@@ -0,0 +1,28 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Module containing the non-ui logic used to find, identify and manage the mods of a game.
+
+pub mod conflicts;
+pub mod dependencies;
+pub mod discovery;
+pub mod filter;
+pub mod fuzzy;
+pub mod game_switch;
+pub mod launcher;
+pub mod load_order;
+pub mod merged_packs;
+pub mod pack_cache;
+pub mod pack_hasher;
+pub mod pack_header;
+pub mod pack_view;
+pub mod pack_watcher;
+pub mod prewarm;
+pub mod thumbnails;
@@ -0,0 +1,287 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! On-disk cache of metadata of the Packs of a game.
+//!
+//! Entries are keyed by path, and only considered valid while the size and modification time of the file
+//! match the ones we cached. That means an unchanged Pack costs us one `stat` instead of a read.
+//!
+//! Besides the header, entries keep the names of the Packs each Pack depends on, read right after the header when the Pack
+//! declares any, so dependency checks never have to touch the disk.
+
+use anyhow::Result;
+use getset::*;
+use rayon::prelude::*;
+use serde::{Deserialize, Serialize};
+
+use std::collections::{HashMap, HashSet};
+use std::fs::File;
+use std::io::{BufReader, Read};
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+use rpfm_lib::games::GameInfo;
+
+use crate::integrations::write_atomic;
+use crate::mod_manager::pack_hasher::{ContentHash, HashRequest, HashResult};
+use crate::mod_manager::pack_header::PackHeader;
+use crate::mod_manager::pack_view::PackView;
+use crate::profiling::span_with;
+use crate::settings_ui::pack_cache_path;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+#[derive(Debug, Default, Getters, Serialize, Deserialize)]
+#[getset(get = "pub")]
+pub struct PackCache {
+    game_key: String,
+    packs: HashMap<PathBuf, CachedPack>,
+
+    // If the cache has changed since it was loaded.
+    #[serde(skip)]
+    dirty: bool,
+}
+
+#[derive(Clone, Debug, Default, Getters, Setters, Serialize, Deserialize)]
+#[getset(get = "pub", set = "pub")]
+pub struct CachedPack {
+
+    // Size and modification time of the file when it was cached. If any of them changes, the entry is stale.
+    size: u64,
+    modified: u64,
+
+    // Header info of the Pack. Includes type, version, flags and file count.
+    header: PackHeader,
+
+    // Names of the Packs this Pack depends on. None if they haven't been read yet.
+    #[serde(default)]
+    dependencies: Option<Vec<String>>,
+
+    // Hash of the contents of the Pack, if it has been calculated.
+    #[serde(default)]
+    content_hash: Option<ContentHash>,
+
+    // Hash of the last version of the Pack we hashed, if this version hasn't been hashed yet. Used to know what changed.
+    #[serde(default)]
+    previous_hash: Option<ContentHash>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl PackCache {
+
+    /// This function loads the Pack cache of the provided game.
+    ///
+    /// The cache is disposable, so if it's missing or it cannot be decoded we just start with an empty one.
+    pub fn load(game: &GameInfo) -> Result<Self> {
+        let path = Self::path(game)?;
+        let cache = if path.is_file() {
+            let mut file = BufReader::new(File::open(path)?);
+            let mut data = Vec::with_capacity(file.get_ref().metadata()?.len() as usize);
+            file.read_to_end(&mut data)?;
+
+            serde_json::from_slice::<Self>(&data).ok().filter(|cache| cache.game_key == game.game_key_name())
+        } else {
+            None
+        };
+
+        Ok(cache.unwrap_or_else(|| Self {
+            game_key: game.game_key_name().to_owned(),
+            ..Default::default()
+        }))
+    }
+
+    /// This function saves the cache to disk, only if it changed since it was loaded.
+    pub fn save(&mut self, game: &GameInfo) -> Result<()> {
+        if !self.dirty {
+            return Ok(());
+        }
+
+        // This is not meant to be edited by hand, so keep it compact.
+        write_atomic(&Self::path(game)?, &serde_json::to_vec(&self)?)?;
+
+        self.dirty = false;
+        Ok(())
+    }
+
+    /// This function returns the cached entry of a Pack, if it exists and it's not stale.
+    pub fn pack(&self, path: &Path) -> Option<&CachedPack> {
+        let (size, modified) = file_stamp(path).ok()?;
+        self.packs.get(path).filter(|cached| cached.is_valid(size, modified))
+    }
+
+    /// This function returns the last known header of a Pack, without checking if it's stale.
+    ///
+    /// Meant for views working over Packs that have just gone through [PackCache::pack_header].
+    pub fn last_known_header(&self, path: &Path) -> Option<&PackHeader> {
+        self.packs.get(path).map(|cached| &cached.header)
+    }
+
+    /// This function returns the last known dependencies of a Pack, without checking if they're stale.
+    ///
+    /// Like [PackCache::last_known_header], meant for Packs that have already gone through discovery.
+    pub fn last_known_dependencies(&self, path: &Path) -> &[String] {
+        self.packs.get(path).and_then(|cached| cached.dependencies.as_deref()).unwrap_or_default()
+    }
+
+    /// This function returns the header of the Pack at the provided path, reading it from disk only if the cached one is stale or missing.
+    pub fn pack_header(&mut self, path: &Path) -> Result<PackHeader> {
+        let (size, modified) = file_stamp(path)?;
+        if let Some(cached) = self.packs.get(path) {
+            if cached.is_valid(size, modified) {
+                return Ok(cached.header);
+            }
+        }
+
+        let mut cached = CachedPack::read(path, size, modified)?;
+        let header = cached.header;
+        cached.previous_hash = self.packs.remove(path).and_then(CachedPack::into_previous_hash);
+        self.packs.insert(path.to_path_buf(), cached);
+
+        self.dirty = true;
+        Ok(header)
+    }
+
+    /// This function returns the headers of all the provided packs, in the same order, probing in parallel the ones that are stale or missing.
+    ///
+    /// The parallel part runs on whatever rayon pool the caller is in.
+    pub fn pack_headers(&mut self, paths: &[PathBuf]) -> Result<Vec<PackHeader>> {
+        let probed = paths.par_iter()
+            .map(|path| {
+                let (size, modified) = file_stamp(path)?;
+                match self.packs.get(path) {
+                    Some(cached) if cached.is_valid(size, modified) => Ok((cached.header, None)),
+                    _ => {
+                        let cached = CachedPack::read(path, size, modified)?;
+                        Ok((cached.header, Some(cached)))
+                    }
+                }
+            })
+            .collect::<Result<Vec<_>>>()?;
+
+        let mut headers = Vec::with_capacity(probed.len());
+        for (path, (header, cached)) in paths.iter().zip(probed) {
+            if let Some(mut cached) = cached {
+                cached.previous_hash = self.packs.remove(path).and_then(CachedPack::into_previous_hash);
+                self.packs.insert(path.to_path_buf(), cached);
+                self.dirty = true;
+            }
+
+            headers.push(header);
+        }
+
+        Ok(headers)
+    }
+
+    /// This function returns the hash requests for all the provided Packs that have not been hashed since they last changed.
+    ///
+    /// Packs not in the cache are skipped, as we need their stamp to know if the hash is still valid once it's done.
+    pub fn hash_requests(&self, paths: &[&Path]) -> Vec<HashRequest> {
+        paths.iter()
+            .filter_map(|path| {
+                let cached = self.packs.get(*path)?;
+                if cached.content_hash.is_some() {
+                    return None;
+                }
+
+                Some(HashRequest {
+                    path: path.to_path_buf(),
+                    size: cached.size,
+                    modified: cached.modified,
+                    previous: cached.previous_hash.clone(),
+                })
+            })
+            .collect()
+    }
+
+    /// This function stores the result of hashing a Pack, if the Pack hasn't changed again since it was queued.
+    pub fn set_content_hash(&mut self, result: &HashResult) -> bool {
+        match self.packs.get_mut(result.path()) {
+            Some(cached) if cached.size == *result.size() && cached.modified == *result.modified() => {
+                cached.content_hash = Some(result.hash().clone());
+                cached.previous_hash = None;
+                self.dirty = true;
+                true
+            }
+            _ => false,
+        }
+    }
+
+    /// This function returns if we have a hash of a previous version of the Pack to compare to, once this version gets hashed.
+    pub fn has_previous_hash(&self, path: &Path) -> bool {
+        self.packs.get(path).map(|cached| cached.previous_hash.is_some()).unwrap_or(false)
+    }
+
+    /// This function removes a single Pack from the cache.
+    pub fn remove(&mut self, path: &Path) {
+        self.dirty |= self.packs.remove(path).is_some();
+    }
+
+    /// This function removes from the cache all the Packs not in the provided list, so it doesn't grow forever with deleted Packs.
+    pub fn retain(&mut self, paths: &HashSet<&Path>) {
+        let len = self.packs.len();
+        self.packs.retain(|path, _| paths.contains(path.as_path()));
+        self.dirty |= len != self.packs.len();
+    }
+
+    fn path(game: &GameInfo) -> Result<PathBuf> {
+        Ok(pack_cache_path()?.join(format!("pack_cache_{}.json", game.game_key_name())))
+    }
+}
+
+impl CachedPack {
+
+    /// This function reads the header of a Pack, and its dependencies if it declares any.
+    fn read(path: &Path, size: u64, modified: u64) -> Result<Self> {
+        let _span = span_with("read_pack_header", path.to_string_lossy());
+        let header = PackHeader::read(path)?;
+
+        // Packs we can't get the dependencies from are treated as having none, so we don't retry them on every discovery.
+        let dependencies = if *header.pack_index_count() > 0 {
+            PackView::open(path)
+                .and_then(|view| Ok(view.dependencies()?.into_iter().map(|dependency| dependency.into_owned()).collect()))
+                .unwrap_or_default()
+        } else {
+            vec![]
+        };
+
+        Ok(Self {
+            size,
+            modified,
+            header,
+            dependencies: Some(dependencies),
+            content_hash: None,
+            previous_hash: None,
+        })
+    }
+
+    /// This function returns if the entry is still valid for a Pack with the provided stamp.
+    ///
+    /// Entries cached before dependencies were cached are also invalid if their Pack has any, so they get read again once.
+    fn is_valid(&self, size: u64, modified: u64) -> bool {
+        self.size == size && self.modified == modified && (self.dependencies.is_some() || *self.header.pack_index_count() == 0)
+    }
+
+    /// This function returns the hash to compare the next version of this Pack with.
+    fn into_previous_hash(self) -> Option<ContentHash> {
+        self.content_hash.or(self.previous_hash)
+    }
+}
+
+/// This function returns the size and modification time (as nanoseconds since the unix epoch) of a file.
+pub fn file_stamp(path: &Path) -> Result<(u64, u64)> {
+    let metadata = path.metadata()?;
+    let modified = metadata.modified()?.duration_since(UNIX_EPOCH)?.as_nanos() as u64;
+    Ok((metadata.len(), modified))
+}
@@ -0,0 +1,339 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Background hashing of the contents of Packs.
+//!
+//! Steam bumps the modification time of files it doesn't change, so size and time are only good to know a Pack *may* have changed.
+//! To know if it actually did, Packs get hashed with xxh3 in fixed-size chunks, and the chunk hashes are kept in the Pack cache.
+//! Comparing them with the ones of the previous version tells us not only if the Pack changed, but also which parts of it.
+//! Updates that only touch the data of a Pack keep the same files, so if its indexes are unchanged its conflicts don't need re-indexing.
+//!
+//! The header and indexes are hashed first. If they match the previous version and the size didn't change, the Pack is taken as
+//! unchanged and the rest is not read: that's what a bumped modification time looks like, and checking it costs only the indexes.
+//!
+//! Hashing runs on a small dedicated pool, throttled to a shared bytes-per-second budget, so it never fights the game for the disk.
+
+use anyhow::Result;
+use getset::*;
+use lazy_static::lazy_static;
+use rayon::prelude::*;
+use rayon::{ThreadPool, ThreadPoolBuilder};
+use serde::{Deserialize, Serialize};
+use xxhash_rust::xxh3::xxh3_64;
+
+use std::fs::File;
+use std::io::Read;
+use std::ops::Range;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use rpfm_lib::integrations::log::*;
+
+use crate::mod_manager::pack_cache::file_stamp;
+use crate::mod_manager::pack_header::PackHeader;
+use crate::mod_manager::pack_view::indexes_end;
+
+/// Size of the chunks Packs are hashed in.
+pub const CHUNK_SIZE: usize = 16 * 1024 * 1024;
+
+/// Max amount of bytes per second all the hashing threads together can read from disk.
+const HASHING_BUDGET: u64 = 96 * 1024 * 1024;
+
+/// Amount of threads hashing Packs. Disks are the bottleneck here, not the cpu.
+const HASHING_THREADS: usize = 2;
+
+lazy_static! {
+    static ref HASHING_POOL: ThreadPool = ThreadPoolBuilder::new()
+        .num_threads(HASHING_THREADS)
+        .thread_name(|index| format!("hashing_{index}"))
+        .build()
+        .expect("Failed to build the hashing thread pool.");
+}
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Hash of the contents of a Pack.
+#[derive(Clone, Debug, Default, PartialEq, Eq, Getters, Serialize, Deserialize)]
+#[getset(get = "pub")]
+pub struct ContentHash {
+
+    // Hash of the chunk hashes, to compare entire Packs in one go.
+    hash: u64,
+
+    // Size of the Pack hashed. Zero for hashes saved before we kept it.
+    #[serde(default)]
+    size: u64,
+
+    // Hash of each chunk of CHUNK_SIZE bytes of the Pack, in order. The last one may be smaller.
+    chunks: Vec<u64>,
+}
+
+/// A Pack to hash, with the stamp it had when it was queued.
+#[derive(Clone, Debug)]
+pub struct HashRequest {
+    pub path: PathBuf,
+    pub size: u64,
+    pub modified: u64,
+
+    // Hash of the previous version of the Pack, if we had one.
+    pub previous: Option<ContentHash>,
+}
+
+#[derive(Clone, Debug, Getters)]
+#[getset(get = "pub")]
+pub struct HashResult {
+    path: PathBuf,
+    size: u64,
+    modified: u64,
+    hash: ContentHash,
+
+    // If the header or indexes changed since the previous version, so the files in the Pack may be different.
+    indexes_changed: Option<bool>,
+}
+
+/// Handle to the hashing thread.
+#[derive(Debug)]
+pub struct PackHasher {
+    sender: Sender<(u64, Vec<HashRequest>)>,
+    receiver: Receiver<HashResult>,
+
+    // Packs queued but not yet hashed or skipped.
+    pending: Arc<AtomicUsize>,
+
+    // Requests from older generations are skipped. Increased every time the queue is cleared.
+    generation: Arc<AtomicU64>,
+}
+
+/// Shared budget of the hashing threads.
+struct Throttle {
+    budget: u64,
+    state: Mutex<(Instant, u64)>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl ContentHash {
+
+    /// This function returns the ranges of bytes that differ between this version of a Pack and a previous one.
+    ///
+    /// If the Pack grew or shrank, everything past the end of the shortest version counts as changed.
+    pub fn changed_ranges(&self, previous: &Self) -> Vec<Range<u64>> {
+        let mut ranges: Vec<Range<u64>> = vec![];
+        let chunks = self.chunks.len().max(previous.chunks.len());
+        for index in 0..chunks {
+            if self.chunks.get(index) != previous.chunks.get(index) {
+                let start = (index * CHUNK_SIZE) as u64;
+                let end = start + CHUNK_SIZE as u64;
+                match ranges.last_mut() {
+                    Some(last) if last.end == start => last.end = end,
+                    _ => ranges.push(start..end),
+                }
+            }
+        }
+
+        ranges
+    }
+}
+
+impl PackHasher {
+
+    /// This function starts the hashing thread.
+    pub fn spawn() -> Self {
+        let (sender, requests) = channel::<(u64, Vec<HashRequest>)>();
+        let (results, receiver) = channel();
+        let pending = Arc::new(AtomicUsize::new(0));
+        let generation = Arc::new(AtomicU64::new(0));
+
+        let thread_pending = pending.clone();
+        let thread_generation = generation.clone();
+        thread::spawn(move || {
+            let throttle = Throttle::new(HASHING_BUDGET);
+            let results = Mutex::new(results);
+            while let Ok((request_generation, batch)) = requests.recv() {
+                HASHING_POOL.install(|| batch.into_par_iter().for_each(|request| {
+                    if request_generation == thread_generation.load(Ordering::SeqCst) {
+                        match hash_pack(&request, &throttle, &thread_generation, request_generation) {
+                            Ok(Some(result)) => { let _ = results.lock().unwrap().send(result); },
+                            Ok(None) => {},
+
+                            // Packs that change mid-hash fail here. They'll be requeued once the watcher notices them.
+                            Err(error) => info!("Pack {} not hashed: {}", request.path.to_string_lossy(), error),
+                        }
+                    }
+
+                    thread_pending.fetch_sub(1, Ordering::SeqCst);
+                }));
+            }
+        });
+
+        Self {
+            sender,
+            receiver,
+            pending,
+            generation,
+        }
+    }
+
+    /// This function queues Packs to be hashed.
+    pub fn queue(&self, requests: Vec<HashRequest>) {
+        if requests.is_empty() {
+            return;
+        }
+
+        let len = requests.len();
+        self.pending.fetch_add(len, Ordering::SeqCst);
+        if self.sender.send((self.generation.load(Ordering::SeqCst), requests)).is_err() {
+            self.pending.fetch_sub(len, Ordering::SeqCst);
+            error!("Hashing thread is gone. Pack changes will not be detected.");
+        }
+    }
+
+    /// This function drops everything queued, and stops whatever is being hashed as soon as possible.
+    pub fn clear(&self) {
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        while self.receiver.try_recv().is_ok() {}
+    }
+
+    /// This function returns if there are Packs waiting to be hashed.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns all the hashes finished since the last call. Never blocks.
+    pub fn results(&self) -> Vec<HashResult> {
+        self.receiver.try_iter().collect()
+    }
+}
+
+impl Throttle {
+    fn new(budget: u64) -> Self {
+        Self {
+            budget,
+            state: Mutex::new((Instant::now(), 0)),
+        }
+    }
+
+    /// This function accounts for bytes read, sleeping as long as needed to stay within the budget.
+    fn consume(&self, bytes: u64) {
+        let wait = {
+            let mut state = self.state.lock().unwrap();
+
+            // If we're way behind schedule we've been idle. Start counting again, or the idle time becomes credit for a burst.
+            let expected = Duration::from_millis(state.1 * 1000 / self.budget);
+            if state.0.elapsed() > expected + Duration::from_secs(1) {
+                *state = (Instant::now(), 0);
+            }
+
+            state.1 += bytes;
+            let expected = Duration::from_millis(state.1 * 1000 / self.budget);
+            expected.checked_sub(state.0.elapsed())
+        };
+
+        if let Some(wait) = wait {
+            thread::sleep(wait);
+        }
+    }
+}
+
+/// This function hashes a Pack in chunks, returning `None` if the request got cancelled mid-way.
+///
+/// If the chunks up to the end of the indexes match the previous version and the size is the same, it stops there and keeps
+/// the previous hash.
+fn hash_pack(request: &HashRequest, throttle: &Throttle, generation: &AtomicU64, request_generation: u64) -> Result<Option<HashResult>> {
+    let mut file = File::open(&request.path)?;
+    let mut buffer = vec![0; CHUNK_SIZE];
+    let mut chunks = Vec::with_capacity((request.size as usize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    let mut data_start = None;
+    let mut unchanged = None;
+
+    loop {
+        if generation.load(Ordering::SeqCst) != request_generation {
+            return Ok(None);
+        }
+
+        let len = read_chunk(&mut file, &mut buffer)?;
+        if len == 0 {
+            break;
+        }
+
+        // The header is in the first chunk, so we get where the indexes end without reading it again.
+        if chunks.is_empty() {
+            data_start = PackHeader::decode(&buffer[..len]).ok().map(|header| indexes_end(&header));
+        }
+
+        chunks.push(xxh3_64(&buffer[..len]));
+        throttle.consume(len as u64);
+
+        // Check it once, as soon as we have the chunks covering the header and indexes.
+        if let (Some(previous), Some(data_start)) = (&request.previous, data_start) {
+            let index_chunks = ((data_start as usize + CHUNK_SIZE - 1) / CHUNK_SIZE).max(1);
+            if chunks.len() == index_chunks && previous.size == request.size && previous.chunks.starts_with(&chunks) {
+                unchanged = Some(previous.clone());
+                break;
+            }
+        }
+    }
+
+    // If the file changed while we were reading it, this hash is of nothing in particular.
+    if file_stamp(&request.path)? != (request.size, request.modified) {
+        return Ok(None);
+    }
+
+    if let Some(hash) = unchanged {
+        return Ok(Some(HashResult {
+            path: request.path.to_path_buf(),
+            size: request.size,
+            modified: request.modified,
+            hash,
+            indexes_changed: Some(false),
+        }));
+    }
+
+    let hash_data = chunks.iter().flat_map(|chunk| chunk.to_le_bytes()).collect::<Vec<_>>();
+    let hash = ContentHash {
+        hash: xxh3_64(&hash_data),
+        size: request.size,
+        chunks,
+    };
+
+    // If we can't know where the indexes end, treat any change as a change in them.
+    let indexes_changed = request.previous.as_ref().map(|previous| match data_start {
+        Some(data_start) => hash.changed_ranges(previous).iter().any(|range| range.start < data_start),
+        None => previous.hash != hash.hash,
+    });
+    Ok(Some(HashResult {
+        path: request.path.to_path_buf(),
+        size: request.size,
+        modified: request.modified,
+        hash,
+        indexes_changed,
+    }))
+}
+
+/// This function fills the buffer as much as possible, returning how many bytes were read. Only returns less at the end of the file.
+fn read_chunk(file: &mut File, buffer: &mut [u8]) -> Result<usize> {
+    let mut len = 0;
+    while len < buffer.len() {
+        match file.read(&mut buffer[len..])? {
+            0 => break,
+            read => len += read,
+        }
+    }
+
+    Ok(len)
+}
@@ -0,0 +1,102 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Cheap probe over the header of a Pack.
+//!
+//! Parsing a Pack with `Pack::read_and_merge` reads and decodes its entire file index. When all we need
+//! is to know what kind of Pack a file is, that's a massive waste, so this reads only the start of the header.
+
+use anyhow::{anyhow, Result};
+use getset::*;
+use serde::{Deserialize, Serialize};
+
+use std::fs::File;
+use std::io::Read;
+use std::path::Path;
+
+use rpfm_lib::games::pfh_file_type::PFHFileType;
+
+/// Amount of bytes every PFH header shares, no matter its version: preamble, type + bitmask,
+/// pack index count, pack index size, file index count and file index size.
+pub const HEADER_PROBE_SIZE: usize = 24;
+
+/// Mask to separate the file type from the bitmask in the second field of the header.
+const FILE_TYPE_MASK: u32 = 0xF;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Getters, Serialize, Deserialize)]
+#[getset(get = "pub")]
+pub struct PackHeader {
+
+    // Numeric part of the preamble (0 for PFH0, 5 for PFH5,...).
+    pfh_version: u32,
+
+    // Raw PFHFileType of the Pack.
+    pfh_file_type: u32,
+
+    // Raw PFHFlags of the Pack.
+    bitmask: u32,
+
+    // Amount and size in bytes of the Pack's dependencies.
+    pack_index_count: u32,
+    pack_index_size: u32,
+
+    // Amount and size in bytes of the files inside the Pack.
+    file_count: u32,
+    file_index_size: u32,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl PackHeader {
+
+    /// This function reads the header of the Pack at the provided path, without touching anything past it.
+    pub fn read(path: &Path) -> Result<Self> {
+        let mut data = [0; HEADER_PROBE_SIZE];
+        let mut file = File::open(path)?;
+        file.read_exact(&mut data).map_err(|_| anyhow!("File {} is too small to be a Pack.", path.to_string_lossy()))?;
+
+        Self::decode(&data).map_err(|error| anyhow!("Error reading the header of {}: {}", path.to_string_lossy(), error))
+    }
+
+    /// This function decodes a header from the first [HEADER_PROBE_SIZE] bytes of a Pack.
+    pub fn decode(data: &[u8]) -> Result<Self> {
+        if data.len() < HEADER_PROBE_SIZE || &data[0..3] != b"PFH" || !data[3].is_ascii_digit() {
+            return Err(anyhow!("Invalid PFH preamble."));
+        }
+
+        let pack_type = read_u32(data, 4);
+
+        Ok(Self {
+            pfh_version: (data[3] - b'0') as u32,
+            pfh_file_type: pack_type & FILE_TYPE_MASK,
+            bitmask: pack_type & !FILE_TYPE_MASK,
+            pack_index_count: read_u32(data, 8),
+            pack_index_size: read_u32(data, 12),
+            file_count: read_u32(data, 16),
+            file_index_size: read_u32(data, 20),
+        })
+    }
+
+    /// This function returns if the Pack is of type Mod, the only type we care about when looking for mods.
+    pub fn is_mod(&self) -> bool {
+        self.pfh_file_type == PFHFileType::Mod as u32
+    }
+}
+
+/// Bounds must be checked by the caller.
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes([data[offset], data[offset + 1], data[offset + 2], data[offset + 3]])
+}
@@ -0,0 +1,236 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Zero-copy view over the contents of a Pack.
+//!
+//! Packs are memory-mapped instead of read into buffers, and everything returned by a view (dependencies, file paths, file data)
+//! borrows straight from the map. Only the pages actually touched get loaded, so going through the index of a multi-GB Pack costs
+//! as much as the index itself, and repeated scans reuse whatever the OS already has in its page cache.
+//!
+//! Like the header probe, this avoids `Pack::read_and_merge`, as we don't want a full `Pack` for each mod just to know what's inside it.
+
+use anyhow::{anyhow, Result};
+use getset::*;
+use memmap2::Mmap;
+
+use std::borrow::Cow;
+use std::fs::File;
+use std::ops::Range;
+use std::path::Path;
+
+use crate::mod_manager::pack_header::{PackHeader, HEADER_PROBE_SIZE};
+
+/// The index is encrypted. We don't support reading these.
+const HAS_ENCRYPTED_INDEX: u32 = 0x0000_0080;
+
+/// Each entry of the file index has a timestamp.
+const HAS_INDEX_WITH_TIMESTAMPS: u32 = 0x0000_0040;
+
+/// The header has 20 extra bytes, and the file index has no compression flags.
+const HAS_EXTENDED_HEADER: u32 = 0x0000_0100;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Memory-mapped view over a Pack.
+///
+/// Keep these short-lived: if the Pack gets replaced on disk (like Steam does when updating a mod) while mapped,
+/// the view keeps seeing the old file, and if it gets truncated in place, reading from it may crash the program.
+#[derive(Debug, Getters)]
+#[getset(get = "pub")]
+pub struct PackView {
+    header: PackHeader,
+
+    #[getset(skip)]
+    mmap: Mmap,
+
+    // Ranges of the map with the pack index, the file index, and the data of the files.
+    #[getset(skip)]
+    pack_index: Range<usize>,
+    #[getset(skip)]
+    file_index: Range<usize>,
+    #[getset(skip)]
+    data_start: usize,
+}
+
+/// Entry of the file index of a Pack, borrowing from its view.
+#[derive(Clone, Debug, Getters)]
+#[getset(get = "pub")]
+pub struct PackedFileEntry<'a> {
+
+    // Path of the file inside the Pack, as stored in it.
+    path: Cow<'a, str>,
+
+    // Position and size of the data of the file, relative to the start of the Pack.
+    offset: usize,
+    size: u32,
+
+    // If the data is compressed. Always false for Packs that don't support compression.
+    is_compressed: bool,
+}
+
+/// Iterator over the file index of a Pack.
+pub struct PackedFileEntries<'a> {
+    index: &'a [u8],
+    timestamps: bool,
+    compression: bool,
+    remaining: u32,
+    offset: usize,
+    data_offset: usize,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl PackView {
+
+    /// This function maps the Pack at the provided path and checks its index is complete. Nothing past the header is read yet.
+    pub fn open(path: &Path) -> Result<Self> {
+        let file = File::open(path)?;
+
+        // SAFETY: the map is read-only and short-lived. See the docs of the struct about the file changing under us.
+        let mmap = unsafe { Mmap::map(&file)? };
+        if mmap.len() < HEADER_PROBE_SIZE {
+            return Err(anyhow!("File {} is too small to be a Pack.", path.to_string_lossy()));
+        }
+
+        let header = PackHeader::decode(&mmap[..HEADER_PROBE_SIZE]).map_err(|error| anyhow!("Error reading the header of {}: {}", path.to_string_lossy(), error))?;
+        if header.bitmask() & HAS_ENCRYPTED_INDEX != 0 {
+            return Err(anyhow!("The index of {} is encrypted, which is not supported.", path.to_string_lossy()));
+        }
+
+        let pack_index_start = header_size(&header);
+        let file_index_start = pack_index_start + *header.pack_index_size() as usize;
+        let data_start = file_index_start + *header.file_index_size() as usize;
+        if data_start > mmap.len() {
+            return Err(anyhow!("The index of {} is incomplete.", path.to_string_lossy()));
+        }
+
+        Ok(Self {
+            header,
+            mmap,
+            pack_index: pack_index_start..file_index_start,
+            file_index: file_index_start..data_start,
+            data_start,
+        })
+    }
+
+    /// This function returns the names of the Packs this Pack depends on.
+    pub fn dependencies(&self) -> Result<Vec<Cow<'_, str>>> {
+        let index = &self.mmap[self.pack_index.clone()];
+        let mut offset = 0;
+        let mut dependencies = Vec::with_capacity(*self.header.pack_index_count() as usize);
+        for _ in 0..*self.header.pack_index_count() {
+            dependencies.push(read_string(index, &mut offset)?);
+        }
+
+        Ok(dependencies)
+    }
+
+    /// This function returns an iterator over the file index of the Pack. Each entry is decoded as it's reached.
+    pub fn files(&self) -> PackedFileEntries<'_> {
+        PackedFileEntries {
+            index: &self.mmap[self.file_index.clone()],
+            timestamps: self.header.bitmask() & HAS_INDEX_WITH_TIMESTAMPS != 0,
+            compression: matches!(self.header.pfh_version(), 5 | 6) && self.header.bitmask() & HAS_EXTENDED_HEADER == 0,
+            remaining: *self.header.file_count(),
+            offset: 0,
+            data_offset: self.data_start,
+        }
+    }
+
+    /// This function returns the raw data of a file, as stored in the Pack.
+    pub fn data(&self, entry: &PackedFileEntry) -> Result<&[u8]> {
+        self.mmap.get(entry.offset..entry.offset + entry.size as usize).ok_or_else(|| anyhow!("Data of {} is out of bounds.", entry.path))
+    }
+}
+
+impl<'a> Iterator for PackedFileEntries<'a> {
+    type Item = Result<PackedFileEntry<'a>>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.remaining == 0 {
+            return None;
+        }
+
+        self.remaining -= 1;
+
+        let size = match self.index.get(self.offset..self.offset + 4) {
+            Some(size) => u32::from_le_bytes([size[0], size[1], size[2], size[3]]),
+            None => {
+                self.remaining = 0;
+                return Some(Err(anyhow!("Truncated file index.")));
+            }
+        };
+        self.offset += 4;
+
+        if self.timestamps {
+            self.offset += 4;
+        }
+
+        let is_compressed = if self.compression {
+            self.offset += 1;
+            self.index.get(self.offset - 1).map(|flag| *flag != 0).unwrap_or(false)
+        } else {
+            false
+        };
+
+        let path = match read_string(self.index, &mut self.offset) {
+            Ok(path) => path,
+            Err(error) => {
+                self.remaining = 0;
+                return Some(Err(error));
+            }
+        };
+
+        let offset = self.data_offset;
+        self.data_offset += size as usize;
+
+        Some(Ok(PackedFileEntry {
+            path,
+            offset,
+            size,
+            is_compressed,
+        }))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        (0, Some(self.remaining as usize))
+    }
+}
+
+/// This function returns the size of the full header of a Pack, which depends on its version and flags.
+pub fn header_size(header: &PackHeader) -> usize {
+    match header.pfh_version() {
+        6 => 308,
+        5 | 4 if header.bitmask() & HAS_EXTENDED_HEADER != 0 => 48,
+        5 | 4 => 28,
+        3 | 2 => 32,
+        _ => 24,
+    }
+}
+
+/// This function returns where the indexes of a Pack end, and its data starts.
+pub fn indexes_end(header: &PackHeader) -> u64 {
+    header_size(header) as u64 + *header.pack_index_size() as u64 + *header.file_index_size() as u64
+}
+
+/// This function reads a null-terminated string, leaving the offset after the terminator.
+///
+/// Only strings that are not valid UTF-8 get copied.
+fn read_string<'a>(data: &'a [u8], offset: &mut usize) -> Result<Cow<'a, str>> {
+    let start = (*offset).min(data.len());
+    let end = data[start..].iter().position(|byte| *byte == 0).map(|len| start + len).ok_or_else(|| anyhow!("Unterminated string in index."))?;
+    *offset = end + 1;
+
+    Ok(String::from_utf8_lossy(&data[start..end]))
+}
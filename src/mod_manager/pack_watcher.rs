@@ -0,0 +1,173 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Helpers to keep the game config in sync with the pack folders while the game is selected.
+//!
+//! The ui watches the folders returned here and, when one of them changes, only that folder gets compared
+//! against what the game config knows about it, through a [FolderIndex] of the known packs by folder. Nothing else is
+//! touched, so an update is as cheap as the folder is big, no matter how many mods the game has.
+
+use getset::Getters;
+
+use std::collections::{HashMap, HashSet};
+use std::fs::read_dir;
+use std::path::{Path, PathBuf};
+
+use crate::integrations::GameConfig;
+use crate::mod_manager::pack_cache::PackCache;
+
+const PACK_EXTENSION: &str = "pack";
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Folders to watch for pack changes.
+#[derive(Debug, Default)]
+pub struct PackFolders {
+
+    // Folders with packs of the game, data and content ones.
+    pub folders: Vec<PathBuf>,
+
+    // Folders with a subfolder per workshop mod, so new mods show up as new subfolders in them.
+    pub content_roots: Vec<PathBuf>,
+}
+
+/// Packs the game config knows about, by the folder they're in.
+///
+/// Built once per game switch, and kept in sync as the watcher adds and removes packs.
+#[derive(Debug, Default)]
+pub struct FolderIndex {
+    folders: HashMap<PathBuf, HashSet<PathBuf>>,
+}
+
+/// Differences between the packs in a folder and the ones the game config has in it.
+#[derive(Debug, Default, Getters)]
+#[getset(get = "pub")]
+pub struct PackChanges {
+
+    // Packs not known by the game config. Not all of them are mods.
+    added: Vec<PathBuf>,
+
+    // Known packs that changed on disk since they were last probed.
+    updated: Vec<PathBuf>,
+
+    // Known packs that no longer exist.
+    removed: Vec<PathBuf>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl FolderIndex {
+
+    /// This function indexes the paths of all the mods of the provided game config.
+    pub fn build(game_config: &GameConfig) -> Self {
+        let mut index = Self::default();
+        for path in game_config.mods().values().flat_map(|modd| modd.paths().iter()) {
+            index.insert(path);
+        }
+
+        index
+    }
+
+    pub fn insert(&mut self, path: &Path) {
+        if let Some(folder) = path.parent() {
+            self.folders.entry(folder.to_path_buf()).or_default().insert(path.to_path_buf());
+        }
+    }
+
+    pub fn remove(&mut self, path: &Path) {
+        if let Some(folder) = path.parent() {
+            if let Some(paths) = self.folders.get_mut(folder) {
+                paths.remove(path);
+                if paths.is_empty() {
+                    self.folders.remove(folder);
+                }
+            }
+        }
+    }
+
+    /// This function compares the packs currently in a folder with the ones known in it.
+    pub fn changes(&self, pack_cache: &PackCache, folder: &Path, current: &[PathBuf]) -> PackChanges {
+        let known = self.folders.get(folder);
+        let mut changes = PackChanges::default();
+        for path in current {
+            if !known.map_or(false, |known| known.contains(path)) {
+                changes.added.push(path.to_path_buf());
+            } else if pack_cache.pack(path).is_none() {
+                changes.updated.push(path.to_path_buf());
+            }
+        }
+
+        if let Some(known) = known {
+            let current = current.iter().map(|path| path.as_path()).collect::<HashSet<_>>();
+            changes.removed = known.iter()
+                .filter(|path| !current.contains(path.as_path()))
+                .cloned()
+                .collect();
+        }
+
+        changes
+    }
+}
+
+/// This function returns the folders that need to be watched to notice changes in the provided packs.
+///
+/// That's the folders containing them, plus the content folders themselves, so new workshop mods are noticed too.
+pub fn folders_to_watch(data_paths: &[PathBuf], content_paths: &[PathBuf]) -> PackFolders {
+    let mut content_roots = content_paths.iter()
+        .filter_map(|path| path.parent()?.parent())
+        .map(|path| path.to_path_buf())
+        .collect::<Vec<_>>();
+
+    content_roots.sort();
+    content_roots.dedup();
+
+    let mut folders = data_paths.iter()
+        .chain(content_paths.iter())
+        .filter_map(|path| path.parent())
+        .map(|path| path.to_path_buf())
+        .chain(content_roots.iter().cloned())
+        .collect::<Vec<_>>();
+
+    folders.sort();
+    folders.dedup();
+
+    PackFolders {
+        folders,
+        content_roots,
+    }
+}
+
+/// This function returns the subfolders of the provided folder not already in the watched list.
+///
+/// Used to find workshop mods downloaded after the folders to watch were decided, so only call it on content roots.
+pub fn new_subfolders(folder: &Path, watched: &HashSet<PathBuf>) -> Vec<PathBuf> {
+    match read_dir(folder) {
+        Ok(entries) => entries.flatten()
+            .map(|entry| entry.path())
+            .filter(|path| path.is_dir() && !watched.contains(path))
+            .collect(),
+        Err(_) => vec![],
+    }
+}
+
+/// This function returns the packs directly inside the provided folder. A folder that no longer exists has no packs.
+pub fn packs_in_folder(folder: &Path) -> Vec<PathBuf> {
+    match read_dir(folder) {
+        Ok(entries) => entries.flatten()
+            .map(|entry| entry.path())
+            .filter(|path| path.extension().map(|extension| extension == PACK_EXTENSION).unwrap_or(false) && path.is_file())
+            .collect(),
+        Err(_) => vec![],
+    }
+}
@@ -0,0 +1,243 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Background prewarm of the enabled Packs, so the game starts with them in the OS page cache.
+//!
+//! On a cold start, the game spends most of its load time reading Packs from disk. We know which Packs it's going to read and
+//! in which order before it starts, so once the mods are chosen, a thread reads them ahead. First the header and indexes of
+//! every Pack, as the game reads all of them on start, then their data in load order, until the configured budget runs out.
+//!
+//! Plain sequential reads are used instead of OS readahead hints, as they work the same on every OS and the bytes read can be
+//! counted against the budget. New requests cancel the one being read, so changing mods never queues passes over old lists.
+
+use anyhow::Result;
+use getset::*;
+
+use std::fs::File;
+use std::io::{Read, Seek, SeekFrom};
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use rpfm_lib::integrations::log::*;
+
+use crate::mod_manager::pack_header::PackHeader;
+use crate::mod_manager::pack_view::indexes_end;
+use crate::profiling::span_with;
+
+/// Size of the reads done to prewarm a Pack.
+const PREWARM_CHUNK_SIZE: usize = 4 * 1024 * 1024;
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// Summary of a finished prewarm pass.
+#[derive(Clone, Debug, Getters)]
+#[getset(get = "pub")]
+pub struct PrewarmReport {
+
+    // Amount of Packs with at least their indexes read.
+    packs: usize,
+
+    // Bytes read from all of them.
+    bytes: u64,
+
+    elapsed: Duration,
+}
+
+/// Handle to the prewarm thread.
+#[derive(Debug)]
+pub struct Prewarmer {
+    sender: Sender<(u64, Vec<PathBuf>, u64)>,
+    receiver: Receiver<PrewarmReport>,
+
+    // Passes queued but not yet finished or skipped.
+    pending: Arc<AtomicUsize>,
+
+    // Passes from older generations are stopped. Increased with every new pass.
+    generation: Arc<AtomicU64>,
+
+    // Packs and budget of the last pass requested, so saving the same mods again doesn't read them again.
+    last: Mutex<Option<(Vec<PathBuf>, u64)>>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl Prewarmer {
+
+    /// This function starts the prewarm thread.
+    pub fn spawn() -> Self {
+        let (sender, requests) = channel::<(u64, Vec<PathBuf>, u64)>();
+        let (results, receiver) = channel();
+        let pending = Arc::new(AtomicUsize::new(0));
+        let generation = Arc::new(AtomicU64::new(0));
+
+        let thread_pending = pending.clone();
+        let thread_generation = generation.clone();
+        thread::Builder::new().name("prewarm".to_owned()).spawn(move || {
+            while let Ok((request_generation, paths, budget)) = requests.recv() {
+                if request_generation == thread_generation.load(Ordering::SeqCst) {
+                    if let Some(report) = prewarm_packs(&paths, budget, &thread_generation, request_generation) {
+                        info!("Prewarmed {} bytes of {} packs in {} ms.", report.bytes, report.packs, report.elapsed.as_millis());
+                        let _ = results.send(report);
+                    }
+                }
+
+                thread_pending.fetch_sub(1, Ordering::SeqCst);
+            }
+        }).expect("Failed to start the prewarm thread.");
+
+        Self {
+            sender,
+            receiver,
+            pending,
+            generation,
+            last: Mutex::new(None),
+        }
+    }
+
+    /// This function prewarms the provided Packs, in the order they're loaded, reading no more than `budget` bytes.
+    ///
+    /// Whatever pass was running is stopped. Returns false if these are the same Packs and budget of the last pass, as those
+    /// are still warm, so nothing was queued.
+    pub fn prewarm(&self, paths: Vec<PathBuf>, budget: u64) -> bool {
+        let mut last = self.last.lock().unwrap();
+        if paths.is_empty() || last.as_ref().map_or(false, |(last_paths, last_budget)| *last_paths == paths && *last_budget == budget) {
+            return false;
+        }
+
+        *last = Some((paths.clone(), budget));
+
+        let generation = self.generation.fetch_add(1, Ordering::SeqCst) + 1;
+        self.pending.fetch_add(1, Ordering::SeqCst);
+        if self.sender.send((generation, paths, budget)).is_err() {
+            self.pending.fetch_sub(1, Ordering::SeqCst);
+            error!("Prewarm thread is gone. Packs will not be prewarmed.");
+            return false;
+        }
+
+        true
+    }
+
+    /// This function stops whatever is being prewarmed as soon as possible, and forgets the last pass.
+    pub fn clear(&self) {
+        *self.last.lock().unwrap() = None;
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        while self.receiver.try_recv().is_ok() {}
+    }
+
+    /// This function returns if there's a pass waiting or running.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns the reports of the passes finished since the last call. Never blocks.
+    pub fn results(&self) -> Vec<PrewarmReport> {
+        self.receiver.try_iter().collect()
+    }
+}
+
+/// This function reads the indexes of the provided Packs, then their data, until `budget` bytes have been read.
+///
+/// Returns `None` if the pass got cancelled mid-way. Packs that can't be read are skipped, as the game will complain about them anyway.
+fn prewarm_packs(paths: &[PathBuf], budget: u64, generation: &AtomicU64, request_generation: u64) -> Option<PrewarmReport> {
+    let _span = span_with("prewarm_packs", format!("{} packs", paths.len()));
+    let start = Instant::now();
+    let mut buffer = vec![0; PREWARM_CHUNK_SIZE];
+    let mut left = budget;
+    let mut data = Vec::with_capacity(paths.len());
+
+    for path in paths {
+        let range = match index_range(path) {
+            Ok(range) => range,
+            Err(error) => {
+                info!("Pack {} not prewarmed: {}", path.to_string_lossy(), error);
+                continue;
+            }
+        };
+
+        let end = range.end.min(range.start + left);
+        let mut read = 0;
+        let result = touch(path, range.start..end, &mut buffer, generation, request_generation, &mut read);
+        left -= read;
+        match result {
+            Ok(true) => {},
+            Ok(false) => return None,
+            Err(error) => info!("Pack {} not prewarmed: {}", path.to_string_lossy(), error),
+        }
+
+        data.push((path, range.end));
+        if left == 0 {
+            break;
+        }
+    }
+
+    let packs = data.len();
+    for (path, data_start) in data {
+        if left == 0 {
+            break;
+        }
+
+        let mut read = 0;
+        let result = touch(path, data_start..data_start + left, &mut buffer, generation, request_generation, &mut read);
+        left -= read;
+        match result {
+            Ok(true) => {},
+            Ok(false) => return None,
+            Err(error) => info!("Pack {} not prewarmed: {}", path.to_string_lossy(), error),
+        }
+    }
+
+    Some(PrewarmReport {
+        packs,
+        bytes: budget - left,
+        elapsed: start.elapsed(),
+    })
+}
+
+/// This function returns the range of bytes of a Pack with its header and indexes, read from its header.
+fn index_range(path: &Path) -> Result<Range<u64>> {
+    let header = PackHeader::read(path)?;
+    Ok(0..indexes_end(&header))
+}
+
+/// This function reads the provided range of a file, stopping early at the end of the file. Returns false if the pass got
+/// cancelled mid-way.
+///
+/// Bytes read are added to `read` as they're read, so they count against the budget even if reading fails half-way.
+fn touch(path: &Path, range: Range<u64>, buffer: &mut [u8], generation: &AtomicU64, request_generation: u64, read: &mut u64) -> Result<bool> {
+    let mut file = File::open(path)?;
+    file.seek(SeekFrom::Start(range.start))?;
+
+    let mut done = 0;
+    while done < range.end - range.start {
+        if generation.load(Ordering::SeqCst) != request_generation {
+            return Ok(false);
+        }
+
+        let len = buffer.len().min((range.end - range.start - done) as usize);
+        match file.read(&mut buffer[..len])? {
+            0 => break,
+            len => {
+                done += len as u64;
+                *read += len as u64;
+            }
+        }
+    }
+
+    Ok(true)
+}
@@ -0,0 +1,323 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Preview images of Workshop mods, as thumbnails for the mod list.
+//!
+//! Images are downloaded once and kept as-is in an on-disk cache, one folder per game, keyed by Workshop id and update time,
+//! so updated mods get their new preview. Once a mod gets updated, the preview of its previous version is deleted by name,
+//! and previews of mods no longer installed are pruned when their game is selected.
+//!
+//! Decoding and scaling happen on a small pool, never on the GUI thread, and what comes out are raw RGBA thumbnails the size
+//! of a row. The lists only ask for the rows they show, and keep what they get in a size-bounded [ThumbnailLru].
+
+use anyhow::Result;
+use getset::*;
+use image::imageops::FilterType;
+use lazy_static::lazy_static;
+use rayon::{ThreadPool, ThreadPoolBuilder};
+
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::fs::{read, read_dir, remove_file};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::Arc;
+
+use rpfm_lib::integrations::log::*;
+
+use crate::integrations::mod_ids::ModHandle;
+use crate::integrations::write_atomic;
+use crate::settings_ui::thumbnail_cache_path;
+
+/// Amount of threads downloading and decoding previews.
+const THUMBNAIL_THREADS: usize = 2;
+
+lazy_static! {
+    static ref THUMBNAIL_POOL: ThreadPool = ThreadPoolBuilder::new()
+        .num_threads(THUMBNAIL_THREADS)
+        .thread_name(|index| format!("thumbnails_{index}"))
+        .build()
+        .expect("Failed to build the thumbnails thread pool.");
+}
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// A preview to turn into a thumbnail.
+#[derive(Clone, Debug)]
+pub struct ThumbnailRequest {
+
+    // Handle of the mod the thumbnail is for, in the game config it was requested for, and the key of its game.
+    pub handle: ModHandle,
+    pub game_key: String,
+    pub steam_id: String,
+    pub url: String,
+    pub time_updated: u64,
+
+    // Max width and height of the thumbnail, in pixels.
+    pub size: u32,
+}
+
+/// A decoded thumbnail, as tightly packed RGBA.
+#[derive(Debug, Getters)]
+#[getset(get = "pub")]
+pub struct Thumbnail {
+    handle: ModHandle,
+    width: u32,
+    height: u32,
+    rgba: Vec<u8>,
+
+    // Generation of the queue the thumbnail was requested in. Handles of older generations may belong to another game.
+    #[getset(skip)]
+    generation: u64,
+}
+
+/// Handle to the thumbnail pool.
+#[derive(Debug)]
+pub struct ThumbnailLoader {
+    sender: Sender<Thumbnail>,
+    receiver: Receiver<Thumbnail>,
+
+    // Thumbnails requested but not yet decoded or failed.
+    pending: Arc<AtomicUsize>,
+
+    // Requests from older generations are skipped. Increased every time the queue is cleared.
+    generation: Arc<AtomicU64>,
+}
+
+/// Least recently used cache of thumbnails, bounded by the memory they take.
+#[derive(Debug)]
+pub struct ThumbnailLru<T> {
+    budget: usize,
+    used: usize,
+    tick: u64,
+
+    // Thumbnails by mod handle, with their size and the tick they were last used at.
+    entries: HashMap<ModHandle, (T, usize, u64)>,
+
+    // Mod handles by the tick they were last used at, so the oldest is always the first one.
+    order: BTreeMap<u64, ModHandle>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl ThumbnailLoader {
+
+    pub fn new() -> Self {
+        let (sender, receiver) = channel();
+        Self {
+            sender,
+            receiver,
+            pending: Arc::new(AtomicUsize::new(0)),
+            generation: Arc::new(AtomicU64::new(0)),
+        }
+    }
+
+    /// This function queues a thumbnail to be loaded in the background.
+    pub fn load(&self, request: ThumbnailRequest) {
+        let sender = self.sender.clone();
+        let pending = self.pending.clone();
+        let generation = self.generation.clone();
+        let request_generation = generation.load(Ordering::SeqCst);
+
+        pending.fetch_add(1, Ordering::SeqCst);
+        THUMBNAIL_POOL.spawn(move || {
+            if request_generation == generation.load(Ordering::SeqCst) {
+                match load_thumbnail(&request, request_generation) {
+                    Ok(thumbnail) => { let _ = sender.send(thumbnail); },
+                    Err(error) => info!("Thumbnail of Workshop item {} not loaded: {}", request.steam_id, error),
+                }
+            }
+
+            pending.fetch_sub(1, Ordering::SeqCst);
+        });
+    }
+
+    /// This function deletes in the background the cached preview of a version of a Workshop mod, once it got updated.
+    pub fn remove_preview(&self, game_key: &str, steam_id: &str, time_updated: u64) {
+        let game_key = game_key.to_owned();
+        let steam_id = steam_id.to_owned();
+        THUMBNAIL_POOL.spawn(move || {
+            if let Ok(path) = preview_path(&game_key, &steam_id, time_updated) {
+                if path.is_file() {
+                    if let Err(error) = remove_file(&path) {
+                        info!("Old preview of Workshop item {} not deleted: {}", steam_id, error);
+                    }
+                }
+            }
+        });
+    }
+
+    /// This function deletes in the background the cached previews of a game that are not of the provided versions of its
+    /// Workshop mods, as (steam id, time updated).
+    pub fn prune_previews(&self, game_key: &str, keep: Vec<(String, u64)>) {
+        let game_key = game_key.to_owned();
+        THUMBNAIL_POOL.spawn(move || {
+            let folder = match thumbnail_cache_path() {
+                Ok(path) => path.join(&game_key),
+                Err(_) => return,
+            };
+
+            let entries = match read_dir(&folder) {
+                Ok(entries) => entries,
+                Err(_) => return,
+            };
+
+            let keep = keep.iter().map(|(steam_id, time_updated)| preview_name(steam_id, *time_updated)).collect::<HashSet<_>>();
+            for entry in entries.flatten() {
+                let name = entry.file_name();
+                let name = name.to_string_lossy();
+
+                // Temp files may be previews still being downloaded.
+                if !keep.contains(name.as_ref()) && !name.ends_with(".tmp") {
+                    if let Err(error) = remove_file(entry.path()) {
+                        info!("Preview {} of a mod no longer installed not deleted: {}", name, error);
+                    }
+                }
+            }
+        });
+    }
+
+    /// This function drops everything queued.
+    pub fn clear(&self) {
+        self.generation.fetch_add(1, Ordering::SeqCst);
+        while self.receiver.try_recv().is_ok() {}
+    }
+
+    /// This function returns if there are thumbnails being loaded.
+    pub fn is_busy(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) > 0
+    }
+
+    /// This function returns all the thumbnails loaded since the last call. Never blocks.
+    ///
+    /// Thumbnails that were already being loaded when the queue was cleared are dropped here.
+    pub fn results(&self) -> Vec<Thumbnail> {
+        let generation = self.generation.load(Ordering::SeqCst);
+        self.receiver.try_iter().filter(|thumbnail| thumbnail.generation == generation).collect()
+    }
+}
+
+impl<T> ThumbnailLru<T> {
+
+    /// This function creates an empty cache, that will hold at most `budget` bytes of thumbnails.
+    pub fn new(budget: usize) -> Self {
+        Self {
+            budget,
+            used: 0,
+            tick: 0,
+            entries: HashMap::new(),
+            order: BTreeMap::new(),
+        }
+    }
+
+    /// This function returns the thumbnail of a mod, marking it as recently used.
+    pub fn get(&mut self, handle: ModHandle) -> Option<&T> {
+        self.tick += 1;
+        let tick = self.tick;
+        let (thumbnail, _, last_used) = self.entries.get_mut(&handle)?;
+        let key = self.order.remove(last_used)?;
+        self.order.insert(tick, key);
+        *last_used = tick;
+
+        Some(thumbnail)
+    }
+
+    /// This function returns the thumbnail of a mod, without marking it as used.
+    pub fn peek(&self, handle: ModHandle) -> Option<&T> {
+        self.entries.get(&handle).map(|(thumbnail, _, _)| thumbnail)
+    }
+
+    /// This function adds the thumbnail of a mod, returning the handles of the mods evicted to make room for it.
+    pub fn insert(&mut self, handle: ModHandle, thumbnail: T, size: usize) -> Vec<ModHandle> {
+        self.remove(handle);
+
+        self.tick += 1;
+        self.used += size;
+        self.order.insert(self.tick, handle);
+        self.entries.insert(handle, (thumbnail, size, self.tick));
+
+        self.evict()
+    }
+
+    /// This function changes the budget of the cache, returning the handles of the mods evicted to fit in it.
+    pub fn set_budget(&mut self, budget: usize) -> Vec<ModHandle> {
+        self.budget = budget;
+        self.evict()
+    }
+
+    pub fn remove(&mut self, handle: ModHandle) {
+        if let Some((_, size, last_used)) = self.entries.remove(&handle) {
+            self.order.remove(&last_used);
+            self.used -= size;
+        }
+    }
+
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.order.clear();
+        self.used = 0;
+    }
+
+    /// This function drops the least recently used thumbnails until we're within budget.
+    fn evict(&mut self) -> Vec<ModHandle> {
+        let mut evicted = vec![];
+        while self.used > self.budget {
+            match self.order.keys().next().copied().and_then(|tick| self.order.remove(&tick)) {
+                Some(handle) => {
+                    if let Some((_, size, _)) = self.entries.remove(&handle) {
+                        self.used -= size;
+                    }
+
+                    evicted.push(handle);
+                }
+                None => break,
+            }
+        }
+
+        evicted
+    }
+}
+
+/// This function returns the thumbnail for a request, downloading the preview only if it's not in the disk cache.
+fn load_thumbnail(request: &ThumbnailRequest, generation: u64) -> Result<Thumbnail> {
+    let path = preview_path(&request.game_key, &request.steam_id, request.time_updated)?;
+    let data = if path.is_file() {
+        read(&path)?
+    } else {
+        let data = reqwest::blocking::get(&request.url)?.error_for_status()?.bytes()?.to_vec();
+        write_atomic(&path, &data)?;
+        data
+    };
+
+    let image = image::load_from_memory(&data)?;
+    let thumbnail = image.resize(request.size, request.size, FilterType::Triangle).to_rgba8();
+
+    Ok(Thumbnail {
+        handle: request.handle,
+        width: thumbnail.width(),
+        height: thumbnail.height(),
+        rgba: thumbnail.into_raw(),
+        generation,
+    })
+}
+
+/// This function returns the path of the cached preview of a version of a Workshop mod.
+fn preview_path(game_key: &str, steam_id: &str, time_updated: u64) -> Result<PathBuf> {
+    Ok(thumbnail_cache_path()?.join(game_key).join(preview_name(steam_id, time_updated)))
+}
+
+/// This function returns the file name of the cached preview of a version of a Workshop mod.
+fn preview_name(steam_id: &str, time_updated: u64) -> String {
+    format!("{}_{}", steam_id, time_updated)
+}
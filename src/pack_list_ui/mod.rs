@@ -8,36 +8,49 @@
 // https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
 //---------------------------------------------------------------------------//
 
+use qt_widgets::QAction;
 use qt_widgets::QGridLayout;
 use qt_widgets::QLineEdit;
 use qt_widgets::QMainWindow;
+use qt_widgets::QMenu;
 use qt_widgets::QTableView;
 use qt_widgets::QToolButton;
 
+use qt_gui::QFontMetrics;
 use qt_gui::QListOfQStandardItem;
 use qt_gui::QStandardItem;
 use qt_gui::QStandardItemModel;
 
-use qt_core::CaseSensitivity;
+use qt_core::ContextMenuPolicy;
 use qt_core::QBox;
 use qt_core::QPtr;
-use qt_core::QRegExp;
 use qt_core::QSortFilterProxyModel;
 use qt_core::QString;
 use qt_core::QTimer;
 use qt_core::QVariant;
 
+use cpp_core::CppBox;
+
 use anyhow::Result;
 use getset::*;
 
-use std::sync::Arc;
-
-use rpfm_lib::files::pack::Pack;
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap, HashSet};
+use std::ops::{Deref, DerefMut};
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, RwLock, RwLockWriteGuard};
 
-use rpfm_ui_common::locale::qtr;
+use rpfm_ui_common::locale::{qtr, qtre};
 use rpfm_ui_common::utils::*;
 
-use crate::integrations::GameConfig;
+use crate::integrations::{GameConfig, Mod, ProfileDiff};
+use crate::integrations::mod_ids::ModHandle;
+use crate::mod_manager::conflicts::PackConflicts;
+use crate::mod_manager::filter::{FilterIndex, FilterOptions, FILTER_DELAY, FILTER_ROLE, FILTER_VISIBLE};
+use crate::mod_manager::dependencies::DependencyGraph;
+use crate::mod_manager::load_order::{rule_links, load_order_key, order_keys, solve_load_order, solve_mods, OrderKey, SortKey};
+use crate::mod_manager::pack_cache::PackCache;
+use crate::profiling::span_with;
 
 use self::slots::PackListUISlots;
 
@@ -46,6 +59,24 @@ mod slots;
 const VIEW_DEBUG: &str = "ui_templates/filterable_table_widget.ui";
 const VIEW_RELEASE: &str = "ui/filterable_table_widget.ui";
 
+const COLUMN_NAME: i32 = 0;
+const COLUMN_PATH: i32 = 1;
+const COLUMN_LOAD_ORDER: i32 = 2;
+const COLUMN_LOCATION: i32 = 3;
+const COLUMN_CONFLICTS: i32 = 4;
+
+/// Amount of the longest texts of a column measured to size it.
+const COLUMN_WIDTH_SAMPLES: usize = 8;
+
+/// Space around the text of a cell, in pixels.
+const CELL_PADDING: i32 = 12;
+
+/// Max amount of rows a profile can change one by one. Past this, rebuilding the list is faster.
+const PROFILE_DIFF_ROWS_MAX: usize = 64;
+
+/// Name of the folder data packs are in. Anything else comes from the workshop.
+const DATA_FOLDER: &str = "data";
+
 //-------------------------------------------------------------------------------//
 //                              Enums & Structs
 //-------------------------------------------------------------------------------//
@@ -58,7 +89,61 @@ pub struct PackListUI {
     filter: QBox<QSortFilterProxyModel>,
     filter_line_edit: QPtr<QLineEdit>,
     filter_case_sensitive_button: QPtr<QToolButton>,
+    filter_regex_button: QPtr<QToolButton>,
+    filter_categories_button: QPtr<QToolButton>,
+    filter_paths_button: QPtr<QToolButton>,
+    filter_fuzzy_button: QPtr<QToolButton>,
     filter_timer: QBox<QTimer>,
+
+    // Timer to fill the rows that became visible, once the view is done scrolling or rebuilding.
+    visible_rows_timer: QBox<QTimer>,
+
+    context_menu: QBox<QMenu>,
+    pin: QPtr<QAction>,
+    unpin: QPtr<QAction>,
+    load_before: QPtr<QAction>,
+    load_after: QPtr<QAction>,
+    clear_rules: QPtr<QAction>,
+
+    // Rows of the model, in the same order. Their order keys are used to find where to insert packs without rebuilding the list.
+    #[getset(skip)]
+    rows: RwLock<PackRows>,
+
+    // Last known conflicts of each pack with conflicts. Kept across rebuilds, as the analyzer only reports changes.
+    conflicts: RwLock<HashMap<String, PackConflicts>>,
+
+    // Searchable fields of the packs in the list.
+    filter_index: RwLock<FilterIndex>,
+}
+
+/// A row of the list, with what it needs to fill its columns once it's shown.
+///
+/// Only the name and load order are set when rows are built. Path, location and conflicts are filled when the rows scroll into view.
+#[derive(Debug)]
+struct PackRow {
+    handle: ModHandle,
+    key: SortKey,
+    order: OrderKey,
+    path: PathBuf,
+    filled: bool,
+
+    // Load order shown in the row. Inserting or removing rows shifts the ones after them, so it's fixed when the row is shown.
+    load_order: usize,
+}
+
+/// The rows of the list, sorted by order key, with the order key of the row of each mod.
+///
+/// Order keys don't change when other rows are inserted or removed, so rows are found by a binary search over them, and
+/// nothing needs updating past the row that changed. Mods linked by rules or dependencies are kept linked both ways, so
+/// the group of any mod is found without looking at the rest.
+#[derive(Debug, Default)]
+struct PackRows {
+    rows: Vec<PackRow>,
+    positions: HashMap<ModHandle, OrderKey>,
+    links: HashMap<ModHandle, Vec<ModHandle>>,
+
+    // If the load order has cycles of rules. Groups with cycles are not solved the same on their own, so any change rebuilds the list.
+    cycles: bool,
 }
 
 //-------------------------------------------------------------------------------//
@@ -72,20 +157,49 @@ impl PackListUI {
 
         // Load the UI Template.
         let template_path = if cfg!(debug_assertions) { VIEW_DEBUG } else { VIEW_RELEASE };
-        let main_widget = load_template(main_window, template_path)?;
+        let main_widget = {
+            let _span = span_with("load_template", template_path);
+            load_template(main_window, template_path)?
+        };
 
         let table_view: QPtr<QTableView> = find_widget(&main_widget.static_upcast(), "table_view")?;
         let filter_line_edit: QPtr<QLineEdit> = find_widget(&main_widget.static_upcast(), "filter_line_edit")?;
         let filter_case_sensitive_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_case_sensitive_button")?;
+        let filter_regex_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_regex_button")?;
+        let filter_categories_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_categories_button")?;
+        let filter_paths_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_paths_button")?;
+        let filter_fuzzy_button: QPtr<QToolButton> = find_widget(&main_widget.static_upcast(), "filter_fuzzy_button")?;
+        filter_regex_button.set_tool_tip(&qtr("filter_regex"));
+        filter_categories_button.set_tool_tip(&qtr("filter_categories"));
+        filter_paths_button.set_tool_tip(&qtr("filter_paths"));
+        filter_fuzzy_button.set_tool_tip(&qtr("filter_fuzzy"));
 
         let model = QStandardItemModel::new_1a(&main_widget);
         let filter = QSortFilterProxyModel::new_1a(&main_widget);
         filter.set_source_model(&model);
+
+        // The proxy only checks the flag the filter index leaves in the first column of each row.
+        filter.set_filter_role(FILTER_ROLE);
         model.set_parent(&table_view);
         table_view.set_model(&filter);
 
         let filter_timer = QTimer::new_1a(&main_widget);
         filter_timer.set_single_shot(true);
+        filter_timer.set_interval(FILTER_DELAY);
+
+        let visible_rows_timer = QTimer::new_1a(&main_widget);
+        visible_rows_timer.set_single_shot(true);
+        visible_rows_timer.set_interval(0);
+
+        // Pins and rules are edited from the pack list, but they're saved in the game config, so the app connects them.
+        table_view.set_context_menu_policy(ContextMenuPolicy::CustomContextMenu);
+        let context_menu = QMenu::from_q_widget(&table_view);
+        let pin = context_menu.add_action_q_string(&qtr("load_order_pin"));
+        let unpin = context_menu.add_action_q_string(&qtr("load_order_unpin"));
+        context_menu.add_separator();
+        let load_before = context_menu.add_action_q_string(&qtr("load_order_load_before"));
+        let load_after = context_menu.add_action_q_string(&qtr("load_order_load_after"));
+        let clear_rules = context_menu.add_action_q_string(&qtr("load_order_clear_rules"));
 
         layout.add_widget_5a(&main_widget, 1, 1, 1, 1);
 
@@ -95,7 +209,21 @@ impl PackListUI {
             filter,
             filter_line_edit,
             filter_case_sensitive_button,
+            filter_regex_button,
+            filter_categories_button,
+            filter_paths_button,
+            filter_fuzzy_button,
             filter_timer,
+            visible_rows_timer,
+            context_menu,
+            pin,
+            unpin,
+            load_before,
+            load_after,
+            clear_rules,
+            rows: RwLock::new(PackRows::default()),
+            conflicts: RwLock::new(HashMap::new()),
+            filter_index: RwLock::new(FilterIndex::default()),
         });
 
         let slots = PackListUISlots::new(&list);
@@ -107,77 +235,628 @@ impl PackListUI {
     pub unsafe fn set_connections(&self, slots: &PackListUISlots) {
         self.filter_line_edit().text_changed().connect(slots.filter_line_edit());
         self.filter_case_sensitive_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_regex_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_categories_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_paths_button().toggled().connect(slots.filter_case_sensitive_button());
+        self.filter_fuzzy_button().toggled().connect(slots.filter_case_sensitive_button());
         self.filter_timer().timeout().connect(slots.filter_trigger());
+        self.table_view().custom_context_menu_requested().connect(slots.context_menu());
+        self.table_view().vertical_scroll_bar().value_changed().connect(slots.request_visible_rows());
+        self.table_view().vertical_scroll_bar().range_changed().connect(slots.request_visible_rows());
+        self.visible_rows_timer().timeout().connect(slots.fill_visible_rows());
     }
 
-    pub unsafe fn load(&self, game_config: &GameConfig) -> Result<()> {
-        self.model().clear();
+    pub unsafe fn load(&self, game_config: &GameConfig, pack_cache: &PackCache) -> Result<()> {
+        self.clear();
 
         // Pre-sort the mods.
-        let mut mods = game_config.mods()
-            .values()
-            .filter(|modd| *modd.enabled() && !modd.paths().is_empty())
+        let solved = solve_load_order(game_config, pack_cache);
+        let cycles = !solved.cycles().is_empty();
+        let mods = solved.into_mods();
+        let orders = order_keys(mods.iter().map(|(key, _)| key));
+
+        let mut filter_index = self.filter_index.write().unwrap();
+        for (index, (_, modd)) in mods.iter().enumerate() {
+            let row = Self::new_row(modd, index);
+            self.model().append_row_q_list_of_q_standard_item(row.into_ptr().as_ref().unwrap());
+            filter_index.insert(modd);
+        }
+
+        let mut rows = PackRows::new(mods.iter()
+            .zip(orders)
+            .enumerate()
+            .map(|(index, ((key, modd), order))| PackRow::new(key.clone(), order, modd, index))
+            .collect());
+        rows.cycles = cycles;
+
+        // Links go both ways, so rules are linked from one side and dependencies from the mod that needs them.
+        let listed = |mod_id: &str| game_config.mod_handle(mod_id).filter(|handle| rows.contains(*handle));
+        let mut links = game_config.load_order().rules()
+            .iter()
+            .filter_map(|rule| Some((listed(rule.before())?, listed(rule.after())?)))
             .collect::<Vec<_>>();
 
-        mods.sort_unstable_by(|a, b| a.id().cmp(b.id()));
+        for (_, modd) in &mods {
+            links.extend(pack_cache.last_known_dependencies(&modd.paths()[0]).iter().filter_map(|dependency| Some((modd.handle(), listed(dependency)?))));
+        }
 
-        for (index, modd) in mods.iter().enumerate() {
-            let row = QListOfQStandardItem::new();
-            let pack_name = modd.paths()[0].file_name().unwrap().to_string_lossy().as_ref().to_owned();
-            let item_name = QStandardItem::from_q_string(&QString::from_std_str(&pack_name));
-            let pack = Pack::read_and_merge(&[modd.paths()[0].to_path_buf()], true, false)?;
-            let combined_name = format!("{}{}", pack.pfh_file_type() as u32, pack_name);
-            item_name.set_data_2a(&QVariant::from_q_string(&QString::from_std_str(combined_name)), 20);
+        for (a, b) in links {
+            if a != b {
+                rows.link(a, b);
+            }
+        }
 
-            let item_path = QStandardItem::from_q_string(&QString::from_std_str(&modd.paths()[0].to_string_lossy()));
-            let load_order = QStandardItem::from_q_string(&QString::from_std_str(index.to_string()));
-            let location = QStandardItem::from_q_string(&QString::from_std_str("tbd"));
+        *self.rows.write().unwrap() = rows;
+        drop(filter_index);
 
-            row.append_q_standard_item(&item_name.into_ptr().as_mut_raw_ptr());
-            row.append_q_standard_item(&item_path.into_ptr().as_mut_raw_ptr());
-            row.append_q_standard_item(&load_order.into_ptr().as_mut_raw_ptr());
-            row.append_q_standard_item(&location.into_ptr().as_mut_raw_ptr());
+        self.table_view().hide_column(COLUMN_PATH);
 
-            self.model().append_row_q_list_of_q_standard_item(row.into_ptr().as_ref().unwrap());
+        self.setup_columns();
+        self.resize_columns();
+        self.filter_list();
+
+        Ok(())
+    }
+
+    /// This function clears the list. Always use this instead of clearing the model directly, so the rows are kept in sync.
+    pub unsafe fn clear(&self) {
+        self.rows.write().unwrap().clear();
+        self.filter_index.write().unwrap().clear();
+        self.model().clear();
+    }
+
+    /// This function adds the row of a newly enabled mod, solving again only the mods linked to it by rules or dependencies.
+    ///
+    /// Only the rows whose place in the load order changed get moved. The rest of the list is not touched.
+    pub unsafe fn insert_pack(&self, game_config: &GameConfig, modd: &Mod, pack_cache: &PackCache, graph: &DependencyGraph) -> Result<()> {
+        if modd.paths().is_empty() {
+            return Ok(());
         }
 
-        // Sort first by pack type, then by ascii order.
-        self.table_view().hide_column(1);
+        let mut rows = self.rows.write().unwrap();
+        if rows.contains(modd.handle()) {
+            return Ok(());
+        }
 
-        self.setup_columns();
-        self.table_view().resize_columns_to_contents();
+        for linked in Self::linked_handles(game_config, modd, graph, &rows) {
+            rows.link(modd.handle(), linked);
+        }
+
+        self.filter_index.write().unwrap().insert(modd);
+        self.solve_groups(game_config, pack_cache, rows, &[modd.handle()])
+    }
+
+    /// This function removes the row of a disabled mod, solving again only the mods that were linked to it.
+    pub unsafe fn remove_pack(&self, game_config: &GameConfig, mod_id: &str, pack_cache: &PackCache) -> Result<()> {
+        let handle = match game_config.mod_handle(mod_id) {
+            Some(handle) => handle,
+            None => return Ok(()),
+        };
+
+        let mut rows = self.rows.write().unwrap();
+        if let Some(index) = rows.position(handle) {
+            self.model().remove_row_1a(index as i32);
+            rows.remove(index);
+            self.filter_index.write().unwrap().remove(handle);
+
+            let linked = rows.unlink(handle);
+            self.solve_groups(game_config, pack_cache, rows, &linked)?;
+        }
 
         Ok(())
     }
 
+    /// This function moves the row of a mod to its new place, if its sort key or the mods it's linked to changed.
+    pub unsafe fn update_pack(&self, game_config: &GameConfig, modd: &Mod, pack_cache: &PackCache, graph: &DependencyGraph) -> Result<()> {
+        let mut rows = self.rows.write().unwrap();
+        let index = match rows.position(modd.handle()) {
+            Some(index) => index,
+            None => return Ok(()),
+        };
+
+        let key = load_order_key(modd, game_config.load_order(), pack_cache);
+        let linked = Self::linked_handles(game_config, modd, graph, &rows);
+        if rows[index].key == key && rows.linked(modd.handle()) == linked.as_slice() {
+            return Ok(());
+        }
+
+        // Its old group may split without it, so all of its old links get solved again too.
+        let mut groups = rows.unlink(modd.handle());
+        for linked in linked {
+            rows.link(modd.handle(), linked);
+        }
+
+        groups.push(modd.handle());
+        self.solve_groups(game_config, pack_cache, rows, &groups)
+    }
+
+    /// This function updates the rows of the mods a profile changed, after applying it to the game config.
+    ///
+    /// Big diffs are applied by rebuilding the list, as moving most rows one by one costs more than building them again.
+    pub unsafe fn apply_profile_diff(&self, game_config: &GameConfig, diff: &ProfileDiff, pack_cache: &PackCache, graph: &DependencyGraph) -> Result<()> {
+        if diff.len() > PROFILE_DIFF_ROWS_MAX {
+            return self.load(game_config, pack_cache);
+        }
+
+        for handle in diff.disable() {
+            if let Some(mod_id) = game_config.mod_id(*handle) {
+                self.remove_pack(game_config, mod_id, pack_cache)?;
+            }
+        }
+
+        for handle in diff.enable() {
+            if let Some(modd) = game_config.mod_by_handle(*handle) {
+                self.insert_pack(game_config, modd, pack_cache, graph)?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// This function solves again the groups of linked mods of the provided mods, and moves the rows whose order key changed.
+    ///
+    /// Mods of the groups without a row get one. Groups with cycles of rules can't be solved on their own, so then the list is rebuilt.
+    unsafe fn solve_groups(&self, game_config: &GameConfig, pack_cache: &PackCache, mut rows: RwLockWriteGuard<PackRows>, handles: &[ModHandle]) -> Result<()> {
+        if rows.cycles {
+            drop(rows);
+            return self.load(game_config, pack_cache);
+        }
+
+        let mut solved = HashSet::new();
+        for handle in handles {
+            if solved.contains(handle) {
+                continue;
+            }
+
+            let group = rows.group(*handle);
+            solved.extend(group.iter().copied());
+
+            let mods = group.iter()
+                .filter_map(|handle| game_config.mod_by_handle(*handle))
+                .map(|modd| (load_order_key(modd, game_config.load_order(), pack_cache), modd))
+                .collect::<Vec<_>>();
+
+            let group_order = solve_mods(mods, game_config.load_order(), pack_cache);
+            if !group_order.cycles().is_empty() {
+                drop(rows);
+                return self.load(game_config, pack_cache);
+            }
+
+            let mods = group_order.into_mods();
+            let orders = order_keys(mods.iter().map(|(key, _)| key));
+            for ((key, modd), order) in mods.into_iter().zip(orders) {
+                let current = rows.position(modd.handle());
+                if let Some(index) = current {
+                    if rows[index].key == key && rows[index].order == order {
+                        continue;
+                    }
+
+                    self.model().remove_row_1a(index as i32);
+                    rows.remove(index);
+                }
+
+                let index = rows.binary_search_by(|row| row.order.cmp(&order)).unwrap_or_else(|index| index);
+                let row = Self::new_row(modd, index);
+                self.model().insert_row_int_q_list_of_q_standard_item(index as i32, row.into_ptr().as_ref().unwrap());
+                rows.insert(index, PackRow::new(key, order, modd, index));
+            }
+        }
+
+        self.visible_rows_timer().start_0a();
+        Ok(())
+    }
+
+    /// This function returns the mods in the list the provided one is linked to, by rules or dependencies in any direction, sorted.
+    fn linked_handles(game_config: &GameConfig, modd: &Mod, graph: &DependencyGraph, rows: &PackRows) -> Vec<ModHandle> {
+        let mut linked = rule_links(modd.id(), game_config.load_order())
+            .chain(graph.dependencies(modd.id()).iter().map(|dependency| dependency.as_str()))
+            .chain(graph.enabled_dependents(game_config, modd.id()))
+            .filter_map(|mod_id| game_config.mod_handle(mod_id))
+            .filter(|handle| *handle != modd.handle() && rows.contains(*handle))
+            .collect::<Vec<_>>();
+
+        linked.sort_unstable();
+        linked.dedup();
+        linked
+    }
+
+    /// This function returns the ids of the mods of the selected rows, in load order.
+    pub unsafe fn selected_mod_ids(&self) -> Vec<String> {
+        let pack_rows = self.rows.read().unwrap();
+        let indexes = self.table_view().selection_model().selected_rows_0a();
+        let mut rows = (0..indexes.count_0a())
+            .map(|index| self.filter().map_to_source(indexes.at(index)).row())
+            .filter(|row| *row >= 0)
+            .map(|row| row as usize)
+            .collect::<Vec<_>>();
+        rows.sort_unstable();
+
+        rows.into_iter().filter_map(|row| pack_rows.get(row)).map(|row| row.key.id().to_owned()).collect()
+    }
+
+    /// This function returns the ids of the mods in the list, in load order.
+    pub fn mod_ids(&self) -> Vec<String> {
+        self.rows.read().unwrap().iter().map(|row| row.key.id().to_owned()).collect()
+    }
+
+    /// This function fills the path, location and conflicts of the rows shown by the view that are not yet filled, and fixes
+    /// their load order if rows were inserted or removed before them.
+    pub unsafe fn fill_visible_rows(&self) {
+        let visible = self.visible_rows();
+        let mut rows = self.rows.write().unwrap();
+        let conflicts = self.conflicts.read().unwrap();
+        for index in visible {
+            if let Some(row) = rows.get_mut(index) {
+                if row.load_order != index {
+                    let item_load_order = self.model().item_2a(index as i32, COLUMN_LOAD_ORDER);
+                    if !item_load_order.is_null() {
+                        item_load_order.set_text(&QString::from_std_str(index.to_string()));
+                    }
+
+                    row.load_order = index;
+                }
+
+                if !row.filled {
+                    let item_path = self.model().item_2a(index as i32, COLUMN_PATH);
+                    if !item_path.is_null() {
+                        item_path.set_text(&QString::from_std_str(row.path.to_string_lossy()));
+                    }
+
+                    let item_location = self.model().item_2a(index as i32, COLUMN_LOCATION);
+                    if !item_location.is_null() {
+                        item_location.set_text(&Self::location(&row.path));
+                    }
+
+                    let item_conflicts = self.model().item_2a(index as i32, COLUMN_CONFLICTS);
+                    if !item_conflicts.is_null() {
+                        Self::set_conflicts_item(&item_conflicts, conflicts.get(row.key.id()));
+                    }
+
+                    row.filled = true;
+                }
+            }
+        }
+    }
+
+    /// This function returns the rows of the model shown by the view, top to bottom.
+    unsafe fn visible_rows(&self) -> Vec<usize> {
+        let first = self.table_view().row_at(0);
+        if first < 0 {
+            return vec![];
+        }
+
+        // Past the last row, there's no row at the bottom of the viewport.
+        let last = match self.table_view().row_at(self.table_view().viewport().height() - 1) {
+            last if last < 0 => self.filter().row_count_0a() - 1,
+            last => last,
+        };
+
+        (first..=last)
+            .map(|row| self.filter().map_to_source(&self.filter().index_2a(row, COLUMN_NAME)).row())
+            .filter(|row| *row >= 0)
+            .map(|row| row as usize)
+            .collect()
+    }
+
+    /// This function updates the conflicts column with the results of the conflict analyzer.
+    pub unsafe fn set_conflicts(&self, game_config: &GameConfig, updates: HashMap<String, PackConflicts>) {
+        let rows = self.rows.read().unwrap();
+        let mut conflicts = self.conflicts.write().unwrap();
+        for (id, pack_conflicts) in updates {
+
+            // Rows not yet filled will pick them up when they're shown.
+            let index = game_config.mod_handle(&id).and_then(|handle| rows.position(handle)).filter(|index| rows[*index].filled);
+            if let Some(index) = index {
+                let item = self.model().item_2a(index as i32, COLUMN_CONFLICTS);
+                if !item.is_null() {
+                    Self::set_conflicts_item(&item, Some(&pack_conflicts));
+                }
+            }
+
+            if *pack_conflicts.files() > 0 {
+                conflicts.insert(id, pack_conflicts);
+            } else {
+                conflicts.remove(&id);
+            }
+        }
+    }
+
+    /// This function builds the row of a pack, with only its name and load order. The rest is filled once it's shown.
+    unsafe fn new_row(modd: &Mod, index: usize) -> CppBox<QListOfQStandardItem> {
+        let row = QListOfQStandardItem::new();
+        let pack_name = modd.paths()[0].file_name().unwrap().to_string_lossy();
+        let item_name = QStandardItem::from_q_string(&QString::from_std_str(&pack_name));
+
+        // New packs are visible until the next filter pass.
+        item_name.set_data_2a(&QVariant::from_q_string(&QString::from_std_str(FILTER_VISIBLE)), FILTER_ROLE);
+
+        let item_path = QStandardItem::new();
+        let load_order = QStandardItem::from_q_string(&QString::from_std_str(index.to_string()));
+        let location = QStandardItem::new();
+        let item_conflicts = QStandardItem::new();
+
+        row.append_q_standard_item(&item_name.into_ptr().as_mut_raw_ptr());
+        row.append_q_standard_item(&item_path.into_ptr().as_mut_raw_ptr());
+        row.append_q_standard_item(&load_order.into_ptr().as_mut_raw_ptr());
+        row.append_q_standard_item(&location.into_ptr().as_mut_raw_ptr());
+        row.append_q_standard_item(&item_conflicts.into_ptr().as_mut_raw_ptr());
+        row
+    }
+
+    /// This function returns where the pack loaded by the game is: data or content (workshop).
+    unsafe fn location(path: &Path) -> CppBox<QString> {
+        let in_data = path.parent()
+            .and_then(|folder| folder.file_name())
+            .map(|folder| folder.to_string_lossy().eq_ignore_ascii_case(DATA_FOLDER))
+            .unwrap_or(false);
+
+        if in_data {
+            qtr("location_data")
+        } else {
+            qtr("location_content")
+        }
+    }
+
+    unsafe fn set_conflicts_item(item: &QStandardItem, conflicts: Option<&PackConflicts>) {
+        match conflicts {
+            Some(conflicts) if *conflicts.files() > 0 => {
+                let mut tooltip = qtre("conflicts_tooltip", &[&conflicts.files().to_string(), &conflicts.tables().to_string()]).to_std_string();
+                if !conflicts.overwrites().is_empty() {
+                    tooltip.push_str("\n\n");
+                    tooltip.push_str(&qtre("conflicts_overwrites", &[&conflicts.overwrites().join("\n")]).to_std_string());
+                }
+
+                if !conflicts.overwritten_by().is_empty() {
+                    tooltip.push_str("\n\n");
+                    tooltip.push_str(&qtre("conflicts_overwritten_by", &[
+                        &conflicts.overwritten_files().to_string(),
+                        &conflicts.overwritten_tables().to_string(),
+                        &conflicts.overwritten_by().join("\n"),
+                    ]).to_std_string());
+                }
+
+                if !conflicts.overwritten_table_names().is_empty() {
+                    tooltip.push_str("\n\n");
+                    tooltip.push_str(&qtre("conflicts_overwritten_tables", &[&conflicts.overwritten_table_names().join("\n")]).to_std_string());
+                }
+
+                // Shared files, and how many of them the game doesn't load from this pack.
+                item.set_text(&qtre("conflicts_cell", &[&conflicts.files().to_string(), &conflicts.overwritten_files().to_string()]));
+                item.set_tool_tip(&QString::from_std_str(tooltip));
+            }
+            _ => {
+                item.set_text(&QString::new());
+                item.set_tool_tip(&QString::new());
+            }
+        }
+    }
+
     pub unsafe fn setup_columns(&self) {
         let pack_name = QStandardItem::from_q_string(&qtr("pack_name"));
         let pack_path = QStandardItem::from_q_string(&qtr("pack_path"));
         let load_order = QStandardItem::from_q_string(&qtr("load_order"));
         let location = QStandardItem::from_q_string(&qtr("location"));
+        let conflicts = QStandardItem::from_q_string(&qtr("conflicts"));
 
-        self.model.set_horizontal_header_item(0, pack_name.into_ptr());
-        self.model.set_horizontal_header_item(1, pack_path.into_ptr());
-        self.model.set_horizontal_header_item(2, load_order.into_ptr());
-        self.model.set_horizontal_header_item(3, location.into_ptr());
+        self.model.set_horizontal_header_item(COLUMN_NAME, pack_name.into_ptr());
+        self.model.set_horizontal_header_item(COLUMN_PATH, pack_path.into_ptr());
+        self.model.set_horizontal_header_item(COLUMN_LOAD_ORDER, load_order.into_ptr());
+        self.model.set_horizontal_header_item(COLUMN_LOCATION, location.into_ptr());
+        self.model.set_horizontal_header_item(COLUMN_CONFLICTS, conflicts.into_ptr());
     }
 
-    pub unsafe fn filter_list(&self) {
+    /// This function sizes the visible columns to fit their contents, measuring only the texts most likely to be the widest.
+    ///
+    /// Cells are filled lazily and `resize_columns_to_contents` measures every one of them, so using it would be both wrong and slow.
+    unsafe fn resize_columns(&self) {
+        let metrics = QFontMetrics::new_1a(self.table_view().font());
+        let header = self.table_view().horizontal_header();
+        let rows = self.rows.read().unwrap();
+        let conflicts = self.conflicts.read().unwrap();
+
+        // Numbers are as wide as their digits, so the widest conflicts cell is the one with the biggest counts.
+        let files = conflicts.values().map(|conflicts| *conflicts.files()).max();
+        let overwritten = conflicts.values().map(|conflicts| *conflicts.overwritten_files()).max();
+        let conflicts_cell = match (files, overwritten) {
+            (Some(files), Some(overwritten)) => vec![qtre("conflicts_cell", &[&files.to_string(), &overwritten.to_string()])],
+            _ => vec![],
+        };
+
+        let names = longest_texts(rows.iter().map(|row| row.key.id().as_str()))
+            .into_iter()
+            .map(QString::from_std_str)
+            .collect();
+        let load_orders = vec![QString::from_std_str(rows.len().saturating_sub(1).to_string())];
+        let locations = vec![qtr("location_data"), qtr("location_content")];
+
+        for (column, texts) in [(COLUMN_NAME, names), (COLUMN_LOAD_ORDER, load_orders), (COLUMN_LOCATION, locations), (COLUMN_CONFLICTS, conflicts_cell)] {
+            let width = texts.iter()
+                .map(|text| metrics.horizontal_advance_q_string(text) + CELL_PADDING)
+                .fold(header.section_size_hint(column), i32::max);
+
+            self.table_view().set_column_width(column, width);
+        }
+    }
 
-        // Set the pattern to search.
-        let pattern = QRegExp::new_1a(&self.filter_line_edit.text());
+    /// This function filters the list with the current search, through the filter index.
+    ///
+    /// The index decides which packs pass and leaves a flag in each row, so the proxy doesn't have to search anything.
+    pub unsafe fn filter_list(&self) {
+        let search = self.filter_line_edit().text().to_std_string();
+        let mut options = FilterOptions::default();
+        options.set_case_sensitive(self.filter_case_sensitive_button().is_checked());
+        options.set_regex(self.filter_regex_button().is_checked());
+        options.set_categories(self.filter_categories_button().is_checked());
+        options.set_paths(self.filter_paths_button().is_checked());
+        options.set_fuzzy(self.filter_fuzzy_button().is_checked());
+
+        let mut filter_index = self.filter_index.write().unwrap();
+        if filter_index.search(&search, &options) {
+            let visible = QVariant::from_q_string(&QString::from_std_str(FILTER_VISIBLE));
+            let hidden = QVariant::from_q_string(&QString::new());
+            let matches = filter_index.results().map(|(handle, _)| handle).collect::<HashSet<_>>();
+
+            // Rows keep their load order, even for fuzzy searches, so scores are not used here.
+            let blocked = self.model().block_signals(true);
+            for (index, row) in self.rows.read().unwrap().iter().enumerate() {
+                let item = self.model().item_2a(index as i32, COLUMN_NAME);
+                if !item.is_null() {
+                    item.set_data_2a(if matches.contains(&row.handle) { &visible } else { &hidden }, FILTER_ROLE);
+                }
+            }
+            self.model().block_signals(blocked);
+
+            self.filter().set_filter_fixed_string(&QString::from_std_str(FILTER_VISIBLE));
+            self.filter().invalidate();
+        }
 
-        // Check if the filter should be "Case Sensitive".
-        let case_sensitive = self.filter_case_sensitive_button.is_checked();
-        if case_sensitive { pattern.set_case_sensitivity(CaseSensitivity::CaseSensitive); }
-        else { pattern.set_case_sensitivity(CaseSensitivity::CaseInsensitive); }
+        // No search, so just let everything through.
+        else {
+            self.filter().set_filter_fixed_string(&QString::new());
+        }
 
-        // Filter whatever it's in that column by the text we got.
-        self.filter().set_filter_reg_exp_q_reg_exp(&pattern);
+        // Filtering changes which rows are shown.
+        self.visible_rows_timer().start_0a();
     }
 
     pub unsafe fn delayed_updates(&self) {
-        self.filter_timer.set_interval(500);
         self.filter_timer.start_0a();
     }
 }
+
+impl PackRow {
+    fn new(key: SortKey, order: OrderKey, modd: &Mod, load_order: usize) -> Self {
+        Self {
+            handle: modd.handle(),
+            key,
+            order,
+            path: modd.paths()[0].to_path_buf(),
+            filled: false,
+            load_order,
+        }
+    }
+}
+
+impl PackRows {
+    fn new(rows: Vec<PackRow>) -> Self {
+        let positions = rows.iter().map(|row| (row.handle, row.order.clone())).collect();
+        Self {
+            rows,
+            positions,
+            links: HashMap::new(),
+            cycles: false,
+        }
+    }
+
+    /// This function returns the position of the row of the provided mod, if it has one.
+    ///
+    /// Lists built with cycles of rules may not be sorted by order key, so those are searched one row at a time.
+    fn position(&self, handle: ModHandle) -> Option<usize> {
+        let order = self.positions.get(&handle)?;
+        if self.cycles {
+            self.rows.iter().position(|row| row.handle == handle)
+        } else {
+            self.rows.binary_search_by(|row| row.order.cmp(order)).ok()
+        }
+    }
+
+    fn contains(&self, handle: ModHandle) -> bool {
+        self.positions.contains_key(&handle)
+    }
+
+    fn insert(&mut self, index: usize, row: PackRow) {
+        self.positions.insert(row.handle, row.order.clone());
+        self.rows.insert(index, row);
+    }
+
+    fn remove(&mut self, index: usize) -> PackRow {
+        let row = self.rows.remove(index);
+        self.positions.remove(&row.handle);
+        row
+    }
+
+    fn clear(&mut self) {
+        self.rows.clear();
+        self.positions.clear();
+        self.links.clear();
+        self.cycles = false;
+    }
+
+    /// This function links two mods both ways, so each one is in the group of the other.
+    fn link(&mut self, a: ModHandle, b: ModHandle) {
+        for (from, to) in [(a, b), (b, a)] {
+            let links = self.links.entry(from).or_default();
+            if let Err(index) = links.binary_search(&to) {
+                links.insert(index, to);
+            }
+        }
+    }
+
+    /// This function removes all the links of a mod, returning the mods it was linked to.
+    fn unlink(&mut self, handle: ModHandle) -> Vec<ModHandle> {
+        let linked = self.links.remove(&handle).unwrap_or_default();
+        for other in &linked {
+            if let Some(links) = self.links.get_mut(other) {
+                links.retain(|link| *link != handle);
+                if links.is_empty() {
+                    self.links.remove(other);
+                }
+            }
+        }
+
+        linked
+    }
+
+    /// This function returns the mods a mod is linked to, sorted.
+    fn linked(&self, handle: ModHandle) -> &[ModHandle] {
+        self.links.get(&handle).map(|links| links.as_slice()).unwrap_or_default()
+    }
+
+    /// This function returns the mods linked to a mod, directly or through others, the mod itself included.
+    fn group(&self, handle: ModHandle) -> Vec<ModHandle> {
+        let mut group = vec![handle];
+        let mut seen = HashSet::from([handle]);
+        let mut next = 0;
+        while next < group.len() {
+            for linked in self.linked(group[next]) {
+                if seen.insert(*linked) {
+                    group.push(*linked);
+                }
+            }
+
+            next += 1;
+        }
+
+        group
+    }
+}
+
+impl Deref for PackRows {
+    type Target = [PackRow];
+
+    fn deref(&self) -> &Self::Target {
+        &self.rows
+    }
+}
+
+// Only the contents of the rows can be changed through this. Their order and mods can't.
+impl DerefMut for PackRows {
+    fn deref_mut(&mut self) -> &mut Self::Target {
+        &mut self.rows
+    }
+}
+
+/// This function returns the [COLUMN_WIDTH_SAMPLES] longest of the provided texts, by length in bytes.
+///
+/// Only the longest ones found so far are kept, in a heap of fixed size, so nothing is copied or sorted besides them.
+fn longest_texts<'a>(texts: impl Iterator<Item = &'a str>) -> Vec<&'a str> {
+    let mut longest = BinaryHeap::with_capacity(COLUMN_WIDTH_SAMPLES + 1);
+    for text in texts {
+        longest.push(Reverse((text.len(), text)));
+        if longest.len() > COLUMN_WIDTH_SAMPLES {
+            longest.pop();
+        }
+    }
+
+    longest.into_iter().map(|Reverse((_, text))| text).collect()
+}
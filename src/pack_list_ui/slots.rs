@@ -8,8 +8,10 @@
 // https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
 //---------------------------------------------------------------------------//
 
+use qt_gui::QCursor;
+
 use qt_core::QBox;
-use qt_core::{SlotNoArgs, SlotOfQString};
+use qt_core::{SlotNoArgs, SlotOfQPoint, SlotOfQString};
 
 use std::sync::Arc;
 
@@ -27,6 +29,9 @@ pub struct PackListUISlots {
     filter_line_edit: QBox<SlotOfQString>,
     filter_case_sensitive_button: QBox<SlotNoArgs>,
     filter_trigger: QBox<SlotNoArgs>,
+    context_menu: QBox<SlotOfQPoint>,
+    request_visible_rows: QBox<SlotNoArgs>,
+    fill_visible_rows: QBox<SlotNoArgs>,
 }
 
 //-------------------------------------------------------------------------------//
@@ -51,10 +56,34 @@ impl PackListUISlots {
             view.filter_list();
         }));
 
+        let context_menu = SlotOfQPoint::new(&view.table_view, clone!(
+            view => move |_| {
+            let selected = !view.table_view().selection_model().selected_rows_0a().is_empty();
+            view.pin().set_enabled(selected);
+            view.unpin().set_enabled(selected);
+            view.load_before().set_enabled(selected);
+            view.load_after().set_enabled(selected);
+            view.clear_rules().set_enabled(selected);
+            view.context_menu().exec_1a_mut(&QCursor::pos_0a());
+        }));
+
+        let request_visible_rows = SlotNoArgs::new(&view.table_view, clone!(
+            view => move || {
+            view.visible_rows_timer().start_0a();
+        }));
+
+        let fill_visible_rows = SlotNoArgs::new(&view.table_view, clone!(
+            view => move || {
+            view.fill_visible_rows();
+        }));
+
         Self {
             filter_line_edit,
             filter_case_sensitive_button,
             filter_trigger,
+            context_menu,
+            request_visible_rows,
+            fill_visible_rows,
         }
     }
 }
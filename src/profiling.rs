@@ -0,0 +1,232 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2017-2023 Ismael Gutiérrez González. All rights reserved.
+//
+// This file is part of the Rusted PackFile Manager (RPFM) project,
+// which can be found here: https://github.com/Frodo45127/rpfm.
+//
+// This file is licensed under the MIT license, which can be found here:
+// https://github.com/Frodo45127/rpfm/blob/master/LICENSE.
+//---------------------------------------------------------------------------//
+
+//! Timing of the slow parts of the program.
+//!
+//! Startup phases, game switches and Pack reads are wrapped in [Span]s, which record how long they took when dropped. Recorded
+//! spans can be seen summarized from the Debug menu, or exported as a Chrome trace, to open in `chrome://tracing` or Perfetto
+//! and see what ran when and on which thread.
+//!
+//! Spans cost two clock reads and a short lock, so they're always on. Once [MAX_SPANS] have been recorded, new ones are dropped.
+
+use anyhow::Result;
+use lazy_static::lazy_static;
+use serde::Serialize;
+
+use std::cell::Cell;
+use std::collections::HashMap;
+use std::fmt::Write;
+use std::path::Path;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::thread;
+use std::time::Instant;
+
+use crate::integrations::write_atomic;
+
+/// Max amount of spans kept. Way more than the spans of a few game switches with thousands of mods.
+const MAX_SPANS: usize = 200_000;
+
+lazy_static! {
+
+    /// Time all span times are relative to.
+    static ref START: Instant = Instant::now();
+    static ref SPANS: Mutex<Vec<SpanRecord>> = Mutex::new(vec![]);
+
+    /// Names of the threads that recorded spans, by thread id.
+    static ref THREAD_NAMES: Mutex<HashMap<u64, String>> = Mutex::new(HashMap::new());
+}
+
+static NEXT_THREAD_ID: AtomicU64 = AtomicU64::new(1);
+
+thread_local! {
+    static THREAD_ID: Cell<u64> = Cell::new(0);
+}
+
+//-------------------------------------------------------------------------------//
+//                              Enums & Structs
+//-------------------------------------------------------------------------------//
+
+/// A running span. Records itself when dropped.
+#[must_use = "Spans record the time until they're dropped. If you don't hold it, it records nothing."]
+#[derive(Debug)]
+pub struct Span {
+    name: &'static str,
+    detail: Option<String>,
+    start: Instant,
+}
+
+/// A finished span.
+#[derive(Clone, Debug)]
+pub struct SpanRecord {
+    name: &'static str,
+
+    // What the span was about, like the path of the Pack read.
+    detail: Option<String>,
+    thread_id: u64,
+
+    // Start and duration of the span, in microseconds. Start is relative to the first span of the program.
+    start: u64,
+    duration: u64,
+}
+
+/// An event of a Chrome trace.
+#[derive(Serialize)]
+struct TraceEvent<'a> {
+    name: &'a str,
+    ph: &'static str,
+    pid: u32,
+    tid: u64,
+
+    #[serde(skip_serializing_if = "Option::is_none")]
+    ts: Option<u64>,
+
+    #[serde(skip_serializing_if = "Option::is_none")]
+    dur: Option<u64>,
+
+    #[serde(skip_serializing_if = "Option::is_none")]
+    args: Option<HashMap<&'static str, &'a str>>,
+}
+
+#[derive(Serialize)]
+struct Trace<'a> {
+    #[serde(rename = "traceEvents")]
+    trace_events: Vec<TraceEvent<'a>>,
+}
+
+//-------------------------------------------------------------------------------//
+//                             Implementations
+//-------------------------------------------------------------------------------//
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        let record = SpanRecord {
+            name: self.name,
+            detail: self.detail.take(),
+            thread_id: thread_id(),
+            start: self.start.saturating_duration_since(*START).as_micros() as u64,
+            duration: self.start.elapsed().as_micros() as u64,
+        };
+
+        let mut spans = SPANS.lock().unwrap();
+        if spans.len() < MAX_SPANS {
+            spans.push(record);
+        }
+    }
+}
+
+/// This function starts a span, that ends when the returned value is dropped.
+pub fn span(name: &'static str) -> Span {
+    span_inner(name, None)
+}
+
+/// This function starts a span with some detail of what it's about, that ends when the returned value is dropped.
+pub fn span_with(name: &'static str, detail: impl Into<String>) -> Span {
+    span_inner(name, Some(detail.into()))
+}
+
+fn span_inner(name: &'static str, detail: Option<String>) -> Span {
+
+    // Make sure the start is set before the first span starts, so no span starts before it.
+    lazy_static::initialize(&START);
+    Span {
+        name,
+        detail,
+        start: Instant::now(),
+    }
+}
+
+/// This function returns a summary of all the spans recorded, grouped by name, in the order they first ran.
+///
+/// Spans with a detail, like game switches, are also listed one by one, so each run can be compared with the others.
+pub fn summary() -> String {
+    let spans = SPANS.lock().unwrap();
+
+    // Spans are recorded when they end, so outer spans come after the ones inside them. Order them by start instead.
+    let mut groups: HashMap<&str, (usize, u64, u64, u64)> = HashMap::new();
+    for span in spans.iter() {
+        let group = groups.entry(span.name).or_insert((0, 0, 0, span.start));
+        group.0 += 1;
+        group.1 += span.duration;
+        group.2 = group.2.max(span.duration);
+        group.3 = group.3.min(span.start);
+    }
+
+    let mut order = groups.keys().copied().collect::<Vec<_>>();
+    order.sort_by_key(|name| groups[name].3);
+
+    let mut summary = String::new();
+    let _ = writeln!(summary, "{:<32} {:>8} {:>12} {:>12}", "Span", "Count", "Total (ms)", "Max (ms)");
+    for name in &order {
+        let (count, total, max, _) = groups[name];
+        let _ = writeln!(summary, "{:<32} {:>8} {:>12.2} {:>12.2}", name, count, total as f64 / 1000.0, max as f64 / 1000.0);
+    }
+
+    // Only spans that don't run per-Pack are worth listing one by one.
+    let _ = writeln!(summary);
+    let mut detailed = spans.iter().filter(|span| span.detail.is_some() && groups[span.name].0 <= 32).collect::<Vec<_>>();
+    detailed.sort_by_key(|span| span.start);
+    for span in detailed {
+        if let Some(ref detail) = span.detail {
+            let _ = writeln!(summary, "{:<32} {:>12.2} ms  {}", span.name, span.duration as f64 / 1000.0, detail);
+        }
+    }
+
+    if spans.len() >= MAX_SPANS {
+        let _ = writeln!(summary, "\nSpan limit reached. Later spans have not been recorded.");
+    }
+
+    summary
+}
+
+/// This function exports all the spans recorded as a Chrome trace, in json.
+pub fn export_chrome_trace(path: &Path) -> Result<()> {
+    let spans = SPANS.lock().unwrap();
+    let thread_names = THREAD_NAMES.lock().unwrap();
+
+    let mut trace_events = thread_names.iter()
+        .map(|(thread_id, name)| TraceEvent {
+            name: "thread_name",
+            ph: "M",
+            pid: 1,
+            tid: *thread_id,
+            ts: None,
+            dur: None,
+            args: Some(HashMap::from([("name", name.as_str())])),
+        })
+        .collect::<Vec<_>>();
+
+    trace_events.extend(spans.iter().map(|span| TraceEvent {
+        name: span.name,
+        ph: "X",
+        pid: 1,
+        tid: span.thread_id,
+        ts: Some(span.start),
+        dur: Some(span.duration),
+        args: span.detail.as_deref().map(|detail| HashMap::from([("detail", detail)])),
+    }));
+
+    write_atomic(path, &serde_json::to_vec(&Trace { trace_events })?)
+}
+
+/// This function returns a small, stable id for the current thread, registering its name the first time.
+fn thread_id() -> u64 {
+    THREAD_ID.with(|id| {
+        if id.get() == 0 {
+            let new_id = NEXT_THREAD_ID.fetch_add(1, Ordering::SeqCst);
+            let current = thread::current();
+            let name = current.name().map(|name| name.to_owned()).unwrap_or_else(|| format!("thread_{new_id}"));
+            THREAD_NAMES.lock().unwrap().insert(new_id, name);
+            id.set(new_id);
+        }
+
+        id.get()
+    })
+}
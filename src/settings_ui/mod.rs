@@ -19,6 +19,7 @@ use qt_widgets::QLabel;
 use qt_widgets::QLineEdit;
 use qt_widgets::QMainWindow;
 use qt_widgets::QPushButton;
+use qt_widgets::QSpinBox;
 use qt_widgets::QToolButton;
 
 use qt_gui::QStandardItemModel;
@@ -45,7 +46,9 @@ use rpfm_ui_common::PROGRAM_NAME;
 use rpfm_ui_common::settings::*;
 use rpfm_ui_common::utils::*;
 
+use crate::integrations::{ConfigFormat, game_install_path};
 use crate::SUPPORTED_GAMES;
+use crate::profiling::span_with;
 
 use self::slots::SettingsUISlots;
 
@@ -54,6 +57,21 @@ mod slots;
 const VIEW_DEBUG: &str = "ui_templates/settings_dialog.ui";
 const VIEW_RELEASE: &str = "ui/settings_dialog.ui";
 
+/// Config formats available in the settings, in the order they're shown.
+const CONFIG_FORMATS: [ConfigFormat; 3] = [ConfigFormat::Binary, ConfigFormat::Json, ConfigFormat::PrettyJson];
+
+/// Default memory budget of the thumbnails, in MB.
+const THUMBNAIL_CACHE_BUDGET_DEFAULT: i32 = 32;
+
+/// Max memory budget of the thumbnails, in MB.
+const THUMBNAIL_CACHE_BUDGET_MAX: i32 = 1024;
+
+/// Max size of the mods that can be merged on launch, in MB.
+const MERGE_SMALL_MODS_MAX: i32 = 1024;
+
+/// Max amount of the enabled packs read ahead of launching, in MB.
+const PREWARM_BUDGET_MAX: i32 = 65536;
+
 //-------------------------------------------------------------------------------//
 //                              Enums & Structs
 //-------------------------------------------------------------------------------//
@@ -68,6 +86,10 @@ pub struct SettingsUI {
 
     default_game_combobox: QPtr<QComboBox>,
     update_chanel_combobox: QPtr<QComboBox>,
+    config_format_combobox: QBox<QComboBox>,
+    thumbnail_cache_budget_spinbox: QBox<QSpinBox>,
+    merge_small_mods_spinbox: QBox<QSpinBox>,
+    prewarm_budget_spinbox: QBox<QSpinBox>,
 
     default_game_model: QBox<QStandardItemModel>,
     update_chanel_model: QBox<QStandardItemModel>,
@@ -105,7 +127,10 @@ impl SettingsUI {
 
         // Load the UI Template.
         let template_path = if cfg!(debug_assertions) { VIEW_DEBUG } else { VIEW_RELEASE };
-        let main_widget = load_template(main_window, template_path)?;
+        let main_widget = {
+            let _span = span_with("load_template", template_path);
+            load_template(main_window, template_path)?
+        };
         let dialog: QPtr<QDialog> = main_widget.static_downcast();
 
         let paths_groupbox: QPtr<QGroupBox> = find_widget(&main_widget.static_upcast(), "paths_groupbox")?;
@@ -122,6 +147,49 @@ impl SettingsUI {
         default_game_label.set_text(&qtr("default_game"));
         update_chanel_label.set_text(&qtr("update_channel"));
 
+        // Tweaks not in the template go after the ones in it.
+        let tweaks_groupbox: QPtr<QGroupBox> = find_widget(&main_widget.static_upcast(), "tweaks_groupbox")?;
+        let tweaks_layout: QPtr<QGridLayout> = tweaks_groupbox.layout().static_downcast();
+
+        let config_format_label = QLabel::from_q_string_q_widget(&qtr("config_format"), &tweaks_groupbox);
+        let config_format_combobox = QComboBox::new_1a(&tweaks_groupbox);
+        for format in CONFIG_FORMATS {
+            config_format_combobox.add_item_q_string(&qtr(&format!("config_format_{}", format.key())));
+        }
+
+        tweaks_layout.add_widget_5a(&config_format_label, 2, 0, 1, 1);
+        tweaks_layout.add_widget_5a(&config_format_combobox, 2, 1, 1, 1);
+
+        let thumbnail_cache_budget_label = QLabel::from_q_string_q_widget(&qtr("thumbnail_cache_budget"), &tweaks_groupbox);
+        let thumbnail_cache_budget_spinbox = QSpinBox::new_1a(&tweaks_groupbox);
+        thumbnail_cache_budget_spinbox.set_range(0, THUMBNAIL_CACHE_BUDGET_MAX);
+        thumbnail_cache_budget_spinbox.set_suffix(&QString::from_std_str(" MB"));
+
+        tweaks_layout.add_widget_5a(&thumbnail_cache_budget_label, 3, 0, 1, 1);
+        tweaks_layout.add_widget_5a(&thumbnail_cache_budget_spinbox, 3, 1, 1, 1);
+
+        // Zero means mods are never merged.
+        let merge_small_mods_label = QLabel::from_q_string_q_widget(&qtr("merge_small_mods"), &tweaks_groupbox);
+        let merge_small_mods_spinbox = QSpinBox::new_1a(&tweaks_groupbox);
+        merge_small_mods_spinbox.set_range(0, MERGE_SMALL_MODS_MAX);
+        merge_small_mods_spinbox.set_suffix(&QString::from_std_str(" MB"));
+        merge_small_mods_spinbox.set_special_value_text(&qtr("merge_small_mods_disabled"));
+        merge_small_mods_spinbox.set_tool_tip(&qtr("merge_small_mods_tooltip"));
+
+        tweaks_layout.add_widget_5a(&merge_small_mods_label, 4, 0, 1, 1);
+        tweaks_layout.add_widget_5a(&merge_small_mods_spinbox, 4, 1, 1, 1);
+
+        // Zero means packs are never prewarmed.
+        let prewarm_budget_label = QLabel::from_q_string_q_widget(&qtr("prewarm_budget"), &tweaks_groupbox);
+        let prewarm_budget_spinbox = QSpinBox::new_1a(&tweaks_groupbox);
+        prewarm_budget_spinbox.set_range(0, PREWARM_BUDGET_MAX);
+        prewarm_budget_spinbox.set_suffix(&QString::from_std_str(" MB"));
+        prewarm_budget_spinbox.set_special_value_text(&qtr("prewarm_budget_disabled"));
+        prewarm_budget_spinbox.set_tool_tip(&qtr("prewarm_budget_tooltip"));
+
+        tweaks_layout.add_widget_5a(&prewarm_budget_label, 5, 0, 1, 1);
+        tweaks_layout.add_widget_5a(&prewarm_budget_spinbox, 5, 1, 1, 1);
+
         // We automatically add a Label/LineEdit/Button for each game we support.
         let mut paths_games_line_edits = BTreeMap::new();
         let mut paths_games_buttons = BTreeMap::new();
@@ -158,6 +226,10 @@ impl SettingsUI {
             paths_games_buttons,
             default_game_combobox,
             update_chanel_combobox,
+            config_format_combobox,
+            thumbnail_cache_budget_spinbox,
+            merge_small_mods_spinbox,
+            prewarm_budget_spinbox,
             default_game_model,
             update_chanel_model,
 
@@ -172,11 +244,13 @@ impl SettingsUI {
     pub unsafe fn load(&self) -> Result<()> {
         let q_settings = settings();
 
-        // Load the Game Paths, if they exists.
+        // Load the Game Paths, if they exists. Games without one get the one of their install, if we find it.
         for (key, path) in self.paths_games_line_edits.iter() {
             let stored_path = setting_string(key);
             if !stored_path.is_empty() {
                 path.set_text(&QString::from_std_str(setting_string_from_q_setting(&q_settings, key)));
+            } else if let Some(install_path) = SUPPORTED_GAMES.game(key).and_then(game_install_path) {
+                path.set_text(&QString::from_std_str(install_path.to_string_lossy()));
             }
         }
 
@@ -189,6 +263,15 @@ impl SettingsUI {
             }
         }
 
+        let config_format = config_format();
+        if let Some(index) = CONFIG_FORMATS.iter().position(|format| *format == config_format) {
+            self.config_format_combobox.set_current_index(index as i32);
+        }
+
+        self.thumbnail_cache_budget_spinbox.set_value(setting_int_from_q_setting(&q_settings, "thumbnail_cache_budget"));
+        self.merge_small_mods_spinbox.set_value(setting_int_from_q_setting(&q_settings, "merge_small_mods"));
+        self.prewarm_budget_spinbox.set_value(setting_int_from_q_setting(&q_settings, "prewarm_budget"));
+
         //let language_selected = setting_string("language");
         //let language_selected_split = language_selected.split('_').collect::<Vec<&str>>()[0];
         //for (index, (language,_)) in Locale::get_available_locales()?.iter().enumerate() {
@@ -222,6 +305,14 @@ impl SettingsUI {
         game = game.replace(' ', "_").to_lowercase();
         set_setting_string_to_q_setting(&q_settings, "default_game", &game);
 
+        if let Some(format) = CONFIG_FORMATS.get(self.config_format_combobox.current_index() as usize) {
+            set_setting_string_to_q_setting(&q_settings, "config_format", format.key());
+        }
+
+        set_setting_int_to_q_setting(&q_settings, "thumbnail_cache_budget", self.thumbnail_cache_budget_spinbox.value());
+        set_setting_int_to_q_setting(&q_settings, "merge_small_mods", self.merge_small_mods_spinbox.value());
+        set_setting_int_to_q_setting(&q_settings, "prewarm_budget", self.prewarm_budget_spinbox.value());
+
         // We need to store the full locale filename, not just the visible name!
         //let mut language = self.general_language_combobox.current_text().to_std_string();
         //if let Some(index) = language.find('&') { language.remove(index); }
@@ -299,6 +390,9 @@ pub unsafe fn init_settings(main_window: &QPtr<QMainWindow>) {
     set_setting_if_new_q_byte_array(&q_settings, "originalWindowState", main_window.save_state_0a().as_ref());
 
     set_setting_string_to_q_setting(&q_settings, "default_game", "warhammer_3");
+    set_setting_if_new_int(&q_settings, "thumbnail_cache_budget", THUMBNAIL_CACHE_BUDGET_DEFAULT);
+    set_setting_if_new_int(&q_settings, "merge_small_mods", 0);
+    set_setting_if_new_int(&q_settings, "prewarm_budget", 0);
 
     q_settings.sync();
 }
@@ -314,13 +408,27 @@ pub fn init_config_path() -> Result<()> {
     *ORGANISATION.write().unwrap() = "FrodoWazEre".to_owned();
     *PROGRAM_NAME.write().unwrap() = "runcher".to_owned();
 
+    init_config_folders()
+}
+
+/// This function creates all the folders we need inside the config folder, if they don't exist yet.
+pub fn init_config_folders() -> Result<()> {
     DirBuilder::new().recursive(true).create(error_path()?)?;
     DirBuilder::new().recursive(true).create(game_config_path()?)?;
     DirBuilder::new().recursive(true).create(profiles_path()?)?;
+    DirBuilder::new().recursive(true).create(pack_cache_path()?)?;
+    DirBuilder::new().recursive(true).create(workshop_cache_path()?)?;
+    DirBuilder::new().recursive(true).create(thumbnail_cache_path()?)?;
+    DirBuilder::new().recursive(true).create(merged_packs_path()?)?;
 
     Ok(())
 }
 
+/// This function returns the format in which configs and profiles should be saved.
+pub fn config_format() -> ConfigFormat {
+    ConfigFormat::from_key(&setting_string("config_format"))
+}
+
 pub fn game_config_path() -> Result<PathBuf> {
     Ok(config_path()?.join("game_config"))
 }
@@ -328,3 +436,34 @@ pub fn game_config_path() -> Result<PathBuf> {
 pub fn profiles_path() -> Result<PathBuf> {
     Ok(config_path()?.join("profiles"))
 }
+
+pub fn pack_cache_path() -> Result<PathBuf> {
+    Ok(config_path()?.join("pack_cache"))
+}
+
+pub fn workshop_cache_path() -> Result<PathBuf> {
+    Ok(config_path()?.join("workshop_cache"))
+}
+
+pub fn thumbnail_cache_path() -> Result<PathBuf> {
+    Ok(config_path()?.join("thumbnail_cache"))
+}
+
+pub fn merged_packs_path() -> Result<PathBuf> {
+    Ok(config_path()?.join("merged_packs"))
+}
+
+/// This function returns the max amount of memory, in bytes, thumbnails can take.
+pub fn thumbnail_cache_budget() -> usize {
+    setting_int("thumbnail_cache_budget").max(0) as usize * 1024 * 1024
+}
+
+/// This function returns the max size, in bytes, of the mods merged on launch. Zero means mods are not merged.
+pub fn merge_small_mods_max_size() -> u64 {
+    setting_int("merge_small_mods").max(0) as u64 * 1024 * 1024
+}
+
+/// This function returns the max amount of bytes of the enabled packs read ahead of launching. Zero means packs are not prewarmed.
+pub fn prewarm_budget() -> u64 {
+    setting_int("prewarm_budget").max(0) as u64 * 1024 * 1024
+}